@@ -0,0 +1,247 @@
+// Offline asset cooker
+// Bake an OBJ model and its texture into one package that VkApplication maps at start up :
+// welded and reordered vertex/index streams with their meshlets and LOD chain, and a texture with its full mip chain already generated
+
+#include <iostream>
+#include <chrono>
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+
+#include "ObjLoader.h"
+#include "MeshOptimizer.h"
+#include "VertexPacking.h"
+#include "MeshletBuilder.h"
+#include "MeshSimplifier.h"
+#include "AssetPackage.h"
+
+namespace
+{
+	constexpr uint32_t kBytesPerPixel = 4;
+
+	float SrgbToLinear(uint8_t value)
+	{
+		float c = value / 255.0f;
+		return c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+	}
+
+	uint8_t LinearToSrgb(float value)
+	{
+		float c = value <= 0.0031308f ? value * 12.92f : 1.055f * std::pow(value, 1.0f / 2.4f) - 0.055f;
+		return static_cast<uint8_t>(std::min(std::max(c, 0.0f), 1.0f) * 255.0f + 0.5f);
+	}
+
+	uint32_t CalculateMipLevels(uint32_t width, uint32_t height)
+	{
+		return static_cast<uint32_t>(std::floor(std::log2(std::max(width, height)))) + 1;
+	}
+
+	// Build every mip level of an RGBA8 sRGB image with a 2x2 box filter
+	// Color channels are averaged in linear space, alpha is averaged as is
+	std::vector<uint8_t> BuildMipChain(const stbi_uc* pixels, uint32_t width, uint32_t height, uint32_t mipLevels)
+	{
+		uint64_t totalSize = 0;
+		for (uint32_t level = 0; level < mipLevels; ++level)
+			totalSize += VkUtils::GetMipLevelSize(width, height, level, kBytesPerPixel);
+
+		std::vector<uint8_t> chain(totalSize);
+		std::copy(pixels, pixels + VkUtils::GetMipLevelSize(width, height, 0, kBytesPerPixel), chain.begin());
+
+		float toLinear[256];
+		for (int i = 0; i < 256; ++i)
+			toLinear[i] = SrgbToLinear(static_cast<uint8_t>(i));
+
+		uint64_t srcOffset = 0;
+		for (uint32_t level = 1; level < mipLevels; ++level)
+		{
+			uint32_t srcWidth = std::max(1u, width >> (level - 1));
+			uint32_t srcHeight = std::max(1u, height >> (level - 1));
+			uint32_t dstWidth = std::max(1u, width >> level);
+			uint32_t dstHeight = std::max(1u, height >> level);
+			uint64_t dstOffset = srcOffset + VkUtils::GetMipLevelSize(width, height, level - 1, kBytesPerPixel);
+
+			const uint8_t* src = chain.data() + srcOffset;
+			uint8_t* dst = chain.data() + dstOffset;
+
+			for (uint32_t y = 0; y < dstHeight; ++y)
+			{
+				uint32_t y0 = std::min(2 * y, srcHeight - 1);
+				uint32_t y1 = std::min(2 * y + 1, srcHeight - 1);
+
+				for (uint32_t x = 0; x < dstWidth; ++x)
+				{
+					uint32_t x0 = std::min(2 * x, srcWidth - 1);
+					uint32_t x1 = std::min(2 * x + 1, srcWidth - 1);
+
+					const uint8_t* samples[4] = {
+						src + (y0 * srcWidth + x0) * kBytesPerPixel,
+						src + (y0 * srcWidth + x1) * kBytesPerPixel,
+						src + (y1 * srcWidth + x0) * kBytesPerPixel,
+						src + (y1 * srcWidth + x1) * kBytesPerPixel
+					};
+
+					uint8_t* texel = dst + (y * dstWidth + x) * kBytesPerPixel;
+					for (uint32_t c = 0; c < 3; ++c)
+					{
+						float sum = toLinear[samples[0][c]] + toLinear[samples[1][c]] + toLinear[samples[2][c]] + toLinear[samples[3][c]];
+						texel[c] = LinearToSrgb(sum * 0.25f);
+					}
+					texel[3] = static_cast<uint8_t>((samples[0][3] + samples[1][3] + samples[2][3] + samples[3][3] + 2) / 4);
+				}
+			}
+
+			srcOffset = dstOffset;
+		}
+
+		return chain;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 4)
+	{
+		std::cerr << "Usage : AssetCooker <model.obj> <texture> <output.vkpk> [--packed-vertices]\n";
+		return EXIT_FAILURE;
+	}
+
+	const char* modelPath = argv[1];
+	const char* texturePath = argv[2];
+	const char* outputPath = argv[3];
+	bool packVertices = argc > 4 && std::string(argv[4]) == "--packed-vertices";
+
+	try
+	{
+		auto startTime = std::chrono::high_resolution_clock::now();
+
+		std::vector<VkUtils::Vertex> vertices;
+		std::vector<uint32_t> indices;
+		VkUtils::ModelLoadStats stats;
+		VkUtils::LoadModelParallel(modelPath, vertices, indices, &stats);
+		auto optimizationStats = VkUtils::OptimizeMesh(vertices, indices);
+		size_t optimizedVertexCount = vertices.size();
+		auto subMeshes = VkUtils::SplitMeshForShortIndices(vertices, indices);
+		VkUtils::MeshletStats meshletStats;
+		std::vector<uint32_t> meshletIndices;
+		auto meshlets = VkUtils::BuildMeshlets(vertices, indices, subMeshes, meshletIndices, &meshletStats);
+		// LOD sub meshes go after the full detail ones, meshlets only cover LOD 0
+		auto lods = VkUtils::BuildLodChain(vertices, indices, subMeshes);
+		auto bounds = VkUtils::ComputeBoundingSphere(vertices);
+		auto shortIndices = VkUtils::ConvertToShortIndices(indices);
+		auto shortMeshletIndices = VkUtils::ConvertToShortIndices(meshletIndices);
+
+		int width, height, channel;
+		stbi_uc* pixels = stbi_load(texturePath, &width, &height, &channel, STBI_rgb_alpha);
+		if (!pixels)
+			throw std::runtime_error("\nERROR : Failed to load texture image from file !\n");
+
+		uint32_t mipLevels = CalculateMipLevels(width, height);
+		auto mipChain = BuildMipChain(pixels, width, height, mipLevels);
+		stbi_image_free(pixels);
+
+		VkUtils::AssetPackageWriter writer;
+		// Recorded so the renderer can tell when the package is older than its sources
+		if (!writer.SetSource(VkUtils::PackageSourceType::Model, modelPath) || !writer.SetSource(VkUtils::PackageSourceType::Texture, texturePath))
+			throw std::runtime_error("\nERROR : Failed to read source file attributes !\n");
+
+		std::vector<VkUtils::PackedVertex> packedVertices;
+		VkUtils::VertexQuantization quantization{};
+
+		VkUtils::PackageSection vertexSection{};
+		vertexSection.Type = VkUtils::PackageSectionType::VertexData;
+		vertexSection.ElementCount = static_cast<uint32_t>(vertices.size());
+		if (packVertices)
+		{
+			std::vector<VkUtils::SubMesh> fullDetailSubMeshes(subMeshes.begin(), subMeshes.begin() + lods[0].SubMeshCount);
+			quantization = VkUtils::PackVertices(vertices, indices, fullDetailSubMeshes, packedVertices);
+
+			vertexSection.Format = static_cast<uint32_t>(VkUtils::VertexFormat::Packed);
+			vertexSection.ElementSize = sizeof(VkUtils::PackedVertex);
+			writer.AddSection(vertexSection, packedVertices.data(), sizeof(VkUtils::PackedVertex) * packedVertices.size());
+
+			VkUtils::PackageSection quantizationSection{};
+			quantizationSection.Type = VkUtils::PackageSectionType::VertexQuantization;
+			quantizationSection.ElementCount = 1;
+			quantizationSection.ElementSize = sizeof(VkUtils::VertexQuantization);
+			writer.AddSection(quantizationSection, &quantization, sizeof(quantization));
+		}
+		else
+		{
+			vertexSection.Format = static_cast<uint32_t>(VkUtils::VertexFormat::Standard);
+			vertexSection.ElementSize = sizeof(VkUtils::Vertex);
+			writer.AddSection(vertexSection, vertices.data(), sizeof(VkUtils::Vertex) * vertices.size());
+		}
+
+		VkUtils::PackageSection indexSection{};
+		indexSection.Type = VkUtils::PackageSectionType::IndexData;
+		indexSection.ElementCount = static_cast<uint32_t>(shortIndices.size());
+		indexSection.ElementSize = sizeof(uint16_t);
+		writer.AddSection(indexSection, shortIndices.data(), sizeof(uint16_t) * shortIndices.size());
+
+		VkUtils::PackageSection subMeshSection{};
+		subMeshSection.Type = VkUtils::PackageSectionType::SubMeshes;
+		subMeshSection.ElementCount = static_cast<uint32_t>(subMeshes.size());
+		subMeshSection.ElementSize = sizeof(VkUtils::SubMesh);
+		writer.AddSection(subMeshSection, subMeshes.data(), sizeof(VkUtils::SubMesh) * subMeshes.size());
+
+		VkUtils::PackageSection meshletSection{};
+		meshletSection.Type = VkUtils::PackageSectionType::Meshlets;
+		meshletSection.ElementCount = static_cast<uint32_t>(meshlets.size());
+		meshletSection.ElementSize = sizeof(VkUtils::Meshlet);
+		writer.AddSection(meshletSection, meshlets.data(), sizeof(VkUtils::Meshlet) * meshlets.size());
+
+		VkUtils::PackageSection meshletIndexSection{};
+		meshletIndexSection.Type = VkUtils::PackageSectionType::MeshletIndices;
+		meshletIndexSection.ElementCount = static_cast<uint32_t>(shortMeshletIndices.size());
+		meshletIndexSection.ElementSize = sizeof(uint16_t);
+		writer.AddSection(meshletIndexSection, shortMeshletIndices.data(), sizeof(uint16_t) * shortMeshletIndices.size());
+
+		VkUtils::PackageSection lodSection{};
+		lodSection.Type = VkUtils::PackageSectionType::Lods;
+		lodSection.ElementCount = static_cast<uint32_t>(lods.size());
+		lodSection.ElementSize = sizeof(VkUtils::MeshLod);
+		writer.AddSection(lodSection, lods.data(), sizeof(VkUtils::MeshLod) * lods.size());
+
+		VkUtils::PackageSection boundsSection{};
+		boundsSection.Type = VkUtils::PackageSectionType::Bounds;
+		boundsSection.ElementCount = 1;
+		boundsSection.ElementSize = sizeof(VkUtils::BoundingSphere);
+		writer.AddSection(boundsSection, &bounds, sizeof(bounds));
+
+		VkUtils::PackageSection textureSection{};
+		textureSection.Type = VkUtils::PackageSectionType::TextureData;
+		textureSection.Format = VK_FORMAT_R8G8B8A8_SRGB;
+		textureSection.ElementSize = kBytesPerPixel;
+		textureSection.Width = static_cast<uint32_t>(width);
+		textureSection.Height = static_cast<uint32_t>(height);
+		textureSection.MipLevels = mipLevels;
+		writer.AddSection(textureSection, mipChain.data(), mipChain.size());
+
+		if (!writer.Write(outputPath))
+			throw std::runtime_error("\nERROR : Failed to write asset package !\n");
+
+		auto cookTime = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+
+		std::cout << "Cooked " << outputPath << " in " << cookTime << " ms\n";
+		std::cout << "\tMesh : " << stats.UniqueVertexCount << " vertices (" << stats.RawVertexCount << " before welding), "
+			<< indices.size() << " indices, " << vertexSection.ElementSize * vertices.size() << " bytes of "
+			<< (packVertices ? "packed " : "") << "vertices\n";
+		std::cout << "\t" << subMeshes.size() << " sub meshes with 16 bit indices, " << vertices.size() - optimizedVertexCount
+			<< " vertices duplicated by splitting\n";
+		VkUtils::PrintMeshOptimizationStats(modelPath, optimizationStats);
+		VkUtils::PrintMeshletStats(modelPath, meshletStats);
+		VkUtils::PrintLodChain(modelPath, lods);
+		std::cout << "\tTexture : " << width << "x" << height << ", " << mipLevels << " mip levels, " << mipChain.size() << " bytes\n";
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << e.what() << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,288 @@
+#include "AssetPackage.h"
+
+#include <fstream>
+#include <algorithm>
+#include <iterator>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+namespace
+{
+	uint64_t AlignUp(uint64_t value, uint64_t alignment)
+	{
+		return (value + alignment - 1) / alignment * alignment;
+	}
+
+	// Element sections hold exactly their elements, texture sections at least their whole mip chain
+	bool IsSectionSizeValid(const VkUtils::PackageSection& section)
+	{
+		if (section.Type != VkUtils::PackageSectionType::TextureData)
+			return static_cast<uint64_t>(section.ElementCount) * section.ElementSize == section.Size;
+
+		// Level 0 is checked first so the sum can't overflow, mip levels past 32 can't exist
+		if (section.Width == 0 || section.Height == 0 || section.ElementSize == 0 || section.MipLevels == 0 || section.MipLevels > 32 ||
+			static_cast<uint64_t>(section.Width) * section.Height > section.Size / section.ElementSize)
+			return false;
+
+		uint64_t mipChainSize = 0;
+		for (uint32_t level = 0; level < section.MipLevels; ++level)
+			mipChainSize += VkUtils::GetMipLevelSize(section.Width, section.Height, level, section.ElementSize);
+		return mipChainSize <= section.Size;
+	}
+}
+
+namespace VkUtils
+{
+	MappedFile::~MappedFile()
+	{
+		Close();
+	}
+
+#ifdef _WIN32
+	bool MappedFile::Open(const char* fileName)
+	{
+		Close();
+
+		HANDLE file = CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+			FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+		if (file == INVALID_HANDLE_VALUE)
+			return false;
+
+		LARGE_INTEGER fileSize{};
+		if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+		{
+			CloseHandle(file);
+			return false;
+		}
+
+		HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (mapping == nullptr)
+		{
+			CloseHandle(file);
+			return false;
+		}
+
+		void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		if (data == nullptr)
+		{
+			CloseHandle(mapping);
+			CloseHandle(file);
+			return false;
+		}
+
+		m_fileHandle = file;
+		m_mappingHandle = mapping;
+		m_data = static_cast<const char*>(data);
+		m_size = static_cast<size_t>(fileSize.QuadPart);
+		return true;
+	}
+
+	void MappedFile::Close()
+	{
+		if (m_data)
+			UnmapViewOfFile(m_data);
+		if (m_mappingHandle)
+			CloseHandle(m_mappingHandle);
+		if (m_fileHandle)
+			CloseHandle(m_fileHandle);
+
+		m_data = nullptr;
+		m_size = 0;
+		m_mappingHandle = nullptr;
+		m_fileHandle = nullptr;
+	}
+#else
+	bool MappedFile::Open(const char* fileName)
+	{
+		Close();
+
+		int fileDescriptor = open(fileName, O_RDONLY);
+		if (fileDescriptor < 0)
+			return false;
+
+		struct stat fileStat{};
+		if (fstat(fileDescriptor, &fileStat) != 0 || fileStat.st_size == 0)
+		{
+			close(fileDescriptor);
+			return false;
+		}
+
+		void* data = mmap(nullptr, static_cast<size_t>(fileStat.st_size), PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+		if (data == MAP_FAILED)
+		{
+			close(fileDescriptor);
+			return false;
+		}
+
+		// Whole file is going to be read front to back
+		madvise(data, static_cast<size_t>(fileStat.st_size), MADV_SEQUENTIAL);
+
+		m_fileDescriptor = fileDescriptor;
+		m_data = static_cast<const char*>(data);
+		m_size = static_cast<size_t>(fileStat.st_size);
+		return true;
+	}
+
+	void MappedFile::Close()
+	{
+		if (m_data)
+			munmap(const_cast<char*>(m_data), m_size);
+		if (m_fileDescriptor >= 0)
+			close(m_fileDescriptor);
+
+		m_data = nullptr;
+		m_size = 0;
+		m_fileDescriptor = -1;
+	}
+#endif
+
+	bool GetPackageSource(const char* fileName, PackageSource* pSource)
+	{
+#ifdef _WIN32
+		WIN32_FILE_ATTRIBUTE_DATA attributes;
+		if (!GetFileAttributesExA(fileName, GetFileExInfoStandard, &attributes))
+			return false;
+
+		// FILETIME counts 100 ns intervals since 1601
+		uint64_t writeTime = (static_cast<uint64_t>(attributes.ftLastWriteTime.dwHighDateTime) << 32) | attributes.ftLastWriteTime.dwLowDateTime;
+		pSource->Size = (static_cast<uint64_t>(attributes.nFileSizeHigh) << 32) | attributes.nFileSizeLow;
+		pSource->WriteTime = static_cast<int64_t>(writeTime / 10000000) - 11644473600;
+#else
+		struct stat fileStat;
+		if (stat(fileName, &fileStat) != 0)
+			return false;
+
+		pSource->Size = static_cast<uint64_t>(fileStat.st_size);
+		pSource->WriteTime = static_cast<int64_t>(fileStat.st_mtime);
+#endif
+		return true;
+	}
+
+	bool AssetPackageWriter::SetSource(PackageSourceType type, const char* fileName)
+	{
+		return GetPackageSource(fileName, &m_sources[static_cast<uint32_t>(type)]);
+	}
+
+	void AssetPackageWriter::AddSection(PackageSection section, const void* pData, uint64_t size)
+	{
+		section.Offset = 0;
+		section.Size = size;
+		m_sections.push_back(section);
+		m_sectionData.push_back(pData);
+	}
+
+	bool AssetPackageWriter::Write(const char* fileName) const
+	{
+		PackageHeader header{};
+		header.Magic = kPackageMagic;
+		header.Version = kPackageVersion;
+		header.SectionCount = static_cast<uint32_t>(m_sections.size());
+		std::copy(std::begin(m_sources), std::end(m_sources), std::begin(header.Sources));
+
+		// Place sections after the section table, aligned so GPU copies from a mapped package stay aligned
+		auto sections = m_sections;
+		uint64_t offset = sizeof(PackageHeader) + sizeof(PackageSection) * sections.size();
+		for (auto& section : sections)
+		{
+			offset = AlignUp(offset, kPackageSectionAlignment);
+			section.Offset = offset;
+			offset += section.Size;
+		}
+
+		std::ofstream file(fileName, std::ios::binary | std::ios::trunc);
+		if (!file.is_open())
+			return false;
+
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(reinterpret_cast<const char*>(sections.data()), sizeof(PackageSection) * sections.size());
+
+		const char padding[kPackageSectionAlignment] = {};
+		uint64_t position = sizeof(PackageHeader) + sizeof(PackageSection) * sections.size();
+		for (size_t i = 0; i < sections.size(); ++i)
+		{
+			file.write(padding, static_cast<std::streamsize>(sections[i].Offset - position));
+			file.write(static_cast<const char*>(m_sectionData[i]), static_cast<std::streamsize>(sections[i].Size));
+			position = sections[i].Offset + sections[i].Size;
+		}
+
+		return file.good();
+	}
+
+	bool AssetPackage::Open(const char* fileName, const char* modelFileName, const char* textureFileName)
+	{
+		Close();
+
+		if (!m_file.Open(fileName))
+			return false;
+
+		const auto* header = reinterpret_cast<const PackageHeader*>(m_file.Data());
+		if (m_file.Size() < sizeof(PackageHeader) || header->Magic != kPackageMagic || header->Version != kPackageVersion ||
+			m_file.Size() < sizeof(PackageHeader) + sizeof(PackageSection) * static_cast<uint64_t>(header->SectionCount))
+		{
+			Close();
+			return false;
+		}
+
+		// Without sources at hand the package is all there is, whatever its age
+		const char* sourceFileNames[] = { modelFileName, textureFileName };
+		for (uint32_t i = 0; i < static_cast<uint32_t>(PackageSourceType::Count); ++i)
+		{
+			PackageSource source;
+			if (GetPackageSource(sourceFileNames[i], &source) &&
+				(source.Size != header->Sources[i].Size || source.WriteTime != header->Sources[i].WriteTime))
+			{
+				Close();
+				return false;
+			}
+		}
+
+		m_sections = reinterpret_cast<const PackageSection*>(m_file.Data() + sizeof(PackageHeader));
+		m_sectionCount = header->SectionCount;
+
+		for (uint32_t i = 0; i < m_sectionCount; ++i)
+		{
+			const auto& section = m_sections[i];
+			if (section.Offset > m_file.Size() || section.Size > m_file.Size() - section.Offset || !IsSectionSizeValid(section))
+			{
+				Close();
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	void AssetPackage::Close()
+	{
+		m_file.Close();
+		m_sections = nullptr;
+		m_sectionCount = 0;
+	}
+
+	const PackageSection* AssetPackage::FindSection(PackageSectionType type) const
+	{
+		for (uint32_t i = 0; i < m_sectionCount; ++i)
+		{
+			if (m_sections[i].Type == type)
+				return &m_sections[i];
+		}
+
+		return nullptr;
+	}
+
+	uint64_t GetMipLevelSize(uint32_t width, uint32_t height, uint32_t mipLevel, uint32_t texelSize)
+	{
+		uint64_t mipWidth = std::max(1u, width >> mipLevel);
+		uint64_t mipHeight = std::max(1u, height >> mipLevel);
+		return mipWidth * mipHeight * texelSize;
+	}
+}
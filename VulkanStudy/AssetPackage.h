@@ -0,0 +1,138 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace VkUtils
+{
+	// Cooked asset package layout (little endian) :
+	//		PackageHeader
+	//		PackageSection[SectionCount]
+	//		section data, each section starts at a multiple of kPackageSectionAlignment
+	// Sections hold data ready to be copied into staging memory as is
+	constexpr uint32_t kPackageMagic = 0x4B504B56;			// "VKPK"
+	constexpr uint32_t kPackageVersion = 3;
+	constexpr uint64_t kPackageSectionAlignment = 256;
+
+	enum class PackageSectionType : uint32_t
+	{
+		VertexData = 1,			// ElementCount vertices of ElementSize bytes, Format is a VertexFormat
+		IndexData = 2,			// ElementCount indices of ElementSize bytes (2 or 4)
+		TextureData = 3,		// Width x Height texture of VkFormat Format with ElementSize bytes texels, MipLevels levels packed from the largest one
+		VertexQuantization = 4,	// one VertexQuantization, required when VertexData holds PackedVertex
+		SubMeshes = 5,			// ElementCount SubMesh, if missing the whole index buffer is one sub mesh
+		Meshlets = 6,			// ElementCount Meshlet over the MeshletIndices section, optional
+		Lods = 7,				// ElementCount MeshLod over the SubMeshes section, optional : without it LOD 0 is every sub mesh
+		Bounds = 8,				// one BoundingSphere of the model, required by Lods
+		MeshletIndices = 9,		// ElementCount indices of ElementSize bytes (2 or 4), meshlet triangles apart from the draw order of IndexData
+	};
+
+	// Files a package is cooked from, in PackageHeader::Sources
+	enum class PackageSourceType : uint32_t
+	{
+		Model = 0,
+		Texture = 1,
+		Count
+	};
+
+	// Identifies the version of a source file, a package whose sources changed since it was cooked is stale
+	struct PackageSource
+	{
+		uint64_t Size;
+		int64_t WriteTime;		// seconds since 1970
+	};
+
+	struct PackageHeader
+	{
+		uint32_t Magic;
+		uint32_t Version;
+		uint32_t SectionCount;
+		uint32_t Reserved;
+		PackageSource Sources[static_cast<uint32_t>(PackageSourceType::Count)];
+	};
+
+	struct PackageSection
+	{
+		PackageSectionType Type;
+		uint32_t Format;
+		uint32_t ElementCount;
+		uint32_t ElementSize;
+		uint32_t Width;
+		uint32_t Height;
+		uint32_t MipLevels;
+		uint32_t Reserved;
+		uint64_t Offset;		// from the beginning of the file
+		uint64_t Size;
+	};
+
+	// Read only memory mapping of a whole file
+	class MappedFile
+	{
+	public:
+		MappedFile() = default;
+		~MappedFile();
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+
+		// Return false if file can't be opened or mapped (empty files can't be mapped)
+		bool Open(const char* fileName);
+		void Close();
+
+		bool IsOpen() const { return m_data != nullptr; }
+		const char* Data() const { return m_data; }
+		size_t Size() const { return m_size; }
+	private:
+		const char* m_data = nullptr;
+		size_t m_size = 0;
+#ifdef _WIN32
+		void* m_fileHandle = nullptr;
+		void* m_mappingHandle = nullptr;
+#else
+		int m_fileDescriptor = -1;
+#endif
+	};
+
+	// Return false if file doesn't exist
+	bool GetPackageSource(const char* fileName, PackageSource* pSource);
+
+	// Collect sections and write them as one package file (used by the offline cooker)
+	class AssetPackageWriter
+	{
+	public:
+		// Return false if file doesn't exist
+		bool SetSource(PackageSourceType type, const char* fileName);
+		// section.Offset and section.Size are filled by the writer
+		// pData is only read when Write is called, it must stay valid until then
+		void AddSection(PackageSection section, const void* pData, uint64_t size);
+
+		// Return false if file can't be written
+		bool Write(const char* fileName) const;
+	private:
+		PackageSource m_sources[static_cast<uint32_t>(PackageSourceType::Count)] = {};
+		std::vector<PackageSection> m_sections;
+		std::vector<const void*> m_sectionData;
+	};
+
+	// Memory mapped cooked package, section data is read directly from the mapping
+	class AssetPackage
+	{
+	public:
+		// Return false if package is missing, was cooked with another version or is corrupted
+		// It is stale too, and rejected, when a source file differs from the one it was cooked from. Missing sources aren't checked
+		bool Open(const char* fileName, const char* modelFileName, const char* textureFileName);
+		void Close();
+
+		bool IsOpen() const { return m_file.IsOpen(); }
+
+		// If package doesn't contain this section type, it returns nullptr
+		const PackageSection* FindSection(PackageSectionType type) const;
+		const void* GetSectionData(const PackageSection& section) const { return m_file.Data() + section.Offset; }
+	private:
+		MappedFile m_file;
+		const PackageSection* m_sections = nullptr;
+		uint32_t m_sectionCount = 0;
+	};
+
+	// Byte size of a mip level of an uncompressed image
+	uint64_t GetMipLevelSize(uint32_t width, uint32_t height, uint32_t mipLevel, uint32_t texelSize);
+}
@@ -0,0 +1,84 @@
+#include "BuddyAllocator.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace VkUtils
+{
+	BuddyAllocator::BuddyAllocator(VkDeviceSize size, VkDeviceSize minAllocationSize)
+		: m_size(size)
+	{
+		uint32_t levelCount = 1;
+		while ((size >> levelCount) >= minAllocationSize)
+			++levelCount;
+
+		m_freeRanges.resize(levelCount);
+		m_freeRanges[0].insert(0);
+	}
+
+	bool BuddyAllocator::Allocate(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize* pOffset)
+	{
+		// Finest level whose ranges fit size and alignment
+		uint32_t level = static_cast<uint32_t>(m_freeRanges.size()) - 1;
+		while (level > 0 && (GetLevelSize(level) < size || GetLevelSize(level) < alignment))
+			--level;
+		if (GetLevelSize(level) < size || GetLevelSize(level) < alignment)
+			return false;
+
+		// Smallest free range at least that big
+		uint32_t freeLevel = level;
+		while (m_freeRanges[freeLevel].empty())
+		{
+			if (freeLevel == 0)
+				return false;
+			--freeLevel;
+		}
+
+		VkDeviceSize offset = *m_freeRanges[freeLevel].begin();
+		m_freeRanges[freeLevel].erase(m_freeRanges[freeLevel].begin());
+
+		// Split it down, first halves are kept, second halves become free
+		for (uint32_t splitLevel = freeLevel + 1; splitLevel <= level; ++splitLevel)
+			m_freeRanges[splitLevel].insert(offset + GetLevelSize(splitLevel));
+
+		m_allocatedLevels[offset] = level;
+		m_allocatedSize += GetLevelSize(level);
+		*pOffset = offset;
+		return true;
+	}
+
+	void BuddyAllocator::Free(VkDeviceSize offset)
+	{
+		auto allocated = m_allocatedLevels.find(offset);
+		if (allocated == m_allocatedLevels.end())
+			throw std::runtime_error("\nERROR : Freed range was not allocated !\n");
+
+		uint32_t level = allocated->second;
+		m_allocatedLevels.erase(allocated);
+		m_allocatedSize -= GetLevelSize(level);
+
+		// Merge with the buddy as long as it is free too
+		while (level > 0)
+		{
+			auto buddy = m_freeRanges[level].find(offset ^ GetLevelSize(level));
+			if (buddy == m_freeRanges[level].end())
+				break;
+
+			offset = std::min(offset, *buddy);
+			m_freeRanges[level].erase(buddy);
+			--level;
+		}
+		m_freeRanges[level].insert(offset);
+	}
+
+	VkDeviceSize BuddyAllocator::GetLargestFreeSize() const
+	{
+		for (uint32_t level = 0; level < m_freeRanges.size(); ++level)
+		{
+			if (!m_freeRanges[level].empty())
+				return GetLevelSize(level);
+		}
+
+		return 0;
+	}
+}
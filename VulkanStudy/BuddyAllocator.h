@@ -0,0 +1,37 @@
+#pragma once
+#include <vector>
+#include <set>
+#include <unordered_map>
+
+#include <vulkan/vulkan.h>
+
+namespace VkUtils
+{
+	// Buddy allocation of offsets in a range of memory, CPU only
+	// Ranges are powers of two, split in halves on demand and merged back with their buddy once both halves are free.
+	// A range starts at a multiple of its size, so any alignment up to the rounded size is met for free.
+	class BuddyAllocator
+	{
+	public:
+		// size and minAllocationSize must be powers of two
+		BuddyAllocator(VkDeviceSize size, VkDeviceSize minAllocationSize);
+
+		// alignment must be a power of two. Return false if no free range is big enough
+		bool Allocate(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize* pOffset);
+		void Free(VkDeviceSize offset);
+
+		VkDeviceSize GetSize() const { return m_size; }
+		// Sum of the ranges given out, requested sizes rounded up to powers of two
+		VkDeviceSize GetAllocatedSize() const { return m_allocatedSize; }
+		VkDeviceSize GetLargestFreeSize() const;
+		bool IsEmpty() const { return m_allocatedSize == 0; }
+	private:
+		VkDeviceSize GetLevelSize(uint32_t level) const { return m_size >> level; }
+
+		VkDeviceSize m_size;
+		VkDeviceSize m_allocatedSize = 0;
+		// Level 0 is the whole range, each level halves the size
+		std::vector<std::set<VkDeviceSize>> m_freeRanges;
+		std::unordered_map<VkDeviceSize, uint32_t> m_allocatedLevels;
+	};
+}
@@ -0,0 +1,297 @@
+#include "DeviceAllocator.h"
+
+#include <iostream>
+#include <algorithm>
+#include <stdexcept>
+
+namespace
+{
+	// Share of a heap assumed usable when the driver can't tell its budget
+	constexpr VkDeviceSize kFallbackBudgetPercent = 80;
+	constexpr float kBytesPerMegabyte = 1024.0f * 1024.0f;
+}
+
+namespace VkUtils
+{
+	const char* GetMemoryCategoryName(MemoryCategory category)
+	{
+		switch (category)
+		{
+		case MemoryCategory::Vertex: return "vertex";
+		case MemoryCategory::Index: return "index";
+		case MemoryCategory::Uniform: return "uniform";
+		case MemoryCategory::Texture: return "texture";
+		case MemoryCategory::Attachment: return "attachment";
+		case MemoryCategory::Staging: return "staging";
+		case MemoryCategory::Instance: return "instance";
+		case MemoryCategory::Indirect: return "indirect";
+		default: return "unknown";
+		}
+	}
+
+	void DeviceAllocator::Init(VkPhysicalDevice physicalDevice, VkDevice device, bool hasMemoryBudget)
+	{
+		m_physicalDevice = physicalDevice;
+		m_device = device;
+		m_hasMemoryBudget = hasMemoryBudget;
+		vkGetPhysicalDeviceMemoryProperties(physicalDevice, &m_memoryProperties);
+
+		VkPhysicalDeviceProperties properties{};
+		vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+		m_bufferImageGranularity = properties.limits.bufferImageGranularity;
+		m_maxMemoryObjectCount = properties.limits.maxMemoryAllocationCount;
+	}
+
+	void DeviceAllocator::Destroy()
+	{
+		if (m_device == VK_NULL_HANDLE)
+			return;
+
+#ifdef _DEBUG || DEBUG
+		auto stats = GetStats();
+		if (stats.AllocationCount > 0 || stats.DedicatedCount > 0)
+			std::cout << "\nDEVICE MEMORY : " << stats.AllocationCount + stats.DedicatedCount << " allocations never freed !\n";
+#endif
+
+		// Freeing memory unmaps it
+		for (const auto& block : m_blocks)
+			FreeMemory(block.Memory, block.Allocator.GetSize(), m_memoryProperties.memoryTypes[block.MemoryType].heapIndex);
+		m_blocks.clear();
+		m_device = VK_NULL_HANDLE;
+	}
+
+	DeviceAllocation DeviceAllocator::AllocateBuffer(VkBuffer buffer, VkMemoryPropertyFlags properties, MemoryCategory category)
+	{
+		VkMemoryRequirements requirements{};
+		vkGetBufferMemoryRequirements(m_device, buffer, &requirements);
+
+		auto allocation = Allocate(requirements, properties, category, false, VK_NULL_HANDLE);
+		if (vkBindBufferMemory(m_device, buffer, allocation.Memory, allocation.Offset) != VK_SUCCESS)
+			throw std::runtime_error("\nVULKAN ERROR : Failed to bind buffer and DEVICE MEMORY !\n");
+
+		return allocation;
+	}
+
+	DeviceAllocation DeviceAllocator::AllocateImage(VkImage image, VkMemoryPropertyFlags properties, MemoryCategory category)
+	{
+		VkMemoryRequirements requirements{};
+		vkGetImageMemoryRequirements(m_device, image, &requirements);
+
+		bool isDedicated = requirements.size >= kDedicatedImageSize;
+		auto allocation = Allocate(requirements, properties, category, true, isDedicated ? image : VK_NULL_HANDLE);
+		if (vkBindImageMemory(m_device, image, allocation.Memory, allocation.Offset) != VK_SUCCESS)
+			throw std::runtime_error("\nVULKAN ERROR : Failed to bind image and DEVICE MEMORY !\n");
+
+		return allocation;
+	}
+
+	void DeviceAllocator::Free(const DeviceAllocation& allocation)
+	{
+		if (allocation.Memory == VK_NULL_HANDLE)
+			return;
+
+		auto& usage = m_categoryUsage[static_cast<size_t>(allocation.Category)];
+		--usage.ResourceCount;
+		usage.Bytes -= allocation.Size;
+
+		if (allocation.BlockIndex == UINT32_MAX)
+		{
+			FreeMemory(allocation.Memory, allocation.Size, allocation.HeapIndex);
+			--m_dedicatedCount;
+			m_dedicatedBytes -= allocation.Size;
+			return;
+		}
+
+		auto& block = m_blocks[allocation.BlockIndex];
+		block.Allocator.Free(allocation.Offset);
+		--block.AllocationCount;
+		block.UsedBytes -= allocation.Size;
+	}
+
+	DeviceAllocatorStats DeviceAllocator::GetStats() const
+	{
+		DeviceAllocatorStats stats{};
+		VkDeviceSize freeBytes = 0;
+		VkDeviceSize largestFreeBytes = 0;
+		for (const auto& block : m_blocks)
+		{
+			++stats.BlockCount;
+			stats.BlockBytes += block.Allocator.GetSize();
+			stats.AllocationCount += block.AllocationCount;
+			stats.UsedBytes += block.UsedBytes;
+			stats.AllocatedBytes += block.Allocator.GetAllocatedSize();
+			freeBytes += block.Allocator.GetSize() - block.Allocator.GetAllocatedSize();
+			largestFreeBytes += block.Allocator.GetLargestFreeSize();
+		}
+
+		stats.Fragmentation = freeBytes > 0 ? 1.0f - static_cast<float>(largestFreeBytes) / freeBytes : 0.0f;
+		stats.DedicatedCount = m_dedicatedCount;
+		stats.DedicatedBytes = m_dedicatedBytes;
+		stats.MemoryObjectCount = stats.BlockCount + stats.DedicatedCount;
+		stats.MaxMemoryObjectCount = m_maxMemoryObjectCount;
+		return stats;
+	}
+
+	void DeviceAllocator::PrintStats() const
+	{
+		auto stats = GetStats();
+		std::cout << "\nDEVICE MEMORY :\n";
+		std::cout << "\t" << stats.BlockCount << " blocks, " << stats.BlockBytes << " bytes\n";
+		std::cout << "\t" << stats.AllocationCount << " resources in blocks, " << stats.UsedBytes << " bytes used, "
+			<< stats.AllocatedBytes << " bytes allocated\n";
+		std::cout << "\t" << stats.Fragmentation * 100.0f << "% of free block memory fragmented\n";
+		std::cout << "\t" << stats.DedicatedCount << " dedicated allocations, " << stats.DedicatedBytes << " bytes\n";
+		std::cout << "\t" << stats.MemoryObjectCount << " memory objects of " << stats.MaxMemoryObjectCount << " allowed\n";
+	}
+
+	DeviceAllocation DeviceAllocator::Allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties, MemoryCategory category,
+		bool isImage, VkImage dedicatedImage)
+	{
+		uint32_t memoryType = UINT32_MAX;
+		for (uint32_t i = 0; i < m_memoryProperties.memoryTypeCount; ++i)
+		{
+			if ((requirements.memoryTypeBits & (1 << i)) && (m_memoryProperties.memoryTypes[i].propertyFlags & properties) == properties)
+			{
+				memoryType = i;
+				break;
+			}
+		}
+		if (memoryType == UINT32_MAX)
+			throw std::runtime_error("\nVULKAN ERROR : Failed to find suitable memory type !\n");
+
+		DeviceAllocation allocation{};
+		allocation.Size = requirements.size;
+		allocation.HeapIndex = m_memoryProperties.memoryTypes[memoryType].heapIndex;
+		allocation.Category = category;
+
+		auto& usage = m_categoryUsage[static_cast<size_t>(category)];
+		++usage.ResourceCount;
+		usage.Bytes += requirements.size;
+		usage.PeakBytes = std::max(usage.PeakBytes, usage.Bytes);
+
+		// Ranges over half a block take the whole block anyway
+		if (dedicatedImage != VK_NULL_HANDLE || requirements.size > kDeviceMemoryBlockSize / 2)
+		{
+			VkMemoryDedicatedAllocateInfo dedicatedInfo{};
+			dedicatedInfo.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO;
+			dedicatedInfo.image = dedicatedImage;
+
+			allocation.Memory = AllocateMemory(requirements.size, memoryType, dedicatedImage != VK_NULL_HANDLE ? &dedicatedInfo : nullptr,
+				&allocation.MappedData);
+			++m_dedicatedCount;
+			m_dedicatedBytes += requirements.size;
+			return allocation;
+		}
+
+		// Linear and optimal resources closer than the granularity would alias, they get their own blocks then
+		bool isImageBlock = isImage && m_bufferImageGranularity > kMinDeviceAllocationSize;
+		for (uint32_t i = 0; i < m_blocks.size(); ++i)
+		{
+			auto& block = m_blocks[i];
+			if (block.MemoryType != memoryType || block.IsImageBlock != isImageBlock ||
+				!block.Allocator.Allocate(requirements.size, requirements.alignment, &allocation.Offset))
+				continue;
+
+			allocation.Memory = block.Memory;
+			allocation.BlockIndex = i;
+			allocation.MappedData = block.MappedData ? block.MappedData + allocation.Offset : nullptr;
+			++block.AllocationCount;
+			block.UsedBytes += requirements.size;
+			return allocation;
+		}
+
+		Block block{ VK_NULL_HANDLE, memoryType, isImageBlock, nullptr, BuddyAllocator(kDeviceMemoryBlockSize, kMinDeviceAllocationSize), 0, 0 };
+		block.Memory = AllocateMemory(kDeviceMemoryBlockSize, memoryType, nullptr, &block.MappedData);
+		block.Allocator.Allocate(requirements.size, requirements.alignment, &allocation.Offset);
+		++block.AllocationCount;
+		block.UsedBytes += requirements.size;
+
+		allocation.Memory = block.Memory;
+		allocation.BlockIndex = static_cast<uint32_t>(m_blocks.size());
+		allocation.MappedData = block.MappedData ? block.MappedData + allocation.Offset : nullptr;
+		m_blocks.push_back(std::move(block));
+		return allocation;
+	}
+
+	VkDeviceMemory DeviceAllocator::AllocateMemory(VkDeviceSize size, uint32_t memoryType, const void* pNext, uint8_t** ppMappedData)
+	{
+		VkMemoryAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+		allocInfo.pNext = pNext;
+		allocInfo.allocationSize = size;
+		allocInfo.memoryTypeIndex = memoryType;
+
+		VkDeviceMemory memory = VK_NULL_HANDLE;
+		if (vkAllocateMemory(m_device, &allocInfo, nullptr, &memory) != VK_SUCCESS)
+			throw std::runtime_error("\nVULKAN ERROR : Failed to allocate memory !\n");
+
+		auto heapIndex = m_memoryProperties.memoryTypes[memoryType].heapIndex;
+		m_heapAllocatedBytes[heapIndex] += size;
+		m_heapPeakAllocatedBytes[heapIndex] = std::max(m_heapPeakAllocatedBytes[heapIndex], m_heapAllocatedBytes[heapIndex]);
+
+		*ppMappedData = nullptr;
+		if (m_memoryProperties.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+		{
+			void* data = nullptr;
+			if (vkMapMemory(m_device, memory, 0, size, 0, &data) != VK_SUCCESS)
+				throw std::runtime_error("\nVULKAN ERROR : Failed to map memory !\n");
+			*ppMappedData = static_cast<uint8_t*>(data);
+		}
+
+		return memory;
+	}
+
+	void DeviceAllocator::FreeMemory(VkDeviceMemory memory, VkDeviceSize size, uint32_t heapIndex)
+	{
+		vkFreeMemory(m_device, memory, nullptr);
+		m_heapAllocatedBytes[heapIndex] -= size;
+	}
+
+	std::vector<MemoryHeapBudget> DeviceAllocator::GetHeapBudgets() const
+	{
+		VkPhysicalDeviceMemoryBudgetPropertiesEXT budgetProperties{};
+		budgetProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+		if (m_hasMemoryBudget)
+		{
+			VkPhysicalDeviceMemoryProperties2 properties{};
+			properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+			properties.pNext = &budgetProperties;
+			vkGetPhysicalDeviceMemoryProperties2(m_physicalDevice, &properties);
+		}
+
+		std::vector<MemoryHeapBudget> budgets(m_memoryProperties.memoryHeapCount);
+		for (uint32_t i = 0; i < m_memoryProperties.memoryHeapCount; ++i)
+		{
+			auto& budget = budgets[i];
+			budget.Size = m_memoryProperties.memoryHeaps[i].size;
+			budget.IsDeviceLocal = (m_memoryProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != 0;
+			budget.AllocatedBytes = m_heapAllocatedBytes[i];
+			budget.PeakAllocatedBytes = m_heapPeakAllocatedBytes[i];
+			budget.Usage = m_hasMemoryBudget ? budgetProperties.heapUsage[i] : budget.AllocatedBytes;
+			budget.Budget = m_hasMemoryBudget ? budgetProperties.heapBudget[i] : budget.Size * kFallbackBudgetPercent / 100;
+		}
+
+		return budgets;
+	}
+
+	void DeviceAllocator::PrintBudget() const
+	{
+		auto budgets = GetHeapBudgets();
+		std::cout << "\nMEMORY BUDGET" << (m_hasMemoryBudget ? " :\n" : " (estimated, no VK_EXT_memory_budget) :\n");
+		for (uint32_t i = 0; i < budgets.size(); ++i)
+		{
+			const auto& budget = budgets[i];
+			std::cout << "\theap " << i << (budget.IsDeviceLocal ? " (device local) : " : " : ")
+				<< budget.Usage / kBytesPerMegabyte << " / " << budget.Budget / kBytesPerMegabyte << " MB used, "
+				<< budget.AllocatedBytes / kBytesPerMegabyte << " MB allocated here, peak " << budget.PeakAllocatedBytes / kBytesPerMegabyte << " MB\n";
+		}
+
+		std::cout << "\t";
+		for (size_t i = 0; i < static_cast<size_t>(MemoryCategory::Count); ++i)
+		{
+			const auto& usage = m_categoryUsage[i];
+			std::cout << GetMemoryCategoryName(static_cast<MemoryCategory>(i)) << " " << usage.Bytes / kBytesPerMegabyte
+				<< " MB (peak " << usage.PeakBytes / kBytesPerMegabyte << ")" << (i + 1 < static_cast<size_t>(MemoryCategory::Count) ? ", " : "\n");
+		}
+	}
+}
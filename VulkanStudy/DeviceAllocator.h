@@ -0,0 +1,137 @@
+#pragma once
+#include "VkUtils.h"
+#include "BuddyAllocator.h"
+
+#include <unordered_map>
+
+namespace VkUtils
+{
+	// Device memory is allocated in blocks of this size, one vkAllocateMemory serves many resources
+	constexpr VkDeviceSize kDeviceMemoryBlockSize = 64 * 1024 * 1024;
+	// Smallest range a block gives out, a multiple of every alignment small resources need
+	constexpr VkDeviceSize kMinDeviceAllocationSize = 256;
+	// Images this big get their own vkAllocateMemory : they would waste up to half of a block and drivers may place them better
+	constexpr VkDeviceSize kDedicatedImageSize = kDeviceMemoryBlockSize / 4;
+
+	// What a resource is used for, memory is tracked per category
+	enum class MemoryCategory
+	{
+		Vertex,
+		Index,
+		Uniform,
+		Texture,
+		Attachment,
+		Staging,
+		Instance,
+		Indirect,
+		Count
+	};
+
+	const char* GetMemoryCategoryName(MemoryCategory category);
+
+	struct DeviceAllocation
+	{
+		VkDeviceMemory Memory = VK_NULL_HANDLE;
+		VkDeviceSize Offset = 0;
+		VkDeviceSize Size = 0;
+		// Host visible memory stays mapped, points at Offset
+		uint8_t* MappedData = nullptr;
+		// UINT32_MAX for dedicated allocations
+		uint32_t BlockIndex = UINT32_MAX;
+		uint32_t HeapIndex = 0;
+		MemoryCategory Category = MemoryCategory::Count;
+	};
+
+	struct MemoryCategoryUsage
+	{
+		uint32_t ResourceCount = 0;
+		VkDeviceSize Bytes = 0;				// requested by the resources
+		VkDeviceSize PeakBytes = 0;
+	};
+
+	struct MemoryHeapBudget
+	{
+		VkDeviceSize Size = 0;
+		bool IsDeviceLocal = false;
+		VkDeviceSize AllocatedBytes = 0;	// blocks and dedicated allocations of this allocator
+		VkDeviceSize PeakAllocatedBytes = 0;
+		// Whole process usage and what it can allocate without hurting performance, from VK_EXT_memory_budget
+		// Without the extension usage is AllocatedBytes and budget an estimate from the heap size
+		VkDeviceSize Usage = 0;
+		VkDeviceSize Budget = 0;
+	};
+
+	struct DeviceAllocatorStats
+	{
+		uint32_t BlockCount = 0;
+		VkDeviceSize BlockBytes = 0;
+		uint32_t AllocationCount = 0;		// resources in blocks
+		VkDeviceSize UsedBytes = 0;			// requested by resources in blocks
+		VkDeviceSize AllocatedBytes = 0;	// ranges given out, rounding makes it bigger than UsedBytes
+		float Fragmentation = 0.0f;			// share of free block memory outside the largest free range of its block
+		uint32_t DedicatedCount = 0;
+		VkDeviceSize DedicatedBytes = 0;
+		uint32_t MemoryObjectCount = 0;		// blocks and dedicated allocations, limited by maxMemoryAllocationCount
+		uint32_t MaxMemoryObjectCount = 0;
+	};
+
+	// Sub-allocate buffers and images from blocks per memory type
+	// bufferImageGranularity is honored by keeping optimal tiling images apart from buffers when it is bigger than the
+	// smallest range. Host visible blocks are mapped once for their whole life. Empty blocks are kept for reuse until Destroy.
+	class DeviceAllocator
+	{
+	public:
+		// hasMemoryBudget : VK_EXT_memory_budget is enabled on device
+		void Init(VkPhysicalDevice physicalDevice, VkDevice device, bool hasMemoryBudget);
+		// Every resource must be destroyed already
+		void Destroy();
+
+		// Allocate memory for the resource and bind it
+		DeviceAllocation AllocateBuffer(VkBuffer buffer, VkMemoryPropertyFlags properties, MemoryCategory category);
+		DeviceAllocation AllocateImage(VkImage image, VkMemoryPropertyFlags properties, MemoryCategory category);
+		void Free(const DeviceAllocation& allocation);
+
+		DeviceAllocatorStats GetStats() const;
+		void PrintStats() const;
+
+		const MemoryCategoryUsage& GetCategoryUsage(MemoryCategory category) const { return m_categoryUsage[static_cast<size_t>(category)]; }
+		// One per memory heap, queries the driver's budget every call
+		std::vector<MemoryHeapBudget> GetHeapBudgets() const;
+		bool HasMemoryBudget() const { return m_hasMemoryBudget; }
+		// One line per heap and one for the categories
+		void PrintBudget() const;
+	private:
+		struct Block
+		{
+			VkDeviceMemory Memory;
+			uint32_t MemoryType;
+			bool IsImageBlock;
+			uint8_t* MappedData;
+			BuddyAllocator Allocator;
+			uint32_t AllocationCount;
+			VkDeviceSize UsedBytes;
+		};
+
+		// dedicatedImage : allocate on its own for this image instead of sub-allocating
+		DeviceAllocation Allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties, MemoryCategory category,
+			bool isImage, VkImage dedicatedImage);
+		// pNext is chained to the allocate info
+		VkDeviceMemory AllocateMemory(VkDeviceSize size, uint32_t memoryType, const void* pNext, uint8_t** ppMappedData);
+		void FreeMemory(VkDeviceMemory memory, VkDeviceSize size, uint32_t heapIndex);
+
+		VkPhysicalDevice m_physicalDevice = VK_NULL_HANDLE;
+		VkDevice m_device = VK_NULL_HANDLE;
+		bool m_hasMemoryBudget = false;
+		VkPhysicalDeviceMemoryProperties m_memoryProperties{};
+		VkDeviceSize m_bufferImageGranularity = 1;
+		uint32_t m_maxMemoryObjectCount = 0;
+
+		std::vector<Block> m_blocks;
+		uint32_t m_dedicatedCount = 0;
+		VkDeviceSize m_dedicatedBytes = 0;
+
+		MemoryCategoryUsage m_categoryUsage[static_cast<size_t>(MemoryCategory::Count)];
+		VkDeviceSize m_heapAllocatedBytes[VK_MAX_MEMORY_HEAPS] = {};
+		VkDeviceSize m_heapPeakAllocatedBytes[VK_MAX_MEMORY_HEAPS] = {};
+	};
+}
@@ -0,0 +1,363 @@
+#include "FrustumCuller.h"
+
+#include <iostream>
+#include <algorithm>
+#include <limits>
+#include <random>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define FRUSTUM_CULLER_AVX
+#elif defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#include <emmintrin.h>
+#define FRUSTUM_CULLER_SSE
+#endif
+
+namespace
+{
+	// Spheres tested at once, slots are padded to a multiple of the widest one
+	constexpr uint32_t kSimdGroupSize = 8;
+
+	// Outside if any plane has the box's farthest corner along its normal behind it
+	// planeMask : planes still to test, those the box is fully in front of are cleared
+	bool IsBoxOutside(const glm::vec4 planes[6], const glm::vec3& boxMin, const glm::vec3& boxMax, uint32_t& planeMask)
+	{
+		for (uint32_t i = 0; i < 6; ++i)
+		{
+			if ((planeMask & (1u << i)) == 0)
+				continue;
+
+			glm::vec3 normal(planes[i]);
+			glm::vec3 farCorner(normal.x >= 0.0f ? boxMax.x : boxMin.x, normal.y >= 0.0f ? boxMax.y : boxMin.y, normal.z >= 0.0f ? boxMax.z : boxMin.z);
+			if (glm::dot(normal, farCorner) + planes[i].w < 0.0f)
+				return true;
+
+			glm::vec3 nearCorner(normal.x >= 0.0f ? boxMin.x : boxMax.x, normal.y >= 0.0f ? boxMin.y : boxMax.y, normal.z >= 0.0f ? boxMin.z : boxMax.z);
+			if (glm::dot(normal, nearCorner) + planes[i].w >= 0.0f)
+				planeMask &= ~(1u << i);
+		}
+		return false;
+	}
+}
+
+namespace VkUtils
+{
+	BoundingSphere TransformBoundingSphere(const BoundingSphere& sphere, const glm::mat4& transform)
+	{
+		float scale = std::max(glm::length(glm::vec3(transform[0])), std::max(glm::length(glm::vec3(transform[1])),
+			glm::length(glm::vec3(transform[2]))));
+		return { glm::vec3(transform * glm::vec4(sphere.Center, 1.0f)), sphere.Radius * scale };
+	}
+
+	void BuildInstanceRuns(const std::vector<uint32_t>& sortedIndices, std::vector<InstanceRun>& runs)
+	{
+		runs.clear();
+		for (auto index : sortedIndices)
+		{
+			if (!runs.empty() && runs.back().FirstInstance + runs.back().InstanceCount == index)
+				++runs.back().InstanceCount;
+			else
+				runs.push_back({ index, 1 });
+		}
+	}
+
+	void FrustumCuller::SetObjects(const std::vector<BoundingSphere>& spheres)
+	{
+		m_objectCount = static_cast<uint32_t>(spheres.size());
+		m_nodes.clear();
+
+		std::vector<uint32_t> order(m_objectCount);
+		for (uint32_t i = 0; i < m_objectCount; ++i)
+			order[i] = i;
+		// Building sorts order into leaves, slots follow it
+		if (m_objectCount >= kMinBvhObjectCount)
+			BuildNode(spheres, order, 0, m_objectCount);
+
+		// Padding slots are never visible, reading them is harmless
+		uint32_t slotCount = (m_objectCount + kSimdGroupSize - 1) / kSimdGroupSize * kSimdGroupSize + kSimdGroupSize;
+		m_centerX.assign(slotCount, 0.0f);
+		m_centerY.assign(slotCount, 0.0f);
+		m_centerZ.assign(slotCount, 0.0f);
+		m_radius.assign(slotCount, -std::numeric_limits<float>::max());
+		m_objectIndices.assign(order.begin(), order.end());
+		for (uint32_t slot = 0; slot < m_objectCount; ++slot)
+		{
+			const auto& sphere = spheres[order[slot]];
+			m_centerX[slot] = sphere.Center.x;
+			m_centerY[slot] = sphere.Center.y;
+			m_centerZ[slot] = sphere.Center.z;
+			m_radius[slot] = sphere.Radius;
+		}
+	}
+
+	void FrustumCuller::Cull(const glm::vec4 planes[6], std::vector<uint32_t>& visible) const
+	{
+		if (!HasBvh())
+		{
+			CullLinear(planes, visible);
+			return;
+		}
+
+		size_t firstVisible = visible.size();
+		// Each level halves the objects, 64 levels are never reached
+		struct StackEntry
+		{
+			uint32_t Node;
+			uint32_t PlaneMask;
+		};
+		StackEntry stack[64];
+		uint32_t stackSize = 0;
+		stack[stackSize++] = { 0, 0x3f };
+
+		while (stackSize > 0)
+		{
+			auto entry = stack[--stackSize];
+			const auto& node = m_nodes[entry.Node];
+			uint32_t planeMask = entry.PlaneMask;
+			if (IsBoxOutside(planes, node.Min, node.Max, planeMask))
+				continue;
+
+			if (planeMask == 0)
+				AppendSlots(node.FirstSlot, node.SlotCount, visible);
+			else if (node.SecondChild == 0)
+				TestSlots(planes, node.FirstSlot, node.SlotCount, visible);
+			else
+			{
+				stack[stackSize++] = { node.SecondChild, planeMask };
+				stack[stackSize++] = { entry.Node + 1, planeMask };
+			}
+		}
+
+		SortVisible(visible, firstVisible);
+	}
+
+	void FrustumCuller::CullLinear(const glm::vec4 planes[6], std::vector<uint32_t>& visible) const
+	{
+		size_t firstVisible = visible.size();
+		TestSlots(planes, 0, m_objectCount, visible);
+		if (HasBvh())
+			SortVisible(visible, firstVisible);
+	}
+
+	void FrustumCuller::CullScalar(const glm::vec4 planes[6], std::vector<uint32_t>& visible) const
+	{
+		size_t firstVisible = visible.size();
+		TestSlotsScalar(planes, 0, m_objectCount, visible);
+		if (HasBvh())
+			SortVisible(visible, firstVisible);
+	}
+
+	const char* FrustumCuller::GetSimdName()
+	{
+#if defined(FRUSTUM_CULLER_AVX)
+		return "AVX";
+#elif defined(FRUSTUM_CULLER_SSE)
+		return "SSE";
+#else
+		return "scalar";
+#endif
+	}
+
+	uint32_t FrustumCuller::BuildNode(const std::vector<BoundingSphere>& spheres, std::vector<uint32_t>& order, uint32_t first, uint32_t count)
+	{
+		auto nodeIndex = static_cast<uint32_t>(m_nodes.size());
+		m_nodes.push_back({ glm::vec3(std::numeric_limits<float>::max()), first, glm::vec3(-std::numeric_limits<float>::max()), count, 0 });
+
+		glm::vec3 boxMin(std::numeric_limits<float>::max()), boxMax(-std::numeric_limits<float>::max());
+		glm::vec3 centerMin = boxMin, centerMax = boxMax;
+		for (uint32_t i = first; i < first + count; ++i)
+		{
+			const auto& sphere = spheres[order[i]];
+			boxMin = glm::min(boxMin, sphere.Center - glm::vec3(sphere.Radius));
+			boxMax = glm::max(boxMax, sphere.Center + glm::vec3(sphere.Radius));
+			centerMin = glm::min(centerMin, sphere.Center);
+			centerMax = glm::max(centerMax, sphere.Center);
+		}
+		m_nodes[nodeIndex].Min = boxMin;
+		m_nodes[nodeIndex].Max = boxMax;
+
+		if (count <= kBvhLeafSize)
+			return nodeIndex;
+
+		// Median split along the longest extent of the centers, halves keep the tree balanced
+		glm::vec3 extent = centerMax - centerMin;
+		int axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : (extent.y >= extent.z ? 1 : 2);
+		uint32_t half = count / 2;
+		std::nth_element(order.begin() + first, order.begin() + first + half, order.begin() + first + count,
+			[&spheres, axis](uint32_t a, uint32_t b) { return spheres[a].Center[axis] < spheres[b].Center[axis]; });
+
+		BuildNode(spheres, order, first, half);
+		uint32_t secondChild = BuildNode(spheres, order, first + half, count - half);
+		m_nodes[nodeIndex].SecondChild = secondChild;
+		return nodeIndex;
+	}
+
+	void FrustumCuller::TestSlots(const glm::vec4 planes[6], uint32_t first, uint32_t count, std::vector<uint32_t>& visible) const
+	{
+#if defined(FRUSTUM_CULLER_AVX)
+		constexpr uint32_t kLaneCount = 8;
+		__m256 planeX[6], planeY[6], planeZ[6], planeW[6];
+		for (uint32_t p = 0; p < 6; ++p)
+		{
+			planeX[p] = _mm256_set1_ps(planes[p].x);
+			planeY[p] = _mm256_set1_ps(planes[p].y);
+			planeZ[p] = _mm256_set1_ps(planes[p].z);
+			planeW[p] = _mm256_set1_ps(planes[p].w);
+		}
+
+		for (uint32_t slot = first; slot < first + count; slot += kLaneCount)
+		{
+			__m256 x = _mm256_loadu_ps(&m_centerX[slot]);
+			__m256 y = _mm256_loadu_ps(&m_centerY[slot]);
+			__m256 z = _mm256_loadu_ps(&m_centerZ[slot]);
+			__m256 negRadius = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(&m_radius[slot]));
+
+			__m256 outside = _mm256_setzero_ps();
+			for (uint32_t p = 0; p < 6; ++p)
+			{
+				__m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(planeX[p], x), _mm256_mul_ps(planeY[p], y)),
+					_mm256_add_ps(_mm256_mul_ps(planeZ[p], z), planeW[p]));
+				outside = _mm256_or_ps(outside, _mm256_cmp_ps(distance, negRadius, _CMP_LT_OQ));
+			}
+			uint32_t visibleMask = ~static_cast<uint32_t>(_mm256_movemask_ps(outside)) & 0xff;
+#elif defined(FRUSTUM_CULLER_SSE)
+		constexpr uint32_t kLaneCount = 4;
+		__m128 planeX[6], planeY[6], planeZ[6], planeW[6];
+		for (uint32_t p = 0; p < 6; ++p)
+		{
+			planeX[p] = _mm_set1_ps(planes[p].x);
+			planeY[p] = _mm_set1_ps(planes[p].y);
+			planeZ[p] = _mm_set1_ps(planes[p].z);
+			planeW[p] = _mm_set1_ps(planes[p].w);
+		}
+
+		for (uint32_t slot = first; slot < first + count; slot += kLaneCount)
+		{
+			__m128 x = _mm_loadu_ps(&m_centerX[slot]);
+			__m128 y = _mm_loadu_ps(&m_centerY[slot]);
+			__m128 z = _mm_loadu_ps(&m_centerZ[slot]);
+			__m128 negRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(&m_radius[slot]));
+
+			__m128 outside = _mm_setzero_ps();
+			for (uint32_t p = 0; p < 6; ++p)
+			{
+				__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(planeX[p], x), _mm_mul_ps(planeY[p], y)),
+					_mm_add_ps(_mm_mul_ps(planeZ[p], z), planeW[p]));
+				outside = _mm_or_ps(outside, _mm_cmplt_ps(distance, negRadius));
+			}
+			uint32_t visibleMask = ~static_cast<uint32_t>(_mm_movemask_ps(outside)) & 0xf;
+#endif
+#if defined(FRUSTUM_CULLER_AVX) || defined(FRUSTUM_CULLER_SSE)
+			// Lanes past the range belong to other leaves or to padding
+			uint32_t remaining = first + count - slot;
+			if (remaining < kLaneCount)
+				visibleMask &= (1u << remaining) - 1;
+
+			for (uint32_t lane = 0; visibleMask != 0; ++lane, visibleMask >>= 1)
+			{
+				if (visibleMask & 1)
+					visible.push_back(m_objectIndices[slot + lane]);
+			}
+		}
+#else
+		TestSlotsScalar(planes, first, count, visible);
+#endif
+	}
+
+	void FrustumCuller::TestSlotsScalar(const glm::vec4 planes[6], uint32_t first, uint32_t count, std::vector<uint32_t>& visible) const
+	{
+		for (uint32_t slot = first; slot < first + count; ++slot)
+		{
+			bool isOutside = false;
+			for (uint32_t p = 0; p < 6 && !isOutside; ++p)
+				isOutside = planes[p].x * m_centerX[slot] + planes[p].y * m_centerY[slot] + planes[p].z * m_centerZ[slot] + planes[p].w < -m_radius[slot];
+
+			if (!isOutside)
+				visible.push_back(m_objectIndices[slot]);
+		}
+	}
+
+	void FrustumCuller::SortVisible(std::vector<uint32_t>& visible, size_t firstVisible) const
+	{
+		// One bit per object, read back in order : linear in the object count / 64 where a sort is v log v
+		std::vector<uint64_t> visibleBits((m_objectCount + 63) / 64, 0);
+		for (size_t i = firstVisible; i < visible.size(); ++i)
+			visibleBits[visible[i] / 64] |= 1ull << (visible[i] % 64);
+
+		visible.resize(firstVisible);
+		for (uint32_t word = 0; word < visibleBits.size(); ++word)
+		{
+			uint64_t bits = visibleBits[word];
+			for (uint32_t index = word * 64; bits != 0; ++index, bits >>= 1)
+			{
+				if (bits & 1)
+					visible.push_back(index);
+			}
+		}
+	}
+
+	void FrustumCuller::AppendSlots(uint32_t first, uint32_t count, std::vector<uint32_t>& visible) const
+	{
+		visible.insert(visible.end(), m_objectIndices.begin() + first, m_objectIndices.begin() + first + count);
+	}
+
+	void BenchmarkFrustumCulling(uint32_t objectCount, uint32_t iterations)
+	{
+		using Clock = std::chrono::high_resolution_clock;
+		iterations = std::max(1u, iterations);
+
+		// Spheres spread in a cube around a camera seeing a fraction of them, same seed every run
+		constexpr float kSceneExtent = 1000.0f;
+		std::mt19937 random(42);
+		std::uniform_real_distribution<float> position(-kSceneExtent, kSceneExtent);
+		std::uniform_real_distribution<float> radius(0.5f, 5.0f);
+		std::vector<BoundingSphere> spheres(objectCount);
+		for (auto& sphere : spheres)
+			sphere = { glm::vec3(position(random), position(random), position(random)), radius(random) };
+
+		glm::mat4 view = glm::lookAt(glm::vec3(0.0f), glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+		glm::mat4 proj = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, kSceneExtent);
+		glm::vec4 planes[6];
+		GetFrustumPlanes(proj * view, planes);
+
+		FrustumCuller culler;
+		auto buildStart = Clock::now();
+		culler.SetObjects(spheres);
+		double buildMs = std::chrono::duration<double, std::milli>(Clock::now() - buildStart).count();
+
+		struct Method
+		{
+			const char* Name;
+			void (FrustumCuller::*Cull)(const glm::vec4*, std::vector<uint32_t>&) const;
+			std::vector<uint32_t> Visible;
+			double Ms;
+		};
+		Method methods[] = {
+			{ "scalar", &FrustumCuller::CullScalar, {}, 0.0 },
+			{ culler.GetSimdName(), &FrustumCuller::CullLinear, {}, 0.0 },
+			{ culler.HasBvh() ? "BVH" : "BVH (too few objects, linear)", &FrustumCuller::Cull, {}, 0.0 },
+		};
+
+		for (auto& method : methods)
+		{
+			method.Visible.reserve(objectCount);
+			auto start = Clock::now();
+			for (uint32_t i = 0; i < iterations; ++i)
+			{
+				method.Visible.clear();
+				(culler.*method.Cull)(planes, method.Visible);
+			}
+			method.Ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count() / iterations;
+		}
+
+		std::cout << "\nFRUSTUM CULLING BENCHMARK : " << objectCount << " spheres, " << methods[0].Visible.size() << " visible ("
+			<< iterations << " iterations), BVH built in " << buildMs << " ms\n";
+		for (const auto& method : methods)
+		{
+			std::cout << "\t" << method.Name << " : " << method.Ms << " ms, "
+				<< (method.Ms > 0.0 ? objectCount / method.Ms : 0.0) << " objects culled per ms\n";
+			if (method.Visible != methods[0].Visible)
+				std::cout << "\tWARNING : " << method.Name << " found " << method.Visible.size() << " visible objects !\n";
+		}
+	}
+}
@@ -0,0 +1,81 @@
+#pragma once
+#include "VkUtils.h"
+
+namespace VkUtils
+{
+	// Objects from which SetObjects builds a BVH, fewer are faster to test one after the other
+	constexpr uint32_t kMinBvhObjectCount = 4096;
+	// Objects per BVH leaf, one AVX test or two SSE ones
+	constexpr uint32_t kBvhLeafSize = 8;
+
+	// Consecutive instances drawn by one instanced draw
+	struct InstanceRun
+	{
+		uint32_t FirstInstance;
+		uint32_t InstanceCount;
+
+		bool operator==(const InstanceRun& other) const { return FirstInstance == other.FirstInstance && InstanceCount == other.InstanceCount; }
+		bool operator!=(const InstanceRun& other) const { return !(*this == other); }
+	};
+
+	// Bounding sphere of a transformed object, its radius grows with the largest axis scale
+	BoundingSphere TransformBoundingSphere(const BoundingSphere& sphere, const glm::mat4& transform);
+
+	// Split increasing object indices into runs of consecutive ones
+	void BuildInstanceRuns(const std::vector<uint32_t>& sortedIndices, std::vector<InstanceRun>& runs);
+
+	// CPU frustum culling of bounding spheres, for devices drawing without the GPU culling pass
+	// Spheres are stored as structure of arrays and tested 8 (AVX) or 4 (SSE) at a time against the six planes,
+	// with a scalar fallback on other targets. Large scenes get a BVH of boxes : subtrees outside the frustum are skipped,
+	// those fully inside are accepted without testing their objects, only leaves crossing a plane test their spheres.
+	// Objects are static between SetObjects calls, moving any of them means setting them all again.
+	class FrustumCuller
+	{
+	public:
+		// Replace every object, index i is spheres[i] in Cull's results
+		void SetObjects(const std::vector<BoundingSphere>& spheres);
+
+		// Append the index of every object intersecting the frustum to visible, in increasing order
+		// planes : see GetFrustumPlanes
+		void Cull(const glm::vec4 planes[6], std::vector<uint32_t>& visible) const;
+		// Same without the BVH, testing every object with SIMD or one at a time, for comparison
+		void CullLinear(const glm::vec4 planes[6], std::vector<uint32_t>& visible) const;
+		void CullScalar(const glm::vec4 planes[6], std::vector<uint32_t>& visible) const;
+
+		uint32_t GetObjectCount() const { return m_objectCount; }
+		bool HasBvh() const { return !m_nodes.empty(); }
+		// "AVX", "SSE" or "scalar"
+		static const char* GetSimdName();
+	private:
+		// Depth first : first child follows its parent, objects of a subtree are contiguous slots
+		struct BvhNode
+		{
+			glm::vec3 Min;
+			uint32_t FirstSlot;
+			glm::vec3 Max;
+			uint32_t SlotCount;
+			uint32_t SecondChild;		// 0 for leaves
+		};
+
+		uint32_t BuildNode(const std::vector<BoundingSphere>& spheres, std::vector<uint32_t>& order, uint32_t first, uint32_t count);
+		// Test slots [first, first + count), append the visible ones' object index
+		void TestSlots(const glm::vec4 planes[6], uint32_t first, uint32_t count, std::vector<uint32_t>& visible) const;
+		void TestSlotsScalar(const glm::vec4 planes[6], uint32_t first, uint32_t count, std::vector<uint32_t>& visible) const;
+		void AppendSlots(uint32_t first, uint32_t count, std::vector<uint32_t>& visible) const;
+		// Visible indices from firstVisible on come in slot order, put them back in object order
+		void SortVisible(std::vector<uint32_t>& visible, size_t firstVisible) const;
+
+		uint32_t m_objectCount = 0;
+		// Per slot, padded to a whole SIMD group past the last object
+		std::vector<float> m_centerX;
+		std::vector<float> m_centerY;
+		std::vector<float> m_centerZ;
+		std::vector<float> m_radius;
+		// Slot -> object index, slots follow the BVH leaves' order
+		std::vector<uint32_t> m_objectIndices;
+		std::vector<BvhNode> m_nodes;
+	};
+
+	// Time every culling method on objectCount random spheres, print objects culled per millisecond
+	void BenchmarkFrustumCulling(uint32_t objectCount, uint32_t iterations);
+}
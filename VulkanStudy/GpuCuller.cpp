@@ -0,0 +1,332 @@
+#include "GpuCuller.h"
+
+#include <array>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+
+namespace
+{
+	// Matches cull.comp's Lod struct (std430)
+	struct GpuLod
+	{
+		uint32_t FirstSubMesh;
+		uint32_t SubMeshCount;
+		float Error;
+		uint32_t Padding;
+	};
+
+	// Matches cull.comp's Counters block, DrawCount first as DrawIndexedIndirectCount reads it at offset 0
+	struct GpuCounters
+	{
+		uint32_t DrawCount;
+		uint32_t VisibleCount;
+		uint32_t MaxPixelsPerUnit;		// float bits, positive floats order like their bits
+	};
+
+	// Uniforms, instances, LODs, sub meshes, draws, counters
+	constexpr uint32_t kCullBindingCount = 6;
+}
+
+namespace VkUtils
+{
+	void GpuCuller::Init(DeviceAllocator& allocator, VkPhysicalDevice physicalDevice, VkDevice device, UploadManager& uploadManager,
+		const UniformRing& uniformRing, const char* shaderPath, VkPipelineCache pipelineCache, uint32_t frameCount, bool hasDrawIndirectCount,
+		const std::vector<SubMesh>& subMeshes, const std::vector<MeshLod>& lods, const BoundingSphere& bounds, float lodErrorThreshold)
+	{
+		m_device = device;
+		m_allocator = &allocator;
+		m_hasDrawIndirectCount = hasDrawIndirectCount;
+		m_uniformBuffer = uniformRing.GetBuffer();
+		m_bounds = bounds;
+		m_lodErrorThreshold = lodErrorThreshold;
+
+		VkPhysicalDeviceProperties properties{};
+		vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+		m_maxDrawIndirectCount = properties.limits.maxDrawIndirectCount;
+
+		// Every sub mesh drawn once, firstInstance is the object's index and is set by the culling pass
+		std::vector<VkDrawIndexedIndirectCommand> subMeshDraws(subMeshes.size());
+		for (size_t i = 0; i < subMeshes.size(); ++i)
+			subMeshDraws[i] = { subMeshes[i].IndexCount, 1, subMeshes[i].FirstIndex, subMeshes[i].VertexOffset, 0 };
+
+		std::vector<GpuLod> gpuLods(lods.size());
+		for (size_t i = 0; i < lods.size(); ++i)
+		{
+			gpuLods[i] = { lods[i].FirstSubMesh, lods[i].SubMeshCount, lods[i].Error, 0 };
+			m_maxLodSubMeshCount = std::max(m_maxLodSubMeshCount, lods[i].SubMeshCount);
+		}
+		m_lodCount = static_cast<uint32_t>(lods.size());
+
+		m_subMeshBuffer = CreateMeshBuffer(uploadManager, subMeshDraws.data(), subMeshDraws.size() * sizeof(VkDrawIndexedIndirectCommand), &m_subMeshMemory);
+		m_lodBuffer = CreateMeshBuffer(uploadManager, gpuLods.data(), gpuLods.size() * sizeof(GpuLod), &m_lodMemory);
+
+		CreatePipeline(shaderPath, pipelineCache);
+		CreateDescriptorSets(frameCount);
+	}
+
+	void GpuCuller::Destroy()
+	{
+		if (m_device == VK_NULL_HANDLE)
+			return;
+
+		for (const auto& frame : m_frames)
+		{
+			vkDestroyBuffer(m_device, frame.DrawBuffer, nullptr);
+			vkDestroyBuffer(m_device, frame.CounterBuffer, nullptr);
+			vkDestroyBuffer(m_device, frame.ReadbackBuffer, nullptr);
+			m_allocator->Free(frame.DrawMemory);
+			m_allocator->Free(frame.CounterMemory);
+			m_allocator->Free(frame.ReadbackMemory);
+		}
+		m_frames.clear();
+
+		vkDestroyBuffer(m_device, m_subMeshBuffer, nullptr);
+		vkDestroyBuffer(m_device, m_lodBuffer, nullptr);
+		m_allocator->Free(m_subMeshMemory);
+		m_allocator->Free(m_lodMemory);
+
+		vkDestroyDescriptorPool(m_device, m_descriptorPool, nullptr);
+		vkDestroyPipeline(m_device, m_pipeline, nullptr);
+		vkDestroyPipelineLayout(m_device, m_pipelineLayout, nullptr);
+		vkDestroyDescriptorSetLayout(m_device, m_descriptorSetLayout, nullptr);
+		m_device = VK_NULL_HANDLE;
+	}
+
+	void GpuCuller::UpdateFrame(uint32_t frame, VkBuffer instanceBuffer, uint32_t objectCount)
+	{
+		auto& frameResources = m_frames[frame];
+		if (objectCount > frameResources.Capacity)
+		{
+			// Frame is done with the old buffer, it can go right away
+			vkDestroyBuffer(m_device, frameResources.DrawBuffer, nullptr);
+			m_allocator->Free(frameResources.DrawMemory);
+
+			uint32_t capacity = std::max(kMinCullCapacity, frameResources.Capacity);
+			while (capacity < objectCount)
+				capacity *= 2;
+			if (static_cast<uint64_t>(capacity) * m_maxLodSubMeshCount > m_maxDrawIndirectCount)
+				throw std::runtime_error("\nERROR : More culled draws than one indirect call may draw !\n");
+
+			frameResources.DrawBuffer = CreateBuffer(m_device, capacity * m_maxLodSubMeshCount * sizeof(VkDrawIndexedIndirectCommand),
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+			if (frameResources.DrawBuffer == VK_NULL_HANDLE)
+				throw std::runtime_error("\nVULKAN ERROR : Failed to create culled draw buffer !\n");
+			frameResources.DrawMemory = m_allocator->AllocateBuffer(frameResources.DrawBuffer, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MemoryCategory::Indirect);
+			frameResources.Capacity = capacity;
+		}
+
+		frameResources.ObjectCount = objectCount;
+		WriteDescriptorSet(frameResources, instanceBuffer);
+	}
+
+	uint32_t GpuCuller::PushUniforms(UniformRing& uniformRing, uint32_t frame, const UniformBufferObject& ubo, const glm::mat4& model,
+		float viewportHeight) const
+	{
+		CullUniforms uniforms{};
+		uniforms.View = ubo.View;
+		uniforms.Model = model;
+		GetFrustumPlanes(ubo.Proj * ubo.View, uniforms.FrustumPlanes);
+		uniforms.Bounds = glm::vec4(m_bounds.Center, m_bounds.Radius);
+		// Proj[1][1] is 1 / tan(fovY / 2), same metric as the CPU LOD selection
+		uniforms.PixelScale = std::abs(ubo.Proj[1][1]) * viewportHeight * 0.5f;
+		uniforms.LodErrorThreshold = m_lodErrorThreshold;
+		uniforms.ObjectCount = m_frames[frame].ObjectCount;
+		uniforms.LodCount = m_lodCount;
+
+		return uniformRing.Push(uniforms);
+	}
+
+	void GpuCuller::RecordCulling(VkCommandBuffer cmdBuffer, uint32_t frame, uint32_t uniformOffset) const
+	{
+		const auto& frameResources = m_frames[frame];
+
+		vkCmdFillBuffer(cmdBuffer, frameResources.CounterBuffer, 0, VK_WHOLE_SIZE, 0);
+		// Without a draw count every command up to the maximum is drawn, those the pass doesn't write must draw nothing
+		if (!m_hasDrawIndirectCount)
+			vkCmdFillBuffer(cmdBuffer, frameResources.DrawBuffer, 0, VK_WHOLE_SIZE, 0);
+
+		VkMemoryBarrier clearBarrier{};
+		clearBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		clearBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		clearBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &clearBarrier, 0, nullptr, 0, nullptr);
+
+		vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline);
+		vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelineLayout, 0, 1, &frameResources.DescriptorSet, 1, &uniformOffset);
+		vkCmdDispatch(cmdBuffer, (frameResources.ObjectCount + kCullGroupSize - 1) / kCullGroupSize, 1, 1);
+
+		// Draws and their count are read by the indirect draw, counters by the readback copy as well
+		VkMemoryBarrier cullBarrier{};
+		cullBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		cullBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		cullBarrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT;
+		vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+			0, 1, &cullBarrier, 0, nullptr, 0, nullptr);
+	}
+
+	void GpuCuller::RecordDraws(VkCommandBuffer cmdBuffer, uint32_t frame) const
+	{
+		const auto& frameResources = m_frames[frame];
+		uint32_t maxDrawCount = frameResources.ObjectCount * m_maxLodSubMeshCount;
+
+		if (m_hasDrawIndirectCount)
+			vkCmdDrawIndexedIndirectCount(cmdBuffer, frameResources.DrawBuffer, 0, frameResources.CounterBuffer, 0, maxDrawCount,
+				sizeof(VkDrawIndexedIndirectCommand));
+		else
+			vkCmdDrawIndexedIndirect(cmdBuffer, frameResources.DrawBuffer, 0, maxDrawCount, sizeof(VkDrawIndexedIndirectCommand));
+	}
+
+	void GpuCuller::RecordReadback(VkCommandBuffer cmdBuffer, uint32_t frame) const
+	{
+		const auto& frameResources = m_frames[frame];
+
+		VkBufferCopy bufferCopy{};
+		bufferCopy.size = sizeof(GpuCounters);
+		vkCmdCopyBuffer(cmdBuffer, frameResources.CounterBuffer, frameResources.ReadbackBuffer, 1, &bufferCopy);
+
+		VkMemoryBarrier readbackBarrier{};
+		readbackBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		readbackBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		readbackBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+		vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &readbackBarrier, 0, nullptr, 0, nullptr);
+	}
+
+	const CullStats& GpuCuller::ReadStats(uint32_t frame)
+	{
+		GpuCounters counters{};
+		memcpy(&counters, m_frames[frame].ReadbackMemory.MappedData, sizeof(counters));
+
+		m_lastStats.DrawCount = counters.DrawCount;
+		m_lastStats.VisibleCount = counters.VisibleCount;
+		memcpy(&m_lastStats.MaxPixelsPerUnit, &counters.MaxPixelsPerUnit, sizeof(float));
+		return m_lastStats;
+	}
+
+	void GpuCuller::CreatePipeline(const char* shaderPath, VkPipelineCache pipelineCache)
+	{
+		std::array<VkDescriptorSetLayoutBinding, kCullBindingCount> bindings{};
+		for (uint32_t i = 0; i < kCullBindingCount; ++i)
+		{
+			bindings[i].binding = i;
+			// Offset given at bind time, selects the frame's data in the uniform ring
+			bindings[i].descriptorType = i == 0 ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			bindings[i].descriptorCount = 1;
+			bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		}
+
+		VkDescriptorSetLayoutCreateInfo setLayoutCreateInfo{};
+		setLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		setLayoutCreateInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+		setLayoutCreateInfo.pBindings = bindings.data();
+		if (vkCreateDescriptorSetLayout(m_device, &setLayoutCreateInfo, nullptr, &m_descriptorSetLayout) != VK_SUCCESS)
+			throw std::runtime_error("\nVULKAN ERROR : Failed to create culling descriptor set layout !\n");
+
+		VkPipelineLayoutCreateInfo layoutCreateInfo{};
+		layoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		layoutCreateInfo.setLayoutCount = 1;
+		layoutCreateInfo.pSetLayouts = &m_descriptorSetLayout;
+		if (vkCreatePipelineLayout(m_device, &layoutCreateInfo, nullptr, &m_pipelineLayout) != VK_SUCCESS)
+			throw std::runtime_error("\nVULKAN ERROR : Failed to create culling pipeline layout !\n");
+
+		VkShaderModule shaderModule = CreateShaderModule(m_device, nullptr, shaderPath);
+
+		VkComputePipelineCreateInfo createInfo{};
+		createInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+		createInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		createInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+		createInfo.stage.module = shaderModule;
+		createInfo.stage.pName = "main";
+		createInfo.layout = m_pipelineLayout;
+		createInfo.basePipelineHandle = VK_NULL_HANDLE;
+		createInfo.basePipelineIndex = -1;
+
+		VkResult result = vkCreateComputePipelines(m_device, pipelineCache, 1, &createInfo, nullptr, &m_pipeline);
+		vkDestroyShaderModule(m_device, shaderModule, nullptr);
+		if (result != VK_SUCCESS)
+			throw std::runtime_error("\nVULKAN ERROR : Failed to create culling pipeline !\n");
+	}
+
+	void GpuCuller::CreateDescriptorSets(uint32_t frameCount)
+	{
+		VkDescriptorPoolSize poolSizes[2]{};
+		poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+		poolSizes[0].descriptorCount = frameCount;
+		poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		poolSizes[1].descriptorCount = frameCount * (kCullBindingCount - 1);
+
+		VkDescriptorPoolCreateInfo poolCreateInfo{};
+		poolCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+		poolCreateInfo.maxSets = frameCount;
+		poolCreateInfo.poolSizeCount = _countof(poolSizes);
+		poolCreateInfo.pPoolSizes = poolSizes;
+		if (vkCreateDescriptorPool(m_device, &poolCreateInfo, nullptr, &m_descriptorPool) != VK_SUCCESS)
+			throw std::runtime_error("\nVULKAN ERROR : Failed to create culling descriptor pool !\n");
+
+		std::vector<VkDescriptorSetLayout> setLayouts(frameCount, m_descriptorSetLayout);
+		std::vector<VkDescriptorSet> descriptorSets(frameCount);
+
+		VkDescriptorSetAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		allocInfo.descriptorPool = m_descriptorPool;
+		allocInfo.descriptorSetCount = frameCount;
+		allocInfo.pSetLayouts = setLayouts.data();
+		if (vkAllocateDescriptorSets(m_device, &allocInfo, descriptorSets.data()) != VK_SUCCESS)
+			throw std::runtime_error("\nVULKAN ERROR : Failed to allocate culling descriptor sets !\n");
+
+		// Draw buffers are created by the first UpdateFrame, counters never change size
+		m_frames.assign(frameCount, { VK_NULL_HANDLE, {}, VK_NULL_HANDLE, {}, VK_NULL_HANDLE, {}, VK_NULL_HANDLE, 0, 0 });
+		for (uint32_t i = 0; i < frameCount; ++i)
+		{
+			auto& frame = m_frames[i];
+			frame.DescriptorSet = descriptorSets[i];
+
+			frame.CounterBuffer = CreateBuffer(m_device, sizeof(GpuCounters),
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
+			frame.ReadbackBuffer = CreateBuffer(m_device, sizeof(GpuCounters), VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+			if (frame.CounterBuffer == VK_NULL_HANDLE || frame.ReadbackBuffer == VK_NULL_HANDLE)
+				throw std::runtime_error("\nVULKAN ERROR : Failed to create culling counter buffers !\n");
+			frame.CounterMemory = m_allocator->AllocateBuffer(frame.CounterBuffer, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MemoryCategory::Indirect);
+			frame.ReadbackMemory = m_allocator->AllocateBuffer(frame.ReadbackBuffer,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, MemoryCategory::Indirect);
+			// Read before the frame is first rendered
+			memset(frame.ReadbackMemory.MappedData, 0, sizeof(GpuCounters));
+		}
+	}
+
+	void GpuCuller::WriteDescriptorSet(const FrameResources& frame, VkBuffer instanceBuffer)
+	{
+		std::array<VkDescriptorBufferInfo, kCullBindingCount> bufferInfos{};
+		bufferInfos[0] = { m_uniformBuffer, 0, sizeof(CullUniforms) };
+		bufferInfos[1] = { instanceBuffer, 0, VK_WHOLE_SIZE };
+		bufferInfos[2] = { m_lodBuffer, 0, VK_WHOLE_SIZE };
+		bufferInfos[3] = { m_subMeshBuffer, 0, VK_WHOLE_SIZE };
+		bufferInfos[4] = { frame.DrawBuffer, 0, VK_WHOLE_SIZE };
+		bufferInfos[5] = { frame.CounterBuffer, 0, VK_WHOLE_SIZE };
+
+		std::array<VkWriteDescriptorSet, kCullBindingCount> writes{};
+		for (uint32_t i = 0; i < kCullBindingCount; ++i)
+		{
+			writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			writes[i].dstSet = frame.DescriptorSet;
+			writes[i].dstBinding = i;
+			writes[i].dstArrayElement = 0;
+			writes[i].descriptorCount = 1;
+			writes[i].descriptorType = i == 0 ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			writes[i].pBufferInfo = &bufferInfos[i];
+		}
+
+		vkUpdateDescriptorSets(m_device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+	}
+
+	VkBuffer GpuCuller::CreateMeshBuffer(UploadManager& uploadManager, const void* data, VkDeviceSize size, DeviceAllocation* pMemory)
+	{
+		VkBuffer buffer = CreateBuffer(m_device, size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+		if (buffer == VK_NULL_HANDLE)
+			throw std::runtime_error("\nVULKAN ERROR : Failed to create culling mesh buffer !\n");
+		*pMemory = m_allocator->AllocateBuffer(buffer, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MemoryCategory::Indirect);
+
+		uploadManager.UploadBuffer(buffer, 0, data, size);
+		return buffer;
+	}
+}
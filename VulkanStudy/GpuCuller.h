@@ -0,0 +1,116 @@
+#pragma once
+#include "VkUtils.h"
+#include "DeviceAllocator.h"
+#include "UniformRing.h"
+#include "UploadManager.h"
+
+namespace VkUtils
+{
+	// Objects a frame's draw buffer is created for at least, it grows by doubling from there
+	constexpr uint32_t kMinCullCapacity = 256;
+	// Matches cull.comp's local_size_x
+	constexpr uint32_t kCullGroupSize = 64;
+
+	// Per frame, matches cull.comp's CullUniforms block (std140)
+	struct CullUniforms
+	{
+		glm::mat4 View;
+		glm::mat4 Model;				// applied before every instance transform
+		glm::vec4 FrustumPlanes[6];		// world space, see GetFrustumPlanes
+		glm::vec4 Bounds;				// mesh bounding sphere, xyz center, w radius
+		float PixelScale;				// pixels covered by one unit at distance 1
+		float LodErrorThreshold;		// pixels
+		uint32_t ObjectCount;
+		uint32_t LodCount;
+	};
+
+	// What the GPU culled, read back once the frame's fence is signaled
+	struct CullStats
+	{
+		uint32_t DrawCount = 0;
+		uint32_t VisibleCount = 0;
+		float MaxPixelsPerUnit = 0.0f;	// of the visible object covering the most pixels, 0 if none is
+	};
+
+	// GPU driven draws of every instance of one mesh : a compute pass culls each instance's bounding sphere against
+	// the frustum, picks its LOD from the projected error, and appends one indexed indirect command per sub mesh of
+	// that LOD. Render pass draws them all with one indirect call, so recording and submitting cost the same for any
+	// object count. Draws read their transform from the instance buffer through firstInstance.
+	// Draw count is read on the GPU with DrawIndexedIndirectCount when the device has it, otherwise the command buffer
+	// is cleared first and its unused commands draw nothing.
+	// Buffers written by the pass are per frame, a frame's are only touched once the caller's fence says it is done.
+	class GpuCuller
+	{
+	public:
+		// Device needs multiDrawIndirect and drawIndirectFirstInstance, and drawIndirectCount if hasDrawIndirectCount
+		// Sub mesh and LOD tables are uploaded once, with the rest of the startup uploads
+		void Init(DeviceAllocator& allocator, VkPhysicalDevice physicalDevice, VkDevice device, UploadManager& uploadManager,
+			const UniformRing& uniformRing, const char* shaderPath, VkPipelineCache pipelineCache, uint32_t frameCount, bool hasDrawIndirectCount,
+			const std::vector<SubMesh>& subMeshes, const std::vector<MeshLod>& lods, const BoundingSphere& bounds, float lodErrorThreshold);
+		void Destroy();
+
+		// Size the frame's buffers for objectCount instances read from instanceBuffer, call whenever either changed
+		// Commands recorded for the frame must be recorded again
+		void UpdateFrame(uint32_t frame, VkBuffer instanceBuffer, uint32_t objectCount);
+
+		// Write the frame's culling parameters to the ring, return their dynamic offset
+		uint32_t PushUniforms(UniformRing& uniformRing, uint32_t frame, const UniformBufferObject& ubo, const glm::mat4& model,
+			float viewportHeight) const;
+
+		// Outside a render pass : reset counters and cull every object into the frame's draw buffer
+		void RecordCulling(VkCommandBuffer cmdBuffer, uint32_t frame, uint32_t uniformOffset) const;
+		// Inside the render pass, with vertex, instance and index buffers bound
+		void RecordDraws(VkCommandBuffer cmdBuffer, uint32_t frame) const;
+		// After the render pass : copy counters where ReadStats finds them
+		void RecordReadback(VkCommandBuffer cmdBuffer, uint32_t frame) const;
+
+		// Counters of the frame's last culling pass, its fence must be signaled
+		const CullStats& ReadStats(uint32_t frame);
+		// Last ones ReadStats returned
+		const CullStats& GetLastStats() const { return m_lastStats; }
+	private:
+		// One indirect command per draw, counters read by DrawIndexedIndirectCount and copied back to the host
+		struct FrameResources
+		{
+			VkBuffer DrawBuffer;
+			DeviceAllocation DrawMemory;
+			VkBuffer CounterBuffer;
+			DeviceAllocation CounterMemory;
+			VkBuffer ReadbackBuffer;
+			DeviceAllocation ReadbackMemory;
+			VkDescriptorSet DescriptorSet;
+			uint32_t Capacity;			// objects the draw buffer has room for
+			uint32_t ObjectCount;
+		};
+
+		void CreatePipeline(const char* shaderPath, VkPipelineCache pipelineCache);
+		void CreateDescriptorSets(uint32_t frameCount);
+		void WriteDescriptorSet(const FrameResources& frame, VkBuffer instanceBuffer);
+		VkBuffer CreateMeshBuffer(UploadManager& uploadManager, const void* data, VkDeviceSize size, DeviceAllocation* pMemory);
+
+		VkDevice m_device = VK_NULL_HANDLE;
+		DeviceAllocator* m_allocator = nullptr;
+		bool m_hasDrawIndirectCount = false;
+		uint32_t m_maxDrawIndirectCount = 0;
+
+		VkDescriptorSetLayout m_descriptorSetLayout = VK_NULL_HANDLE;
+		VkPipelineLayout m_pipelineLayout = VK_NULL_HANDLE;
+		VkPipeline m_pipeline = VK_NULL_HANDLE;
+		VkDescriptorPool m_descriptorPool = VK_NULL_HANDLE;
+		VkBuffer m_uniformBuffer = VK_NULL_HANDLE;
+
+		// Indirect command of each sub mesh with one instance, and each LOD's sub mesh run and error
+		VkBuffer m_subMeshBuffer = VK_NULL_HANDLE;
+		DeviceAllocation m_subMeshMemory;
+		VkBuffer m_lodBuffer = VK_NULL_HANDLE;
+		DeviceAllocation m_lodMemory;
+		uint32_t m_lodCount = 0;
+		// Draws one object may append
+		uint32_t m_maxLodSubMeshCount = 0;
+		BoundingSphere m_bounds{};
+		float m_lodErrorThreshold = 0.0f;
+
+		std::vector<FrameResources> m_frames;
+		CullStats m_lastStats;
+	};
+}
@@ -0,0 +1,120 @@
+#include "InstanceScene.h"
+
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+
+namespace VkUtils
+{
+	void InstanceScene::Init(DeviceAllocator& allocator, VkDevice device, uint32_t frameCount)
+	{
+		m_device = device;
+		m_allocator = &allocator;
+		m_frames.assign(frameCount, { VK_NULL_HANDLE, {}, 0, 0, 0 });
+	}
+
+	void InstanceScene::Destroy()
+	{
+		if (m_device == VK_NULL_HANDLE)
+			return;
+
+		for (const auto& frame : m_frames)
+		{
+			vkDestroyBuffer(m_device, frame.Buffer, nullptr);
+			m_allocator->Free(frame.Memory);
+		}
+		m_frames.clear();
+		m_device = VK_NULL_HANDLE;
+	}
+
+	uint32_t InstanceScene::AddInstance(const glm::mat4& model)
+	{
+		uint32_t id = static_cast<uint32_t>(m_instanceIndices.size());
+		if (!m_freeIds.empty())
+		{
+			id = m_freeIds.back();
+			m_freeIds.pop_back();
+		}
+		else
+		{
+			m_instanceIndices.push_back(UINT32_MAX);
+		}
+
+		m_instanceIndices[id] = static_cast<uint32_t>(m_instances.size());
+		m_instances.push_back({ model });
+		m_instanceIds.push_back(id);
+		++m_version;
+		return id;
+	}
+
+	void InstanceScene::RemoveInstance(uint32_t id)
+	{
+		if (id >= m_instanceIndices.size() || m_instanceIndices[id] == UINT32_MAX)
+			throw std::runtime_error("\nERROR : Removed instance does not exist !\n");
+
+		// Last instance takes the hole, the array stays packed for the draw
+		uint32_t index = m_instanceIndices[id];
+		uint32_t lastId = m_instanceIds.back();
+		m_instances[index] = m_instances.back();
+		m_instanceIds[index] = lastId;
+		m_instanceIndices[lastId] = index;
+
+		m_instances.pop_back();
+		m_instanceIds.pop_back();
+		m_instanceIndices[id] = UINT32_MAX;
+		m_freeIds.push_back(id);
+		++m_version;
+	}
+
+	void InstanceScene::SetTransform(uint32_t id, const glm::mat4& model)
+	{
+		m_instances[m_instanceIndices[id]].Model = model;
+		++m_version;
+	}
+
+	void InstanceScene::Clear()
+	{
+		m_instances.clear();
+		m_instanceIndices.clear();
+		m_instanceIds.clear();
+		m_freeIds.clear();
+		++m_version;
+	}
+
+	bool InstanceScene::UpdateFrame(uint32_t frame)
+	{
+		auto& frameBuffer = m_frames[frame];
+		if (frameBuffer.Version == m_version)
+			return false;
+
+		bool isRecreated = false;
+		uint32_t instanceCount = GetInstanceCount();
+		if (instanceCount > frameBuffer.Capacity)
+		{
+			// Frame is done with the old buffer, it can go right away
+			vkDestroyBuffer(m_device, frameBuffer.Buffer, nullptr);
+			m_allocator->Free(frameBuffer.Memory);
+
+			uint32_t capacity = std::max(kMinInstanceCapacity, frameBuffer.Capacity);
+			while (capacity < instanceCount)
+				capacity *= 2;
+
+			frameBuffer.Buffer = CreateBuffer(m_device, capacity * sizeof(InstanceData),
+				VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+			if (frameBuffer.Buffer == VK_NULL_HANDLE)
+				throw std::runtime_error("\nVULKAN ERROR : Failed to create instance buffer !\n");
+			frameBuffer.Memory = m_allocator->AllocateBuffer(frameBuffer.Buffer,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, MemoryCategory::Instance);
+			frameBuffer.Capacity = capacity;
+			isRecreated = true;
+		}
+
+		if (instanceCount > 0)
+			memcpy(frameBuffer.Memory.MappedData, m_instances.data(), instanceCount * sizeof(InstanceData));
+
+		bool isCountChanged = frameBuffer.InstanceCount != instanceCount;
+		frameBuffer.InstanceCount = instanceCount;
+		frameBuffer.Version = m_version;
+		return isRecreated || isCountChanged;
+	}
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include "VkUtils.h"
+#include "DeviceAllocator.h"
+
+namespace VkUtils
+{
+	// Instances a buffer is created for at least, it grows by doubling from there
+	constexpr uint32_t kMinInstanceCapacity = 256;
+
+	// Copies of one mesh drawn with a single instanced draw, each with its own transform
+	// Instances are kept packed in a CPU array (removal moves the last one in the hole) and mirrored to a host visible
+	// buffer per frame, bound as the instance rate vertex binding. A frame's buffer is rewritten only when the
+	// instances changed since it was last written, and only once the caller's fence says the frame is done with it.
+	class InstanceScene
+	{
+	public:
+		// frameCount : buffers, one per frame recorded at once
+		void Init(DeviceAllocator& allocator, VkDevice device, uint32_t frameCount);
+		void Destroy();
+
+		// Return an id staying valid until the instance is removed
+		uint32_t AddInstance(const glm::mat4& model);
+		void RemoveInstance(uint32_t id);
+		void SetTransform(uint32_t id, const glm::mat4& model);
+		void Clear();
+
+		// Bring the frame's buffer up to date. Return true if commands recorded with it must be recorded again,
+		// the buffer or the instance count changed. Buffer is also readable as a storage buffer of mat4
+		bool UpdateFrame(uint32_t frame);
+
+		uint32_t GetInstanceCount() const { return static_cast<uint32_t>(m_instances.size()); }
+		const std::vector<InstanceData>& GetInstances() const { return m_instances; }
+		// Changes with every instance change, for caches built from the instances
+		uint64_t GetVersion() const { return m_version; }
+		VkBuffer GetBuffer(uint32_t frame) const { return m_frames[frame].Buffer; }
+	private:
+		struct FrameBuffer
+		{
+			VkBuffer Buffer;
+			DeviceAllocation Memory;
+			uint32_t Capacity;
+			uint32_t InstanceCount;		// written last time
+			uint64_t Version;			// of the instances written last time
+		};
+
+		VkDevice m_device = VK_NULL_HANDLE;
+		DeviceAllocator* m_allocator = nullptr;
+		std::vector<FrameBuffer> m_frames;
+
+		std::vector<InstanceData> m_instances;
+		// id -> index in m_instances, UINT32_MAX once removed
+		std::vector<uint32_t> m_instanceIndices;
+		// index in m_instances -> id
+		std::vector<uint32_t> m_instanceIds;
+		std::vector<uint32_t> m_freeIds;
+		// Incremented by every change
+		uint64_t m_version = 1;
+	};
+}
@@ -0,0 +1,105 @@
+#include "KtxLoader.h"
+
+#include <cstring>
+#include <algorithm>
+
+namespace
+{
+	// «KTX 20»\r\n\x1A\n
+	const uint8_t KTX2_IDENTIFIER[12] = { 0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32, 0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A };
+
+	struct Ktx2Header
+	{
+		uint8_t Identifier[12];
+		uint32_t VkFormat;
+		uint32_t TypeSize;
+		uint32_t PixelWidth;
+		uint32_t PixelHeight;
+		uint32_t PixelDepth;
+		uint32_t LayerCount;
+		uint32_t FaceCount;
+		uint32_t LevelCount;
+		uint32_t SupercompressionScheme;
+		// Index of the data format descriptor, key/values and supercompression data, none of them are needed here
+		uint32_t DfdByteOffset;
+		uint32_t DfdByteLength;
+		uint32_t KvdByteOffset;
+		uint32_t KvdByteLength;
+		uint64_t SgdByteOffset;
+		uint64_t SgdByteLength;
+	};
+
+	// Followed by LevelCount of these, level 0 (the largest) first
+	struct Ktx2LevelIndex
+	{
+		uint64_t ByteOffset;
+		uint64_t ByteLength;
+		uint64_t UncompressedByteLength;
+	};
+}
+
+namespace VkUtils
+{
+	bool Ktx2Texture::Open(const char* fileName)
+	{
+		Close();
+
+		if (!m_file.Open(fileName))
+			return false;
+
+		Ktx2Header header;
+		if (m_file.Size() < sizeof(header))
+		{
+			Close();
+			return false;
+		}
+		memcpy(&header, m_file.Data(), sizeof(header));
+
+		auto format = static_cast<VkFormat>(header.VkFormat);
+		uint32_t blockExtent = GetTextureFormatBlockExtent(format);
+		uint32_t blockSize = GetTextureFormatBlockSize(format);
+		// Level count 0 means only the base level is stored and the rest has to be generated
+		uint32_t levelCount = std::max(header.LevelCount, 1u);
+
+		if (memcmp(header.Identifier, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER)) != 0 || blockSize == 0 ||
+			header.PixelWidth == 0 || header.PixelHeight == 0 || header.PixelDepth != 0 || header.LayerCount > 1 ||
+			header.FaceCount != 1 || header.SupercompressionScheme != 0 ||
+			levelCount > CalculateMipLevels({ header.PixelWidth, header.PixelHeight, 1 }) ||
+			m_file.Size() < sizeof(header) + sizeof(Ktx2LevelIndex) * static_cast<uint64_t>(levelCount))
+		{
+			Close();
+			return false;
+		}
+
+		m_levels.resize(levelCount);
+		for (uint32_t level = 0; level < levelCount; ++level)
+		{
+			Ktx2LevelIndex index;
+			memcpy(&index, m_file.Data() + sizeof(header) + sizeof(index) * level, sizeof(index));
+
+			// Levels must be tightly packed blocks, that's what vkCmdCopyBufferToImage expects with a 0 row length
+			uint64_t blocksX = (std::max(1u, header.PixelWidth >> level) + blockExtent - 1) / blockExtent;
+			uint64_t blocksY = (std::max(1u, header.PixelHeight >> level) + blockExtent - 1) / blockExtent;
+			if (index.ByteLength != blocksX * blocksY * blockSize || index.ByteOffset > m_file.Size() ||
+				index.ByteLength > m_file.Size() - index.ByteOffset)
+			{
+				Close();
+				return false;
+			}
+
+			m_levels[level] = { index.ByteOffset, index.ByteLength };
+		}
+
+		m_format = format;
+		m_extent = { header.PixelWidth, header.PixelHeight, 1 };
+		return true;
+	}
+
+	void Ktx2Texture::Close()
+	{
+		m_file.Close();
+		m_format = VK_FORMAT_UNDEFINED;
+		m_extent = {};
+		m_levels.clear();
+	}
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include "VkUtils.h"
+#include "AssetPackage.h"
+
+namespace VkUtils
+{
+	// Memory mapped KTX 2.0 texture, level data is read directly from the mapping
+	// Only plain 2D textures are handled : one layer, one face, no supercompression, and a VkFormat
+	// GetTextureFormatBlockSize knows, so every level can be copied to the image as is
+	class Ktx2Texture
+	{
+	public:
+		// Return false if file is missing, isn't KTX 2.0 or uses anything listed above
+		bool Open(const char* fileName);
+		void Close();
+
+		bool IsOpen() const { return m_file.IsOpen(); }
+
+		VkFormat GetFormat() const { return m_format; }
+		VkExtent3D GetExtent() const { return m_extent; }
+		// Levels stored in the file, 1 when the file asks for mipmaps to be generated at load time
+		uint32_t GetMipLevels() const { return static_cast<uint32_t>(m_levels.size()); }
+
+		const void* GetLevelData(uint32_t level) const { return m_file.Data() + m_levels[level].Offset; }
+		uint64_t GetLevelSize(uint32_t level) const { return m_levels[level].Size; }
+	private:
+		struct Level
+		{
+			uint64_t Offset;
+			uint64_t Size;
+		};
+
+		MappedFile m_file;
+		VkFormat m_format = VK_FORMAT_UNDEFINED;
+		VkExtent3D m_extent = {};
+		std::vector<Level> m_levels;
+	};
+}
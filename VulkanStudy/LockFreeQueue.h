@@ -0,0 +1,91 @@
+#pragma once
+#include <atomic>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+
+namespace VkUtils
+{
+	// Bounded queue any number of threads can push to and pop from without locks (Dmitry Vyukov's design)
+	// Every slot has a sequence number telling whether it is free for the producer of a given position,
+	// or filled for its consumer, so producers and consumers only contend on their own position counter
+	template <typename T>
+	class LockFreeQueue
+	{
+	public:
+		// capacity must be a power of two
+		explicit LockFreeQueue(size_t capacity)
+			: m_slots(new Slot[capacity]), m_mask(capacity - 1), m_enqueuePosition(0), m_dequeuePosition(0)
+		{
+			for (size_t i = 0; i < capacity; ++i)
+				m_slots[i].Sequence.store(i, std::memory_order_relaxed);
+		}
+
+		LockFreeQueue(const LockFreeQueue&) = delete;
+		LockFreeQueue& operator=(const LockFreeQueue&) = delete;
+
+		// Return false if the queue is full
+		bool TryPush(const T& value)
+		{
+			size_t position = m_enqueuePosition.load(std::memory_order_relaxed);
+			while (true)
+			{
+				Slot& slot = m_slots[position & m_mask];
+				size_t sequence = slot.Sequence.load(std::memory_order_acquire);
+				intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+				if (difference == 0)
+				{
+					if (m_enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+					{
+						slot.Value = value;
+						// Publish the value to the consumer of this position
+						slot.Sequence.store(position + 1, std::memory_order_release);
+						return true;
+					}
+				}
+				else if (difference < 0)
+					return false;
+				else
+					position = m_enqueuePosition.load(std::memory_order_relaxed);
+			}
+		}
+
+		// Return false if the queue is empty
+		bool TryPop(T& value)
+		{
+			size_t position = m_dequeuePosition.load(std::memory_order_relaxed);
+			while (true)
+			{
+				Slot& slot = m_slots[position & m_mask];
+				size_t sequence = slot.Sequence.load(std::memory_order_acquire);
+				intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position + 1);
+				if (difference == 0)
+				{
+					if (m_dequeuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+					{
+						value = slot.Value;
+						// Free the slot for the producer one lap later
+						slot.Sequence.store(position + m_mask + 1, std::memory_order_release);
+						return true;
+					}
+				}
+				else if (difference < 0)
+					return false;
+				else
+					position = m_dequeuePosition.load(std::memory_order_relaxed);
+			}
+		}
+	private:
+		struct Slot
+		{
+			std::atomic<size_t> Sequence;
+			T Value;
+		};
+
+		std::unique_ptr<Slot[]> m_slots;
+		size_t m_mask;
+		// Own cache lines, producers and consumers don't invalidate each other's counter
+		alignas(64) std::atomic<size_t> m_enqueuePosition;
+		alignas(64) std::atomic<size_t> m_dequeuePosition;
+	};
+}
@@ -0,0 +1,415 @@
+#include "MeshOptimizer.h"
+
+#include <iostream>
+#include <algorithm>
+#include <numeric>
+
+namespace
+{
+	// Vertex to triangles adjacency, stored as one array indexed by per vertex offsets
+	struct TriangleAdjacency
+	{
+		std::vector<uint32_t> Offsets;		// vertexCount + 1 entries
+		std::vector<uint32_t> Triangles;
+	};
+
+	TriangleAdjacency BuildAdjacency(const std::vector<uint32_t>& indices, size_t vertexCount)
+	{
+		TriangleAdjacency adjacency;
+		adjacency.Offsets.assign(vertexCount + 1, 0);
+		adjacency.Triangles.resize(indices.size());
+
+		for (auto index : indices)
+			++adjacency.Offsets[index + 1];
+		std::partial_sum(adjacency.Offsets.begin(), adjacency.Offsets.end(), adjacency.Offsets.begin());
+
+		std::vector<uint32_t> cursors(adjacency.Offsets.begin(), adjacency.Offsets.end() - 1);
+		for (size_t i = 0; i < indices.size(); ++i)
+			adjacency.Triangles[cursors[indices[i]]++] = static_cast<uint32_t>(i / 3);
+
+		return adjacency;
+	}
+
+	// FIFO cache emulated with timestamps : a vertex is cached if less than cacheSize misses happened since it was loaded
+	class FifoCache
+	{
+	public:
+		FifoCache(size_t vertexCount, uint32_t cacheSize):
+			m_timestamps(vertexCount, 0), m_cacheSize(cacheSize), m_time(cacheSize + 1)
+		{
+		}
+
+		// Return true on a cache miss
+		bool Access(uint32_t vertex)
+		{
+			if (m_time - m_timestamps[vertex] <= m_cacheSize)
+				return false;
+
+			m_timestamps[vertex] = m_time++;
+			return true;
+		}
+
+		void Flush() { m_time += m_cacheSize + 1; }
+	private:
+		std::vector<uint32_t> m_timestamps;
+		uint32_t m_cacheSize;
+		uint32_t m_time;
+	};
+
+	uint32_t CountCacheMisses(const uint32_t* indices, size_t indexCount, FifoCache& cache)
+	{
+		uint32_t misses = 0;
+		for (size_t i = 0; i < indexCount; ++i)
+			misses += cache.Access(indices[i]) ? 1 : 0;
+		return misses;
+	}
+}
+
+namespace VkUtils
+{
+	VertexCacheStats AnalyzeVertexCache(const std::vector<uint32_t>& indices, size_t vertexCount, uint32_t cacheSize)
+	{
+		VertexCacheStats stats;
+		if (indices.empty())
+			return stats;
+
+		FifoCache cache(vertexCount, cacheSize);
+		uint32_t misses = CountCacheMisses(indices.data(), indices.size(), cache);
+
+		std::vector<uint8_t> referenced(vertexCount, 0);
+		size_t referencedCount = 0;
+		for (auto index : indices)
+		{
+			referencedCount += referenced[index] ? 0 : 1;
+			referenced[index] = 1;
+		}
+
+		stats.Acmr = static_cast<float>(misses) / (indices.size() / 3);
+		stats.Atvr = static_cast<float>(misses) / referencedCount;
+		return stats;
+	}
+
+	void OptimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount, std::vector<uint32_t>* pClusters, uint32_t cacheSize)
+	{
+		if (pClusters)
+			pClusters->clear();
+
+		size_t triangleCount = indices.size() / 3;
+		if (triangleCount == 0)
+			return;
+
+		auto adjacency = BuildAdjacency(indices, vertexCount);
+
+		std::vector<uint32_t> liveTriangles(vertexCount);
+		for (size_t vertex = 0; vertex < vertexCount; ++vertex)
+			liveTriangles[vertex] = adjacency.Offsets[vertex + 1] - adjacency.Offsets[vertex];
+
+		std::vector<uint32_t> cacheTimestamps(vertexCount, 0);
+		std::vector<uint8_t> emitted(triangleCount, 0);
+		std::vector<uint32_t> deadEndStack;
+		std::vector<uint32_t> candidates;
+		deadEndStack.reserve(indices.size());
+
+		std::vector<uint32_t> result;
+		result.reserve(indices.size());
+
+		uint32_t timestamp = cacheSize + 1;
+		uint32_t scanCursor = 0;
+
+		// Recently used vertices first, then input order
+		auto skipDeadEnd = [&]() -> uint32_t
+		{
+			while (!deadEndStack.empty())
+			{
+				uint32_t vertex = deadEndStack.back();
+				deadEndStack.pop_back();
+				if (liveTriangles[vertex] > 0)
+					return vertex;
+			}
+
+			while (scanCursor < vertexCount)
+			{
+				if (liveTriangles[scanCursor] > 0)
+					return scanCursor;
+				++scanCursor;
+			}
+
+			return UINT32_MAX;
+		};
+
+		uint32_t fanningVertex = skipDeadEnd();
+		while (fanningVertex != UINT32_MAX)
+		{
+			candidates.clear();
+
+			// Emit every remaining triangle around the fanning vertex
+			for (uint32_t i = adjacency.Offsets[fanningVertex]; i < adjacency.Offsets[fanningVertex + 1]; ++i)
+			{
+				uint32_t triangle = adjacency.Triangles[i];
+				if (emitted[triangle])
+					continue;
+
+				for (uint32_t corner = 0; corner < 3; ++corner)
+				{
+					uint32_t vertex = indices[triangle * 3 + corner];
+					result.push_back(vertex);
+					deadEndStack.push_back(vertex);
+					candidates.push_back(vertex);
+					--liveTriangles[vertex];
+
+					if (timestamp - cacheTimestamps[vertex] > cacheSize)
+						cacheTimestamps[vertex] = timestamp++;
+				}
+
+				emitted[triangle] = 1;
+			}
+
+			// Next fanning vertex is the oldest candidate which will still be in cache after its remaining triangles are emitted
+			uint32_t nextVertex = UINT32_MAX;
+			int32_t bestPriority = -1;
+			for (auto vertex : candidates)
+			{
+				if (liveTriangles[vertex] == 0)
+					continue;
+
+				int32_t priority = 0;
+				uint32_t age = timestamp - cacheTimestamps[vertex];
+				if (age + 2 * liveTriangles[vertex] <= cacheSize)
+					priority = static_cast<int32_t>(age);
+
+				if (priority > bestPriority)
+				{
+					bestPriority = priority;
+					nextVertex = vertex;
+				}
+			}
+
+			if (nextVertex == UINT32_MAX)
+			{
+				// Dead end, the stream jumps somewhere else : that is where a new cluster starts
+				nextVertex = skipDeadEnd();
+				if (pClusters && nextVertex != UINT32_MAX)
+					pClusters->push_back(static_cast<uint32_t>(result.size() / 3));
+			}
+
+			fanningVertex = nextVertex;
+		}
+
+		if (pClusters)
+			pClusters->insert(pClusters->begin(), 0);
+
+		indices.swap(result);
+	}
+
+	size_t OptimizeOverdraw(std::vector<uint32_t>& indices, const std::vector<Vertex>& vertices, const std::vector<uint32_t>& clusters,
+		float threshold, uint32_t cacheSize)
+	{
+		uint32_t triangleCount = static_cast<uint32_t>(indices.size() / 3);
+		if (triangleCount == 0 || clusters.empty())
+			return 0;
+
+		// Split clusters where starting over with a cold cache still stays close to the cluster ACMR
+		// Smaller clusters sort better, the threshold bounds what it costs to the vertex cache
+		std::vector<uint32_t> splitClusters;
+		FifoCache cache(vertices.size(), cacheSize);
+		for (size_t i = 0; i < clusters.size(); ++i)
+		{
+			uint32_t begin = clusters[i];
+			uint32_t end = i + 1 < clusters.size() ? clusters[i + 1] : triangleCount;
+
+			cache.Flush();
+			float clusterAcmr = static_cast<float>(CountCacheMisses(indices.data() + begin * 3, (end - begin) * 3, cache)) / (end - begin);
+
+			cache.Flush();
+			splitClusters.push_back(begin);
+			uint32_t misses = 0;
+			uint32_t splitBegin = begin;
+			for (uint32_t triangle = begin; triangle < end; ++triangle)
+			{
+				misses += CountCacheMisses(indices.data() + triangle * 3, 3, cache);
+
+				float acmr = static_cast<float>(misses) / (triangle + 1 - splitBegin);
+				if (acmr <= clusterAcmr * threshold && triangle + 1 < end)
+				{
+					splitClusters.push_back(triangle + 1);
+					splitBegin = triangle + 1;
+					misses = 0;
+					cache.Flush();
+				}
+			}
+		}
+
+		// Area weighted centroid and normal of every cluster
+		struct ClusterInfo
+		{
+			uint32_t Begin;
+			uint32_t End;
+			glm::vec3 Centroid;
+			glm::vec3 Normal;
+			float SortKey;
+		};
+
+		std::vector<ClusterInfo> clusterInfos(splitClusters.size());
+		glm::vec3 meshCentroid(0.0f);
+		float meshArea = 0.0f;
+
+		for (size_t i = 0; i < splitClusters.size(); ++i)
+		{
+			auto& info = clusterInfos[i];
+			info.Begin = splitClusters[i];
+			info.End = i + 1 < splitClusters.size() ? splitClusters[i + 1] : triangleCount;
+			info.Centroid = glm::vec3(0.0f);
+			info.Normal = glm::vec3(0.0f);
+
+			float clusterArea = 0.0f;
+			for (uint32_t triangle = info.Begin; triangle < info.End; ++triangle)
+			{
+				const auto& p0 = vertices[indices[triangle * 3 + 0]].Pos;
+				const auto& p1 = vertices[indices[triangle * 3 + 1]].Pos;
+				const auto& p2 = vertices[indices[triangle * 3 + 2]].Pos;
+
+				glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+				float area = glm::length(normal);
+
+				info.Centroid += (p0 + p1 + p2) * (area / 3.0f);
+				info.Normal += normal;
+				clusterArea += area;
+			}
+
+			meshCentroid += info.Centroid;
+			meshArea += clusterArea;
+			if (clusterArea > 0.0f)
+				info.Centroid /= clusterArea;
+		}
+
+		if (meshArea > 0.0f)
+			meshCentroid /= meshArea;
+
+		// Clusters far out from the center and facing away from it are drawn first
+		for (auto& info : clusterInfos)
+		{
+			float normalLength = glm::length(info.Normal);
+			info.SortKey = normalLength > 0.0f ? glm::dot(info.Centroid - meshCentroid, info.Normal / normalLength) : 0.0f;
+		}
+
+		std::stable_sort(clusterInfos.begin(), clusterInfos.end(),
+			[](const ClusterInfo& a, const ClusterInfo& b) { return a.SortKey > b.SortKey; });
+
+		std::vector<uint32_t> result;
+		result.reserve(indices.size());
+		for (const auto& info : clusterInfos)
+			result.insert(result.end(), indices.begin() + info.Begin * 3, indices.begin() + info.End * 3);
+
+		indices.swap(result);
+		return clusterInfos.size();
+	}
+
+	void OptimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices)
+	{
+		std::vector<uint32_t> remap(vertices.size(), UINT32_MAX);
+		std::vector<Vertex> result;
+		result.reserve(vertices.size());
+
+		for (auto& index : indices)
+		{
+			if (remap[index] == UINT32_MAX)
+			{
+				remap[index] = static_cast<uint32_t>(result.size());
+				result.push_back(vertices[index]);
+			}
+
+			index = remap[index];
+		}
+
+		vertices.swap(result);
+	}
+
+	MeshOptimizationStats OptimizeMesh(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices)
+	{
+		MeshOptimizationStats stats;
+		stats.Before = AnalyzeVertexCache(indices, vertices.size());
+
+		auto startTime = std::chrono::high_resolution_clock::now();
+
+		std::vector<uint32_t> clusters;
+		OptimizeVertexCache(indices, vertices.size(), &clusters);
+		stats.ClusterCount = OptimizeOverdraw(indices, vertices, clusters);
+		OptimizeVertexFetch(vertices, indices);
+
+		stats.OptimizationTime = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+		stats.After = AnalyzeVertexCache(indices, vertices.size());
+		return stats;
+	}
+
+	void PrintMeshOptimizationStats(const char* meshName, const MeshOptimizationStats& stats)
+	{
+		std::cout << "\nMESH OPTIMIZED : " << meshName << " in " << stats.OptimizationTime << " ms, " << stats.ClusterCount << " clusters\n";
+		std::cout << "\tACMR : " << stats.Before.Acmr << " -> " << stats.After.Acmr << "\n";
+		std::cout << "\tATVR : " << stats.Before.Atvr << " -> " << stats.After.Atvr << "\n";
+	}
+
+	std::vector<SubMesh> SplitMeshForShortIndices(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices)
+	{
+		std::vector<SubMesh> subMeshes;
+		if (vertices.size() <= kMaxShortIndexVertexCount)
+		{
+			subMeshes.push_back({ 0, static_cast<uint32_t>(indices.size()), 0 });
+			return subMeshes;
+		}
+
+		// Local index of every vertex in the current sub mesh, UINT32_MAX if it isn't used yet
+		std::vector<uint32_t> localIndices(vertices.size(), UINT32_MAX);
+		std::vector<uint32_t> subMeshVertices;
+		std::vector<Vertex> result;
+		result.reserve(vertices.size());
+
+		SubMesh subMesh{ 0, 0, 0 };
+		auto closeSubMesh = [&](uint32_t endIndex)
+		{
+			for (auto vertex : subMeshVertices)
+			{
+				result.push_back(vertices[vertex]);
+				localIndices[vertex] = UINT32_MAX;
+			}
+
+			subMesh.IndexCount = endIndex - subMesh.FirstIndex;
+			subMeshes.push_back(subMesh);
+
+			subMesh.FirstIndex = endIndex;
+			subMesh.VertexOffset = static_cast<int32_t>(result.size());
+			subMeshVertices.clear();
+		};
+
+		for (uint32_t i = 0; i + 2 < indices.size(); i += 3)
+		{
+			size_t newVertexCount = 0;
+			for (uint32_t corner = 0; corner < 3; ++corner)
+				newVertexCount += localIndices[indices[i + corner]] == UINT32_MAX ? 1 : 0;
+
+			if (subMeshVertices.size() + newVertexCount > kMaxShortIndexVertexCount)
+				closeSubMesh(i);
+
+			for (uint32_t corner = 0; corner < 3; ++corner)
+			{
+				uint32_t& localIndex = localIndices[indices[i + corner]];
+				if (localIndex == UINT32_MAX)
+				{
+					localIndex = static_cast<uint32_t>(subMeshVertices.size());
+					subMeshVertices.push_back(indices[i + corner]);
+				}
+
+				indices[i + corner] = localIndex;
+			}
+		}
+
+		closeSubMesh(static_cast<uint32_t>(indices.size()));
+
+		vertices.swap(result);
+		return subMeshes;
+	}
+
+	std::vector<uint16_t> ConvertToShortIndices(const std::vector<uint32_t>& indices)
+	{
+		return std::vector<uint16_t>(indices.begin(), indices.end());
+	}
+}
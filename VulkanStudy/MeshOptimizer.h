@@ -0,0 +1,57 @@
+#pragma once
+#include "VkUtils.h"
+
+namespace VkUtils
+{
+	// FIFO post-transform cache size used to optimize and to measure
+	// Smaller than most hardware caches on purpose, an order tuned for 16 entries stays good on bigger ones
+	constexpr uint32_t kVertexCacheSize = 16;
+
+	// Vertices addressable with VK_INDEX_TYPE_UINT16
+	constexpr uint32_t kMaxShortIndexVertexCount = 65536;
+
+	struct VertexCacheStats
+	{
+		float Acmr = 0.0f;			// transformed vertices per triangle, 0.5 is the ideal on a regular grid, 3 is the worst
+		float Atvr = 0.0f;			// transformed vertices per referenced vertex, 1 is the ideal
+	};
+
+	struct MeshOptimizationStats
+	{
+		VertexCacheStats Before;
+		VertexCacheStats After;
+		size_t ClusterCount = 0;
+		float OptimizationTime = 0.0f;		// milliseconds
+	};
+
+	// Simulate a FIFO vertex cache over a triangle list
+	VertexCacheStats AnalyzeVertexCache(const std::vector<uint32_t>& indices, size_t vertexCount, uint32_t cacheSize = kVertexCacheSize);
+
+	// Reorder triangles for vertex cache locality (Tipsify, Sander et al. 2007)
+	// If pClusters isn't nullptr, it receives the first triangle of every cluster : runs of triangles
+	// emitted without jumping to a non adjacent part of the mesh
+	void OptimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount, std::vector<uint32_t>* pClusters = nullptr,
+		uint32_t cacheSize = kVertexCacheSize);
+
+	// Sort clusters from OptimizeVertexCache so outward facing ones come first and occlude the rest
+	// Clusters are split further where it costs less than threshold times their ACMR
+	// Return the number of clusters after splitting
+	size_t OptimizeOverdraw(std::vector<uint32_t>& indices, const std::vector<Vertex>& vertices, const std::vector<uint32_t>& clusters,
+		float threshold = 1.05f, uint32_t cacheSize = kVertexCacheSize);
+
+	// Reorder vertices by first use in the index buffer so vertex fetch walks memory linearly
+	// Vertices which aren't referenced by any triangle are removed
+	void OptimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices);
+
+	// Run the three stages above in order and measure the vertex cache before and after
+	MeshOptimizationStats OptimizeMesh(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices);
+	void PrintMeshOptimizationStats(const char* meshName, const MeshOptimizationStats& stats);
+
+	// Split a mesh so every sub mesh references at most kMaxShortIndexVertexCount vertices
+	// Each sub mesh gets its own vertex range, vertices used by several sub meshes are duplicated
+	// Triangle order is kept, indices become relative to their sub mesh's VertexOffset
+	std::vector<SubMesh> SplitMeshForShortIndices(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices);
+
+	// Indices must all be under kMaxShortIndexVertexCount
+	std::vector<uint16_t> ConvertToShortIndices(const std::vector<uint32_t>& indices);
+}
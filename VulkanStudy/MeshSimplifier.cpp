@@ -0,0 +1,407 @@
+#include "MeshSimplifier.h"
+#include "MeshOptimizer.h"
+
+#include <iostream>
+#include <algorithm>
+#include <numeric>
+#include <cmath>
+
+namespace
+{
+	constexpr uint32_t kMaxSimplifyPasses = 100;
+	// A level is only kept if it has at most this fraction of the previous level's indices
+	constexpr float kMinLodReduction = 0.85f;
+	// Collapses tilting a remaining triangle by more than ~75 degrees fold the surface over, they are rejected
+	constexpr float kMinNormalDot = 0.25f;
+
+	// Sum of squared distances to a set of planes, weighted by triangle area (symmetric 4x4 matrix)
+	struct Quadric
+	{
+		double A00, A01, A02, A03, A11, A12, A13, A22, A23, A33;
+		double Weight;
+	};
+
+	Quadric MakePlaneQuadric(const glm::vec3& normal, float distance, double weight)
+	{
+		double a = normal.x, b = normal.y, c = normal.z, d = distance;
+
+		Quadric q;
+		q.A00 = a * a * weight; q.A01 = a * b * weight; q.A02 = a * c * weight; q.A03 = a * d * weight;
+		q.A11 = b * b * weight; q.A12 = b * c * weight; q.A13 = b * d * weight;
+		q.A22 = c * c * weight; q.A23 = c * d * weight;
+		q.A33 = d * d * weight;
+		q.Weight = weight;
+		return q;
+	}
+
+	void AddQuadric(Quadric& q, const Quadric& other)
+	{
+		q.A00 += other.A00; q.A01 += other.A01; q.A02 += other.A02; q.A03 += other.A03;
+		q.A11 += other.A11; q.A12 += other.A12; q.A13 += other.A13;
+		q.A22 += other.A22; q.A23 += other.A23;
+		q.A33 += other.A33;
+		q.Weight += other.Weight;
+	}
+
+	// Mean squared distance from p to the planes
+	double EvaluateQuadric(const Quadric& q, const glm::vec3& p)
+	{
+		double x = p.x, y = p.y, z = p.z;
+		double result = q.A00 * x * x + 2.0 * q.A01 * x * y + 2.0 * q.A02 * x * z + 2.0 * q.A03 * x
+			+ q.A11 * y * y + 2.0 * q.A12 * y * z + 2.0 * q.A13 * y
+			+ q.A22 * z * z + 2.0 * q.A23 * z
+			+ q.A33;
+
+		return q.Weight > 0.0 ? std::max(result, 0.0) / q.Weight : 0.0;
+	}
+
+	struct Collapse
+	{
+		double Cost;
+		uint32_t From;		// position group removed
+		uint32_t To;		// position group kept
+	};
+}
+
+namespace VkUtils
+{
+	std::vector<uint32_t> SimplifyMesh(const Vertex* vertices, size_t vertexCount, const std::vector<uint32_t>& indices,
+		size_t targetIndexCount, float* pError)
+	{
+		std::vector<uint32_t> result = indices;
+		if (pError)
+			*pError = 0.0f;
+		if (result.size() <= targetIndexCount || vertexCount == 0)
+			return result;
+
+		// Vertices at the same position (UV seams) form one group, collapses move whole groups
+		std::vector<uint32_t> order(vertexCount);
+		std::iota(order.begin(), order.end(), 0);
+		auto lessPosition = [&](uint32_t a, uint32_t b)
+		{
+			const auto& pa = vertices[a].Pos;
+			const auto& pb = vertices[b].Pos;
+			if (pa.x != pb.x) return pa.x < pb.x;
+			if (pa.y != pb.y) return pa.y < pb.y;
+			return pa.z < pb.z;
+		};
+		std::sort(order.begin(), order.end(), lessPosition);
+
+		std::vector<uint32_t> groups(vertexCount);
+		std::vector<uint32_t> groupOffsets;
+		for (size_t i = 0; i < order.size(); ++i)
+		{
+			if (i == 0 || lessPosition(order[i - 1], order[i]))
+				groupOffsets.push_back(static_cast<uint32_t>(i));
+			groups[order[i]] = static_cast<uint32_t>(groupOffsets.size() - 1);
+		}
+		uint32_t groupCount = static_cast<uint32_t>(groupOffsets.size());
+		groupOffsets.push_back(static_cast<uint32_t>(vertexCount));
+		const auto& groupVertices = order;
+
+		auto groupPosition = [&](uint32_t group) -> const glm::vec3& { return vertices[groupVertices[groupOffsets[group]]].Pos; };
+
+		// Edges used by a single triangle are open borders, their ends never move
+		std::vector<uint8_t> isGroupLocked(groupCount, 0);
+		{
+			std::vector<uint64_t> edges;
+			edges.reserve(result.size());
+			for (size_t i = 0; i < result.size(); i += 3)
+			{
+				for (size_t corner = 0; corner < 3; ++corner)
+				{
+					uint64_t a = groups[result[i + corner]];
+					uint64_t b = groups[result[i + (corner + 1) % 3]];
+					if (a != b)
+						edges.push_back(a < b ? a << 32 | b : b << 32 | a);
+				}
+			}
+			std::sort(edges.begin(), edges.end());
+
+			for (size_t i = 0; i < edges.size();)
+			{
+				size_t end = i + 1;
+				while (end < edges.size() && edges[end] == edges[i])
+					++end;
+
+				if (end - i == 1)
+				{
+					isGroupLocked[edges[i] >> 32] = 1;
+					isGroupLocked[edges[i] & 0xFFFFFFFF] = 1;
+				}
+				i = end;
+			}
+		}
+
+		std::vector<Quadric> quadrics(groupCount, Quadric{});
+		for (size_t i = 0; i < result.size(); i += 3)
+		{
+			const auto& p0 = vertices[result[i + 0]].Pos;
+			const auto& p1 = vertices[result[i + 1]].Pos;
+			const auto& p2 = vertices[result[i + 2]].Pos;
+
+			glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+			float area = glm::length(normal);
+			if (area == 0.0f)
+				continue;
+
+			normal /= area;
+			auto quadric = MakePlaneQuadric(normal, -glm::dot(normal, p0), area);
+			for (size_t corner = 0; corner < 3; ++corner)
+				AddQuadric(quadrics[groups[result[i + corner]]], quadric);
+		}
+
+		std::vector<uint32_t> remap(vertexCount);
+		std::iota(remap.begin(), remap.end(), 0);
+
+		std::vector<uint32_t> adjacencyOffsets(vertexCount + 1);
+		std::vector<uint32_t> adjacencyTriangles;
+		std::vector<Collapse> collapses;
+		std::vector<uint8_t> isGroupTouched(groupCount);
+		std::vector<uint32_t> partners;
+		double maxCost = 0.0;
+
+		for (uint32_t pass = 0; pass < kMaxSimplifyPasses && result.size() > targetIndexCount; ++pass)
+		{
+			// Vertex to triangles adjacency of the current triangles
+			std::fill(adjacencyOffsets.begin(), adjacencyOffsets.end(), 0);
+			for (auto index : result)
+				++adjacencyOffsets[index + 1];
+			std::partial_sum(adjacencyOffsets.begin(), adjacencyOffsets.end(), adjacencyOffsets.begin());
+
+			adjacencyTriangles.resize(result.size());
+			std::vector<uint32_t> cursors(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+			for (size_t i = 0; i < result.size(); ++i)
+				adjacencyTriangles[cursors[result[i]]++] = static_cast<uint32_t>(i / 3);
+
+			// Every edge can collapse both ways, cheapest first
+			collapses.clear();
+			for (size_t i = 0; i < result.size(); i += 3)
+			{
+				for (size_t corner = 0; corner < 3; ++corner)
+				{
+					uint32_t a = groups[result[i + corner]];
+					uint32_t b = groups[result[i + (corner + 1) % 3]];
+					if (a == b)
+						continue;
+
+					if (!isGroupLocked[a])
+						collapses.push_back({ EvaluateQuadric(quadrics[a], groupPosition(b)), a, b });
+					if (!isGroupLocked[b])
+						collapses.push_back({ EvaluateQuadric(quadrics[b], groupPosition(a)), b, a });
+				}
+			}
+
+			std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) { return a.Cost < b.Cost; });
+
+			// Apply independent collapses : a group whose one ring changed this pass waits for the next one
+			std::fill(isGroupTouched.begin(), isGroupTouched.end(), 0);
+			size_t triangleCount = result.size() / 3;
+			size_t targetTriangleCount = targetIndexCount / 3;
+			size_t appliedCount = 0;
+
+			for (const auto& collapse : collapses)
+			{
+				if (triangleCount <= targetTriangleCount)
+					break;
+				if (isGroupTouched[collapse.From] || isGroupTouched[collapse.To])
+					continue;
+
+				// Every vertex of the removed group must have exactly one vertex of the kept group as neighbour,
+				// that is where it goes. It fails for collapses across a UV seam, which would tear the texture.
+				bool isValid = true;
+				partners.clear();
+				for (uint32_t i = groupOffsets[collapse.From]; i < groupOffsets[collapse.From + 1] && isValid; ++i)
+				{
+					uint32_t vertex = groupVertices[i];
+					uint32_t partner = UINT32_MAX;
+					for (uint32_t j = adjacencyOffsets[vertex]; j < adjacencyOffsets[vertex + 1]; ++j)
+					{
+						const uint32_t* triangle = &result[adjacencyTriangles[j] * 3];
+						for (uint32_t corner = 0; corner < 3; ++corner)
+						{
+							if (groups[triangle[corner]] != collapse.To)
+								continue;
+							if (partner != UINT32_MAX && partner != triangle[corner])
+								isValid = false;
+							partner = triangle[corner];
+						}
+					}
+
+					// Vertices without triangles left don't need a partner
+					if (partner == UINT32_MAX && adjacencyOffsets[vertex + 1] > adjacencyOffsets[vertex])
+						isValid = false;
+					partners.push_back(partner);
+				}
+
+				// Remaining triangles must not flip or collapse to a line when the group moves
+				const auto& newPosition = groupPosition(collapse.To);
+				size_t removedTriangles = 0;
+				for (uint32_t i = groupOffsets[collapse.From]; i < groupOffsets[collapse.From + 1] && isValid; ++i)
+				{
+					uint32_t vertex = groupVertices[i];
+					for (uint32_t j = adjacencyOffsets[vertex]; j < adjacencyOffsets[vertex + 1] && isValid; ++j)
+					{
+						const uint32_t* triangle = &result[adjacencyTriangles[j] * 3];
+						if (groups[triangle[0]] == collapse.To || groups[triangle[1]] == collapse.To || groups[triangle[2]] == collapse.To)
+						{
+							++removedTriangles;
+							continue;
+						}
+
+						glm::vec3 p[3] = { vertices[triangle[0]].Pos, vertices[triangle[1]].Pos, vertices[triangle[2]].Pos };
+						glm::vec3 oldNormal = glm::cross(p[1] - p[0], p[2] - p[0]);
+						for (uint32_t corner = 0; corner < 3; ++corner)
+						{
+							if (triangle[corner] == vertex)
+								p[corner] = newPosition;
+						}
+						glm::vec3 newNormal = glm::cross(p[1] - p[0], p[2] - p[0]);
+
+						float newLength = glm::length(newNormal);
+						if (newLength == 0.0f || glm::dot(oldNormal, newNormal) < kMinNormalDot * glm::length(oldNormal) * newLength)
+							isValid = false;
+					}
+				}
+
+				if (!isValid)
+					continue;
+
+				for (uint32_t i = groupOffsets[collapse.From]; i < groupOffsets[collapse.From + 1]; ++i)
+				{
+					uint32_t vertex = groupVertices[i];
+					uint32_t partner = partners[i - groupOffsets[collapse.From]];
+					if (partner != UINT32_MAX)
+						remap[vertex] = partner;
+
+					for (uint32_t j = adjacencyOffsets[vertex]; j < adjacencyOffsets[vertex + 1]; ++j)
+					{
+						const uint32_t* triangle = &result[adjacencyTriangles[j] * 3];
+						for (uint32_t corner = 0; corner < 3; ++corner)
+							isGroupTouched[groups[triangle[corner]]] = 1;
+					}
+				}
+
+				AddQuadric(quadrics[collapse.To], quadrics[collapse.From]);
+				maxCost = std::max(maxCost, collapse.Cost);
+				triangleCount -= std::min(triangleCount, removedTriangles);
+				++appliedCount;
+			}
+
+			if (appliedCount == 0)
+				break;
+
+			// Remap and drop triangles which lost an edge
+			size_t writeIndex = 0;
+			for (size_t i = 0; i < result.size(); i += 3)
+			{
+				uint32_t a = remap[result[i + 0]];
+				uint32_t b = remap[result[i + 1]];
+				uint32_t c = remap[result[i + 2]];
+				if (a == b || b == c || c == a)
+					continue;
+
+				result[writeIndex++] = a;
+				result[writeIndex++] = b;
+				result[writeIndex++] = c;
+			}
+			result.resize(writeIndex);
+		}
+
+		if (pError)
+			*pError = static_cast<float>(std::sqrt(maxCost));
+		return result;
+	}
+
+	std::vector<MeshLod> BuildLodChain(const std::vector<Vertex>& vertices, std::vector<uint32_t>& indices,
+		std::vector<SubMesh>& subMeshes, const std::vector<float>& lodRatios)
+	{
+		std::vector<MeshLod> lods;
+		uint32_t baseSubMeshCount = static_cast<uint32_t>(subMeshes.size());
+
+		MeshLod baseLod{ 0, baseSubMeshCount, 0.0f, 0 };
+		std::vector<std::vector<uint32_t>> levelIndices(baseSubMeshCount);
+		std::vector<size_t> subMeshVertexCounts(baseSubMeshCount, 0);
+		for (uint32_t i = 0; i < baseSubMeshCount; ++i)
+		{
+			const auto& subMesh = subMeshes[i];
+			auto begin = indices.begin() + subMesh.FirstIndex;
+			levelIndices[i].assign(begin, begin + subMesh.IndexCount);
+			if (subMesh.IndexCount > 0)
+				subMeshVertexCounts[i] = *std::max_element(begin, begin + subMesh.IndexCount) + 1;
+			baseLod.IndexCount += subMesh.IndexCount;
+		}
+		lods.push_back(baseLod);
+
+		for (auto ratio : lodRatios)
+		{
+			const auto& previousLod = lods.back();
+			MeshLod lod{ static_cast<uint32_t>(subMeshes.size()), baseSubMeshCount, previousLod.Error, 0 };
+
+			std::vector<std::vector<uint32_t>> simplifiedIndices(baseSubMeshCount);
+			for (uint32_t i = 0; i < baseSubMeshCount; ++i)
+			{
+				size_t targetIndexCount = static_cast<size_t>(subMeshes[i].IndexCount * ratio) / 3 * 3;
+				const Vertex* subMeshVertices = vertices.data() + subMeshes[i].VertexOffset;
+
+				float error = 0.0f;
+				simplifiedIndices[i] = SimplifyMesh(subMeshVertices, subMeshVertexCounts[i], levelIndices[i], targetIndexCount, &error);
+				OptimizeVertexCache(simplifiedIndices[i], subMeshVertexCounts[i]);
+
+				// Errors of successive levels add up, each one is measured against the previous level
+				lod.Error = std::max(lod.Error, previousLod.Error + error);
+				lod.IndexCount += static_cast<uint32_t>(simplifiedIndices[i].size());
+			}
+
+			if (lod.IndexCount > previousLod.IndexCount * kMinLodReduction)
+				break;
+
+			for (uint32_t i = 0; i < baseSubMeshCount; ++i)
+			{
+				subMeshes.push_back({ static_cast<uint32_t>(indices.size()), static_cast<uint32_t>(simplifiedIndices[i].size()),
+					subMeshes[i].VertexOffset });
+				indices.insert(indices.end(), simplifiedIndices[i].begin(), simplifiedIndices[i].end());
+			}
+
+			lods.push_back(lod);
+			levelIndices.swap(simplifiedIndices);
+		}
+
+		return lods;
+	}
+
+	void PrintLodChain(const char* meshName, const std::vector<MeshLod>& lods)
+	{
+		std::cout << "\nLOD CHAIN : " << meshName << ", " << lods.size() << " levels\n";
+		for (size_t i = 0; i < lods.size(); ++i)
+		{
+			const auto& lod = lods[i];
+			std::cout << "\tLOD " << i << " : " << lod.IndexCount / 3 << " triangles ("
+				<< (lods[0].IndexCount > 0 ? 100.0f * lod.IndexCount / lods[0].IndexCount : 0.0f) << "%), error " << lod.Error
+				<< ", " << lod.SubMeshCount << " sub meshes\n";
+		}
+	}
+
+	BoundingSphere ComputeBoundingSphere(const std::vector<Vertex>& vertices)
+	{
+		BoundingSphere sphere{ glm::vec3(0.0f), 0.0f };
+		if (vertices.empty())
+			return sphere;
+
+		glm::vec3 boundsMin = vertices[0].Pos;
+		glm::vec3 boundsMax = vertices[0].Pos;
+		for (const auto& vertex : vertices)
+		{
+			for (int axis = 0; axis < 3; ++axis)
+			{
+				boundsMin[axis] = std::min(boundsMin[axis], vertex.Pos[axis]);
+				boundsMax[axis] = std::max(boundsMax[axis], vertex.Pos[axis]);
+			}
+		}
+
+		sphere.Center = (boundsMin + boundsMax) * 0.5f;
+		for (const auto& vertex : vertices)
+			sphere.Radius = std::max(sphere.Radius, glm::length(vertex.Pos - sphere.Center));
+		return sphere;
+	}
+}
@@ -0,0 +1,26 @@
+#pragma once
+#include "VkUtils.h"
+
+namespace VkUtils
+{
+	// Triangle ratio of every generated level, relative to the full mesh
+	const std::vector<float> DEFAULT_LOD_RATIOS = { 0.5f, 0.25f, 0.125f };
+
+	// Collapse edges in order of quadric error (Garland & Heckbert 1997) until indices drop to targetIndexCount
+	// or nothing more can collapse. Vertices are never moved or added, the result indexes the same vertices.
+	// Open borders are locked, UV seams only collapse along themselves so the texture doesn't tear.
+	// pError receives the largest error introduced, as an object space distance
+	std::vector<uint32_t> SimplifyMesh(const Vertex* vertices, size_t vertexCount, const std::vector<uint32_t>& indices,
+		size_t targetIndexCount, float* pError = nullptr);
+
+	// Append one simplified copy of every LOD 0 sub mesh per entry of lodRatios, to indices and subMeshes
+	// Levels are simplified from the previous one and stop early when a level can't get meaningfully smaller
+	// Return every level, LOD 0 being the sub meshes already there
+	std::vector<MeshLod> BuildLodChain(const std::vector<Vertex>& vertices, std::vector<uint32_t>& indices,
+		std::vector<SubMesh>& subMeshes, const std::vector<float>& lodRatios = DEFAULT_LOD_RATIOS);
+
+	void PrintLodChain(const char* meshName, const std::vector<MeshLod>& lods);
+
+	// Bounding sphere of the whole mesh (center of its bounding box)
+	BoundingSphere ComputeBoundingSphere(const std::vector<Vertex>& vertices);
+}
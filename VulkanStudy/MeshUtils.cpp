@@ -0,0 +1,83 @@
+#include "MeshUtils.h"
+
+namespace
+{
+	constexpr size_t kMinSlotCount = 16;
+
+	size_t NextPowerOfTwo(size_t value)
+	{
+		size_t result = 1;
+		while (result < value)
+			result <<= 1;
+		return result;
+	}
+
+	// Mix the three attribute indices so neighbouring corners spread over the whole table
+	size_t HashVertexKey(const VkUtils::VertexKey& key)
+	{
+		uint64_t hash = static_cast<uint32_t>(key.Position);
+		hash = hash * 0x9E3779B97F4A7C15ull ^ static_cast<uint32_t>(key.TexCoord);
+		hash = hash * 0x9E3779B97F4A7C15ull ^ static_cast<uint32_t>(key.Normal);
+		hash ^= hash >> 31;
+		hash *= 0xBF58476D1CE4E5B9ull;
+		hash ^= hash >> 29;
+		return static_cast<size_t>(hash);
+	}
+}
+
+namespace VkUtils
+{
+	VertexIndexMap::VertexIndexMap(size_t expectedCount):
+		m_mask(0), m_size(0)
+	{
+		// Keep load factor under 50% so probe sequences stay short
+		size_t slotCount = NextPowerOfTwo(expectedCount * 2);
+		if (slotCount < kMinSlotCount)
+			slotCount = kMinSlotCount;
+
+		m_slots.resize(slotCount, Slot{ {}, UINT32_MAX });
+		m_mask = slotCount - 1;
+	}
+
+	uint32_t VertexIndexMap::FindOrInsert(const VertexKey& key, uint32_t newIndex)
+	{
+		if ((m_size + 1) * 4 > m_slots.size() * 3)
+			Grow();
+
+		size_t slot = HashVertexKey(key) & m_mask;
+		while (true)
+		{
+			auto& entry = m_slots[slot];
+			if (entry.Index == UINT32_MAX)
+			{
+				entry.Key = key;
+				entry.Index = newIndex;
+				++m_size;
+				return newIndex;
+			}
+
+			if (entry.Key == key)
+				return entry.Index;
+
+			slot = (slot + 1) & m_mask;
+		}
+	}
+
+	void VertexIndexMap::Grow()
+	{
+		std::vector<Slot> oldSlots(m_slots.size() * 2, Slot{ {}, UINT32_MAX });
+		oldSlots.swap(m_slots);
+		m_mask = m_slots.size() - 1;
+
+		for (const auto& entry : oldSlots)
+		{
+			if (entry.Index == UINT32_MAX)
+				continue;
+
+			size_t slot = HashVertexKey(entry.Key) & m_mask;
+			while (m_slots[slot].Index != UINT32_MAX)
+				slot = (slot + 1) & m_mask;
+			m_slots[slot] = entry;
+		}
+	}
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace VkUtils
+{
+	// Identify one OBJ face corner by its attribute indices
+	// Negative value means the corner doesn't reference that attribute
+	struct VertexKey
+	{
+		int32_t Position;
+		int32_t TexCoord;
+		int32_t Normal;
+
+		bool operator==(const VertexKey& other) const
+		{
+			return Position == other.Position && TexCoord == other.TexCoord && Normal == other.Normal;
+		}
+	};
+
+	// Open addressing hash map (linear probing) from VertexKey to vertex index
+	// Used to weld face corners that share all attribute indices into one vertex
+	class VertexIndexMap
+	{
+	public:
+		// expectedCount : upper bound of keys that will be inserted, the map grows if it is exceeded
+		explicit VertexIndexMap(size_t expectedCount);
+
+		// If key already exists, return its stored index
+		// Else insert key with newIndex and return newIndex
+		uint32_t FindOrInsert(const VertexKey& key, uint32_t newIndex);
+
+		size_t Size() const { return m_size; }
+	private:
+		struct Slot
+		{
+			VertexKey Key;
+			uint32_t Index;			// UINT32_MAX marks an empty slot
+		};
+
+		void Grow();
+
+		std::vector<Slot> m_slots;
+		size_t m_mask;
+		size_t m_size;
+	};
+}
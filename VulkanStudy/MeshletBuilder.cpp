@@ -0,0 +1,212 @@
+#include "MeshletBuilder.h"
+
+#include <iostream>
+#include <algorithm>
+#include <numeric>
+
+namespace
+{
+	// Narrower cones than this are worth testing, wider ones are almost never back facing
+	constexpr float kMinConeDot = 0.1f;
+
+	// Bounding sphere and normal cone of the triangles of one meshlet
+	void ComputeMeshletBounds(const VkUtils::Vertex* vertices, const uint32_t* indices, VkUtils::Meshlet& meshlet)
+	{
+		glm::vec3 boundsMin = vertices[indices[0]].Pos;
+		glm::vec3 boundsMax = boundsMin;
+		glm::vec3 normalSum(0.0f);
+
+		std::vector<glm::vec3> normals;
+		normals.reserve(meshlet.IndexCount / 3);
+
+		for (uint32_t i = 0; i < meshlet.IndexCount; i += 3)
+		{
+			const auto& p0 = vertices[indices[i + 0]].Pos;
+			const auto& p1 = vertices[indices[i + 1]].Pos;
+			const auto& p2 = vertices[indices[i + 2]].Pos;
+
+			for (const auto* p : { &p0, &p1, &p2 })
+			{
+				for (int axis = 0; axis < 3; ++axis)
+				{
+					boundsMin[axis] = std::min(boundsMin[axis], (*p)[axis]);
+					boundsMax[axis] = std::max(boundsMax[axis], (*p)[axis]);
+				}
+			}
+
+			// Degenerate triangles don't face anywhere
+			glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+			float length = glm::length(normal);
+			if (length > 0.0f)
+			{
+				normals.push_back(normal / length);
+				normalSum += normal / length;
+			}
+		}
+
+		meshlet.Center = (boundsMin + boundsMax) * 0.5f;
+		meshlet.Radius = 0.0f;
+		for (uint32_t i = 0; i < meshlet.IndexCount; ++i)
+			meshlet.Radius = std::max(meshlet.Radius, glm::length(vertices[indices[i]].Pos - meshlet.Center));
+
+		float normalSumLength = glm::length(normalSum);
+		meshlet.ConeAxis = normalSumLength > 0.0f ? normalSum / normalSumLength : glm::vec3(0.0f, 0.0f, 1.0f);
+
+		float minDot = normalSumLength > 0.0f ? 1.0f : -1.0f;
+		for (const auto& normal : normals)
+			minDot = std::min(minDot, glm::dot(normal, meshlet.ConeAxis));
+
+		// Back facing cone is the normal cone widened by 90 degrees and flipped : its cutoff is sin(angle) = sqrt(1 - cos(angle)^2)
+		meshlet.ConeCutoff = minDot > kMinConeDot ? std::sqrt(1.0f - minDot * minDot) : 1.0f;
+	}
+}
+
+namespace VkUtils
+{
+	std::vector<Meshlet> BuildMeshlets(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices,
+		const std::vector<SubMesh>& subMeshes, std::vector<uint32_t>& meshletIndices, MeshletStats* pStats)
+	{
+		std::vector<Meshlet> meshlets;
+		meshletIndices.clear();
+		meshletIndices.reserve(indices.size());
+
+		for (const auto& subMesh : subMeshes)
+		{
+			const uint32_t* subMeshIndices = indices.data() + subMesh.FirstIndex;
+			uint32_t triangleCount = subMesh.IndexCount / 3;
+			if (triangleCount == 0)
+				continue;
+
+			uint32_t vertexCount = *std::max_element(subMeshIndices, subMeshIndices + subMesh.IndexCount) + 1;
+
+			// Local vertex to triangles adjacency
+			std::vector<uint32_t> adjacencyOffsets(vertexCount + 1, 0);
+			std::vector<uint32_t> adjacencyTriangles(subMesh.IndexCount);
+			for (uint32_t i = 0; i < subMesh.IndexCount; ++i)
+				++adjacencyOffsets[subMeshIndices[i] + 1];
+			std::partial_sum(adjacencyOffsets.begin(), adjacencyOffsets.end(), adjacencyOffsets.begin());
+
+			std::vector<uint32_t> cursors(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+			for (uint32_t i = 0; i < subMesh.IndexCount; ++i)
+				adjacencyTriangles[cursors[subMeshIndices[i]]++] = i / 3;
+
+			std::vector<uint8_t> isTriangleUsed(triangleCount, 0);
+			// Meshlet a vertex was last added to, so membership checks don't need clearing between meshlets
+			std::vector<uint32_t> vertexMeshlet(vertexCount, UINT32_MAX);
+			std::vector<uint32_t> meshletVertices;
+			std::vector<uint32_t> meshletTriangles;
+			uint32_t seedCursor = 0;
+
+			auto countNewVertices = [&](uint32_t triangle, uint32_t meshletIndex)
+			{
+				uint32_t count = 0;
+				for (uint32_t corner = 0; corner < 3; ++corner)
+					count += vertexMeshlet[subMeshIndices[triangle * 3 + corner]] != meshletIndex ? 1 : 0;
+				return count;
+			};
+
+			while (true)
+			{
+				while (seedCursor < triangleCount && isTriangleUsed[seedCursor])
+					++seedCursor;
+				if (seedCursor == triangleCount)
+					break;
+
+				uint32_t meshletIndex = static_cast<uint32_t>(meshlets.size());
+				meshletVertices.clear();
+				meshletTriangles.clear();
+
+				uint32_t triangle = seedCursor;
+				while (triangle != UINT32_MAX)
+				{
+					isTriangleUsed[triangle] = 1;
+					meshletTriangles.push_back(triangle);
+					for (uint32_t corner = 0; corner < 3; ++corner)
+					{
+						uint32_t vertex = subMeshIndices[triangle * 3 + corner];
+						if (vertexMeshlet[vertex] != meshletIndex)
+						{
+							vertexMeshlet[vertex] = meshletIndex;
+							meshletVertices.push_back(vertex);
+						}
+					}
+
+					if (meshletTriangles.size() == kMaxMeshletTriangles)
+						break;
+
+					// Best neighbour : fewest new vertices, then earliest in cache order
+					triangle = UINT32_MAX;
+					uint32_t bestNewVertices = UINT32_MAX;
+					for (auto vertex : meshletVertices)
+					{
+						for (uint32_t i = adjacencyOffsets[vertex]; i < adjacencyOffsets[vertex + 1]; ++i)
+						{
+							uint32_t candidate = adjacencyTriangles[i];
+							if (isTriangleUsed[candidate])
+								continue;
+
+							uint32_t newVertices = countNewVertices(candidate, meshletIndex);
+							if (meshletVertices.size() + newVertices > kMaxMeshletVertices)
+								continue;
+
+							if (newVertices < bestNewVertices || (newVertices == bestNewVertices && candidate < triangle))
+							{
+								bestNewVertices = newVertices;
+								triangle = candidate;
+							}
+						}
+					}
+				}
+
+				// Original order inside a meshlet is the vertex cache optimized one
+				std::sort(meshletTriangles.begin(), meshletTriangles.end());
+
+				Meshlet meshlet{};
+				meshlet.FirstIndex = static_cast<uint32_t>(meshletIndices.size());
+				meshlet.IndexCount = static_cast<uint32_t>(meshletTriangles.size() * 3);
+				meshlet.VertexOffset = subMesh.VertexOffset;
+				meshlet.VertexCount = static_cast<uint32_t>(meshletVertices.size());
+
+				for (auto meshletTriangle : meshletTriangles)
+					meshletIndices.insert(meshletIndices.end(), subMeshIndices + meshletTriangle * 3, subMeshIndices + meshletTriangle * 3 + 3);
+
+				ComputeMeshletBounds(vertices.data() + subMesh.VertexOffset, meshletIndices.data() + meshlet.FirstIndex, meshlet);
+				meshlets.push_back(meshlet);
+			}
+		}
+
+		if (pStats)
+		{
+			size_t vertexTotal = 0;
+			size_t triangleTotal = 0;
+			size_t coneCullableCount = 0;
+			for (const auto& meshlet : meshlets)
+			{
+				vertexTotal += meshlet.VertexCount;
+				triangleTotal += meshlet.IndexCount / 3;
+				coneCullableCount += meshlet.ConeCutoff < 1.0f ? 1 : 0;
+			}
+
+			pStats->MeshletCount = meshlets.size();
+			pStats->VertexFill = meshlets.empty() ? 0.0f : static_cast<float>(vertexTotal) / (meshlets.size() * kMaxMeshletVertices);
+			pStats->TriangleFill = meshlets.empty() ? 0.0f : static_cast<float>(triangleTotal) / (meshlets.size() * kMaxMeshletTriangles);
+			pStats->ConeCullableCount = coneCullableCount;
+		}
+
+		return meshlets;
+	}
+
+	bool IsMeshletBackFacing(const Meshlet& meshlet, const glm::vec3& cameraPosition)
+	{
+		glm::vec3 direction = meshlet.Center - cameraPosition;
+		return glm::dot(direction, meshlet.ConeAxis) >= meshlet.ConeCutoff * glm::length(direction) + meshlet.Radius;
+	}
+
+	void PrintMeshletStats(const char* meshName, const MeshletStats& stats)
+	{
+		std::cout << "\nMESHLETS BUILT : " << meshName << ", " << stats.MeshletCount << " meshlets\n";
+		std::cout << "\tVertex fill : " << stats.VertexFill * 100.0f << "% of " << kMaxMeshletVertices << "\n";
+		std::cout << "\tTriangle fill : " << stats.TriangleFill * 100.0f << "% of " << kMaxMeshletTriangles << "\n";
+		std::cout << "\tCone cullable : " << stats.ConeCullableCount << " meshlets\n";
+	}
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include "VkUtils.h"
+
+namespace VkUtils
+{
+	// Meshlet size limits, small enough for a culling thread group to handle one meshlet
+	constexpr uint32_t kMaxMeshletVertices = 64;
+	constexpr uint32_t kMaxMeshletTriangles = 124;
+
+	// Cluster of triangles stored as a contiguous range of the meshlet index buffer, with what culling needs to reject it
+	// Laid out as two vec4 + four uint so it can be read as is from a std430 storage buffer
+	struct Meshlet
+	{
+		glm::vec3 Center;			// bounding sphere
+		float Radius;
+		glm::vec3 ConeAxis;			// average facing direction of its triangles
+		float ConeCutoff;			// sine of the normal cone half angle, 1 when the cone can never be back facing
+		uint32_t FirstIndex;
+		uint32_t IndexCount;
+		int32_t VertexOffset;		// of the sub mesh it belongs to
+		uint32_t VertexCount;
+	};
+
+	struct MeshletStats
+	{
+		size_t MeshletCount = 0;
+		float VertexFill = 0.0f;			// average vertex count / kMaxMeshletVertices
+		float TriangleFill = 0.0f;			// average triangle count / kMaxMeshletTriangles
+		size_t ConeCullableCount = 0;		// meshlets with a narrow enough normal cone to be back face culled
+	};
+
+	// Partition every sub mesh into meshlets, their triangles are copied to meshletIndices so each meshlet is one index range
+	// The draw index buffer isn't touched, its vertex cache and overdraw order is kept
+	// Triangles are grown from a seed through shared vertices, keeping the ones adding fewest new vertices first
+	std::vector<Meshlet> BuildMeshlets(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices,
+		const std::vector<SubMesh>& subMeshes, std::vector<uint32_t>& meshletIndices, MeshletStats* pStats = nullptr);
+
+	// Whole meshlet faces away from a camera at cameraPosition (model space)
+	bool IsMeshletBackFacing(const Meshlet& meshlet, const glm::vec3& cameraPosition);
+
+	void PrintMeshletStats(const char* meshName, const MeshletStats& stats);
+}
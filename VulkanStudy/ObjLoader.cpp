@@ -0,0 +1,477 @@
+#include "ObjLoader.h"
+
+#include <algorithm>
+#include <thread>
+#include <cmath>
+#include <stdexcept>
+
+#include "MeshUtils.h"
+#include "AssetPackage.h"
+
+namespace
+{
+	// Files are never split finer than this per thread, thread start up would cost more than parsing
+	constexpr size_t kMinChunkSize = 1 << 20;
+
+	constexpr double kPowersOfTen[] = {
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+	};
+	constexpr int kMaxTablePower = 22;
+	constexpr int kMaxMantissaDigits = 19;
+
+	// Bits of RelativeIndex::Mask, tell which attributes of a corner were negative (relative) in the file
+	constexpr uint8_t kRelativePosition = 1 << 0;
+	constexpr uint8_t kRelativeTexCoord = 1 << 1;
+	constexpr uint8_t kRelativeNormal = 1 << 2;
+
+	// Negative OBJ indices count backward from the current element count
+	// They are resolved against the chunk first and shifted by the chunk's global offsets after all chunks are parsed
+	struct RelativeIndex
+	{
+		size_t Corner;
+		uint8_t Mask;
+	};
+
+	struct FaceCorner
+	{
+		VkUtils::VertexKey Key;
+		uint8_t RelativeMask;
+	};
+
+	struct ObjChunk
+	{
+		const char* Begin;
+		const char* End;
+
+		std::vector<float> Positions;		// xyz per position
+		std::vector<float> TexCoords;		// uv per texture coordinate
+		size_t NormalCount = 0;				// normals are only referenced by the weld key
+		std::vector<VkUtils::VertexKey> Corners;
+		std::vector<RelativeIndex> RelativeIndices;
+		// A relative texture coordinate index pointed before the first one, it would be taken for a missing one
+		bool HasTexCoordOutOfRange = false;
+
+		// Global offsets, filled after every chunk is parsed
+		size_t BasePosition = 0;
+		size_t BaseTexCoord = 0;
+		size_t BaseNormal = 0;
+		size_t BaseCorner = 0;
+	};
+
+	inline bool IsSpace(char c)
+	{
+		return c == ' ' || c == '\t';
+	}
+
+	inline bool IsDigit(char c)
+	{
+		return static_cast<unsigned>(c - '0') < 10;
+	}
+
+	inline const char* SkipSpaces(const char* p, const char* end)
+	{
+		while (p < end && IsSpace(*p))
+			++p;
+		return p;
+	}
+
+	// Return pointer to the first character of the next line
+	inline const char* SkipLine(const char* p, const char* end)
+	{
+		while (p < end && *p != '\n')
+			++p;
+		return p < end ? p + 1 : end;
+	}
+
+	// from_chars style float parsing : [sign] digits [. digits] [(e|E) [sign] digits]
+	// Doesn't allocate or touch locale, return pointer past the last consumed character
+	const char* ParseFloat(const char* p, const char* end, float& value)
+	{
+		bool negative = false;
+		if (p < end && (*p == '-' || *p == '+'))
+		{
+			negative = *p == '-';
+			++p;
+		}
+
+		uint64_t mantissa = 0;
+		int digits = 0;
+		int exponent = 0;
+
+		while (p < end && IsDigit(*p))
+		{
+			if (digits < kMaxMantissaDigits)
+			{
+				mantissa = mantissa * 10 + (*p - '0');
+				if (mantissa != 0) ++digits;
+			}
+			else
+				++exponent;
+			++p;
+		}
+
+		if (p < end && *p == '.')
+		{
+			++p;
+			while (p < end && IsDigit(*p))
+			{
+				if (digits < kMaxMantissaDigits)
+				{
+					mantissa = mantissa * 10 + (*p - '0');
+					if (mantissa != 0) ++digits;
+					--exponent;
+				}
+				++p;
+			}
+		}
+
+		if (p < end && (*p == 'e' || *p == 'E'))
+		{
+			++p;
+			bool negativeExponent = false;
+			if (p < end && (*p == '-' || *p == '+'))
+			{
+				negativeExponent = *p == '-';
+				++p;
+			}
+
+			int explicitExponent = 0;
+			while (p < end && IsDigit(*p))
+			{
+				if (explicitExponent < 10000)
+					explicitExponent = explicitExponent * 10 + (*p - '0');
+				++p;
+			}
+			exponent += negativeExponent ? -explicitExponent : explicitExponent;
+		}
+
+		double result = static_cast<double>(mantissa);
+		if (exponent < 0)
+			result /= -exponent <= kMaxTablePower ? kPowersOfTen[-exponent] : std::pow(10.0, -exponent);
+		else if (exponent > 0)
+			result *= exponent <= kMaxTablePower ? kPowersOfTen[exponent] : std::pow(10.0, exponent);
+
+		value = static_cast<float>(negative ? -result : result);
+		return p;
+	}
+
+	const char* ParseInt(const char* p, const char* end, int32_t& value)
+	{
+		bool negative = false;
+		if (p < end && (*p == '-' || *p == '+'))
+		{
+			negative = *p == '-';
+			++p;
+		}
+
+		int64_t result = 0;
+		while (p < end && IsDigit(*p))
+		{
+			if (result < INT32_MAX)
+				result = result * 10 + (*p - '0');
+			++p;
+		}
+
+		value = static_cast<int32_t>(negative ? -result : result);
+		return p;
+	}
+
+	// OBJ indices are 1-based, 0 means the attribute isn't present
+	int32_t ResolveIndex(int32_t rawIndex, size_t localCount, uint8_t relativeBit, uint8_t& relativeMask)
+	{
+		if (rawIndex > 0)
+			return rawIndex - 1;
+
+		if (rawIndex < 0)
+		{
+			relativeMask |= relativeBit;
+			return static_cast<int32_t>(localCount) + rawIndex;
+		}
+
+		return -1;
+	}
+
+	// Parse "v", "v/vt", "v//vn" or "v/vt/vn"
+	const char* ParseFaceCorner(const char* p, const char* end, const ObjChunk& chunk, FaceCorner& corner)
+	{
+		int32_t rawIndices[3] = { 0, 0, 0 };
+
+		p = ParseInt(p, end, rawIndices[0]);
+		if (p < end && *p == '/')
+		{
+			++p;
+			if (p < end && *p != '/')
+				p = ParseInt(p, end, rawIndices[1]);
+			if (p < end && *p == '/')
+			{
+				++p;
+				p = ParseInt(p, end, rawIndices[2]);
+			}
+		}
+
+		corner.RelativeMask = 0;
+		corner.Key.Position = ResolveIndex(rawIndices[0], chunk.Positions.size() / 3, kRelativePosition, corner.RelativeMask);
+		corner.Key.TexCoord = ResolveIndex(rawIndices[1], chunk.TexCoords.size() / 2, kRelativeTexCoord, corner.RelativeMask);
+		corner.Key.Normal = ResolveIndex(rawIndices[2], chunk.NormalCount, kRelativeNormal, corner.RelativeMask);
+		return p;
+	}
+
+	void EmitCorner(ObjChunk& chunk, const FaceCorner& corner)
+	{
+		if (corner.RelativeMask)
+			chunk.RelativeIndices.push_back({ chunk.Corners.size(), corner.RelativeMask });
+		chunk.Corners.push_back(corner.Key);
+	}
+
+	void ParseChunk(ObjChunk& chunk)
+	{
+		std::vector<FaceCorner> face;
+		const char* p = chunk.Begin;
+		const char* end = chunk.End;
+
+		while (p < end)
+		{
+			p = SkipSpaces(p, end);
+			if (end - p < 2)
+				break;
+
+			if (p[0] == 'v' && IsSpace(p[1]))
+			{
+				p += 2;
+				for (int i = 0; i < 3; ++i)
+				{
+					float value = 0.0f;
+					p = ParseFloat(SkipSpaces(p, end), end, value);
+					chunk.Positions.push_back(value);
+				}
+			}
+			else if (p[0] == 'v' && p[1] == 't')
+			{
+				p += 2;
+				for (int i = 0; i < 2; ++i)
+				{
+					float value = 0.0f;
+					p = ParseFloat(SkipSpaces(p, end), end, value);
+					chunk.TexCoords.push_back(value);
+				}
+			}
+			else if (p[0] == 'v' && p[1] == 'n')
+			{
+				++chunk.NormalCount;
+			}
+			else if (p[0] == 'f' && IsSpace(p[1]))
+			{
+				p += 2;
+				face.clear();
+				while (true)
+				{
+					p = SkipSpaces(p, end);
+					if (p >= end || !(IsDigit(*p) || *p == '-'))
+						break;
+
+					FaceCorner corner;
+					p = ParseFaceCorner(p, end, chunk, corner);
+					face.push_back(corner);
+				}
+
+				// Triangulate polygon as a fan, same as tinyobj does
+				for (size_t i = 2; i < face.size(); ++i)
+				{
+					EmitCorner(chunk, face[0]);
+					EmitCorner(chunk, face[i - 1]);
+					EmitCorner(chunk, face[i]);
+				}
+			}
+
+			p = SkipLine(p, end);
+		}
+	}
+
+	std::vector<ObjChunk> SplitIntoLineAlignedChunks(const char* data, size_t size, size_t chunkCount)
+	{
+		std::vector<ObjChunk> chunks;
+		chunks.reserve(chunkCount);
+
+		const char* fileEnd = data + size;
+		const char* begin = data;
+		for (size_t i = 0; i < chunkCount && begin < fileEnd; ++i)
+		{
+			const char* end = (i + 1 == chunkCount) ? fileEnd : std::max(begin, data + size * (i + 1) / chunkCount);
+
+			// Move chunk's end forward to the start of the next line
+			while (end < fileEnd && end > data && end[-1] != '\n')
+				++end;
+
+			ObjChunk chunk;
+			chunk.Begin = begin;
+			chunk.End = end;
+			chunks.push_back(std::move(chunk));
+
+			begin = end;
+		}
+
+		return chunks;
+	}
+
+	// Run func(0) ... func(count - 1) each on its own thread, the calling thread takes index 0
+	template<typename Func>
+	void ParallelFor(size_t count, const Func& func)
+	{
+		std::vector<std::thread> workers;
+		workers.reserve(count > 0 ? count - 1 : 0);
+
+		for (size_t i = 1; i < count; ++i)
+			workers.emplace_back(func, i);
+
+		if (count > 0)
+			func(0);
+
+		for (auto& worker : workers)
+			worker.join();
+	}
+
+	template<typename T>
+	void ReleaseMemory(std::vector<T>& vec)
+	{
+		std::vector<T>().swap(vec);
+	}
+}
+
+namespace VkUtils
+{
+	void LoadModelParallel(const char* modelPath, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices,
+		ModelLoadStats* pStats, uint32_t threadCount)
+	{
+		// Map the file instead of reading it, chunks are parsed straight from the page cache
+		MappedFile file;
+		if (!file.Open(modelPath))
+			throw std::runtime_error("\nERROR : Failed to open model file !\n");
+
+		if (threadCount == 0)
+			threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+		size_t chunkCount = std::min<size_t>(threadCount, std::max<size_t>(1, file.Size() / kMinChunkSize));
+		auto chunks = SplitIntoLineAlignedChunks(file.Data(), file.Size(), chunkCount);
+		chunkCount = chunks.size();
+
+		ParallelFor(chunkCount, [&chunks](size_t i) { ParseChunk(chunks[i]); });
+
+		// Prefix sums of every chunk's element counts give their offsets in the merged arrays
+		size_t positionCount = 0, texCoordCount = 0, normalCount = 0, cornerCount = 0;
+		for (auto& chunk : chunks)
+		{
+			chunk.BasePosition = positionCount;
+			chunk.BaseTexCoord = texCoordCount;
+			chunk.BaseNormal = normalCount;
+			chunk.BaseCorner = cornerCount;
+
+			positionCount += chunk.Positions.size() / 3;
+			texCoordCount += chunk.TexCoords.size() / 2;
+			normalCount += chunk.NormalCount;
+			cornerCount += chunk.Corners.size();
+		}
+
+		if (positionCount > INT32_MAX || cornerCount > UINT32_MAX)
+			throw std::runtime_error("\nERROR : Model is too large to be indexed with 32 bits !\n");
+
+		std::vector<float> positions(positionCount * 3);
+		std::vector<float> texCoords(texCoordCount * 2);
+		std::vector<VertexKey> corners(cornerCount);
+
+		ParallelFor(chunkCount, [&](size_t i) {
+			auto& chunk = chunks[i];
+
+			for (const auto& relative : chunk.RelativeIndices)
+			{
+				auto& key = chunk.Corners[relative.Corner];
+				if (relative.Mask & kRelativePosition) key.Position += static_cast<int32_t>(chunk.BasePosition);
+				if (relative.Mask & kRelativeTexCoord)
+				{
+					key.TexCoord += static_cast<int32_t>(chunk.BaseTexCoord);
+					chunk.HasTexCoordOutOfRange |= key.TexCoord < 0;
+				}
+				if (relative.Mask & kRelativeNormal) key.Normal += static_cast<int32_t>(chunk.BaseNormal);
+			}
+
+			std::copy(chunk.Positions.begin(), chunk.Positions.end(), positions.begin() + chunk.BasePosition * 3);
+			std::copy(chunk.TexCoords.begin(), chunk.TexCoords.end(), texCoords.begin() + chunk.BaseTexCoord * 2);
+			std::copy(chunk.Corners.begin(), chunk.Corners.end(), corners.begin() + chunk.BaseCorner);
+
+			ReleaseMemory(chunk.Positions);
+			ReleaseMemory(chunk.TexCoords);
+			ReleaseMemory(chunk.Corners);
+			ReleaseMemory(chunk.RelativeIndices);
+		});
+		file.Close();
+
+		for (const auto& chunk : chunks)
+		{
+			if (chunk.HasTexCoordOutOfRange)
+				throw std::runtime_error("\nERROR : Model file references a vertex attribute out of range !\n");
+		}
+
+		// Weld corners, index buffer size is known exactly, vertex count only after welding
+		size_t firstIndex = indices.size();
+		size_t firstVertex = vertices.size();
+		indices.resize(firstIndex + cornerCount);
+
+		std::vector<uint32_t> uniqueCorners;
+		uniqueCorners.reserve(cornerCount);
+
+		VertexIndexMap uniqueVertices(cornerCount);
+		for (size_t i = 0; i < cornerCount; ++i)
+		{
+			const auto& key = corners[i];
+			if (key.Position < 0 || static_cast<size_t>(key.Position) >= positionCount ||
+				key.TexCoord >= static_cast<int64_t>(texCoordCount))
+				throw std::runtime_error("\nERROR : Model file references a vertex attribute out of range !\n");
+
+			auto newIndex = static_cast<uint32_t>(firstVertex + uniqueCorners.size());
+			auto vertexIndex = uniqueVertices.FindOrInsert(key, newIndex);
+			if (vertexIndex == newIndex)
+				uniqueCorners.push_back(static_cast<uint32_t>(i));
+
+			indices[firstIndex + i] = vertexIndex;
+		}
+
+		auto uniqueCount = uniqueCorners.size();
+		vertices.resize(firstVertex + uniqueCount);
+
+		ParallelFor(chunkCount, [&](size_t t) {
+			size_t begin = uniqueCount * t / chunkCount;
+			size_t end = uniqueCount * (t + 1) / chunkCount;
+
+			for (size_t i = begin; i < end; ++i)
+			{
+				const auto& key = corners[uniqueCorners[i]];
+				auto& vertex = vertices[firstVertex + i];
+
+				vertex.Pos = {
+					positions[3 * key.Position + 0],
+					positions[3 * key.Position + 1],
+					positions[3 * key.Position + 2]
+				};
+
+				if (key.TexCoord >= 0)
+				{
+					vertex.TexCoord = {
+						texCoords[2 * key.TexCoord + 0],
+						1.0f - texCoords[2 * key.TexCoord + 1]
+					};
+				}
+				else
+					vertex.TexCoord = { 0.0f, 0.0f };
+
+				vertex.Color = { 1.0f, 1.0f, 1.0f };
+			}
+		});
+
+		if (pStats)
+		{
+			pStats->RawVertexCount = cornerCount;
+			pStats->UniqueVertexCount = uniqueCount;
+			pStats->IndexCount = cornerCount;
+		}
+	}
+}
@@ -0,0 +1,12 @@
+#pragma once
+#include "VkUtils.h"
+
+namespace VkUtils
+{
+	// Multi-threaded replacement of LoadModel
+	// The file is split into line aligned chunks which are parsed on all cores, then merged into
+	// exactly sized vertex/index arrays. Only v, vt, vn and f records are read, polygons are triangulated as fans.
+	// threadCount = 0 uses every hardware thread
+	void LoadModelParallel(const char* modelPath, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices,
+		ModelLoadStats* pStats = nullptr, uint32_t threadCount = 0);
+}
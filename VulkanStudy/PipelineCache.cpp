@@ -0,0 +1,141 @@
+#include "PipelineCache.h"
+
+#include <fstream>
+#include <cstring>
+#include <cstdio>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#endif
+
+namespace
+{
+	// VkPipelineCacheHeaderVersionOne, read field by field since the data has no alignment guarantee
+	constexpr size_t kCacheHeaderSize = 4 * sizeof(uint32_t) + VK_UUID_SIZE;
+
+	uint32_t ReadUint32(const char* data)
+	{
+		uint32_t value;
+		std::memcpy(&value, data, sizeof(value));
+		return value;
+	}
+
+	bool IsCacheDataCompatible(const std::vector<char>& data, const VkPhysicalDeviceProperties& properties)
+	{
+		if (data.size() < kCacheHeaderSize)
+			return false;
+
+		uint32_t headerSize = ReadUint32(data.data());
+		uint32_t headerVersion = ReadUint32(data.data() + 4);
+		uint32_t vendorID = ReadUint32(data.data() + 8);
+		uint32_t deviceID = ReadUint32(data.data() + 12);
+		return headerSize >= kCacheHeaderSize && headerSize <= data.size() && headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+			vendorID == properties.vendorID && deviceID == properties.deviceID &&
+			std::memcmp(data.data() + 16, properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+	}
+
+	// Replace destination with source in a single step, readers see either file whole
+	bool ReplaceFile(const char* source, const char* destination)
+	{
+#ifdef _WIN32
+		return MoveFileExA(source, destination, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+		return std::rename(source, destination) == 0;
+#endif
+	}
+}
+
+namespace VkUtils
+{
+	void PipelineCache::Init(VkPhysicalDevice physicalDevice, VkDevice device, const char* fileName)
+	{
+		m_device = device;
+		m_fileName = fileName;
+
+		VkPhysicalDeviceProperties properties;
+		vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+		// Missing file or one from another device or driver, start cold
+		m_initialData = ReadBinaryFile(fileName);
+		if (!IsCacheDataCompatible(m_initialData, properties))
+			m_initialData.clear();
+
+		m_cache = CreateCache();
+	}
+
+	void PipelineCache::Destroy()
+	{
+		if (m_device == VK_NULL_HANDLE)
+			return;
+
+		for (auto threadCache : m_threadCaches)
+			vkDestroyPipelineCache(m_device, threadCache, nullptr);
+		m_threadCaches.clear();
+		vkDestroyPipelineCache(m_device, m_cache, nullptr);
+		m_cache = VK_NULL_HANDLE;
+		m_initialData.clear();
+		m_device = VK_NULL_HANDLE;
+	}
+
+	bool PipelineCache::Save()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_threadCacheMutex);
+			if (!m_threadCaches.empty() &&
+				vkMergePipelineCaches(m_device, m_cache, static_cast<uint32_t>(m_threadCaches.size()), m_threadCaches.data()) != VK_SUCCESS)
+				return false;
+		}
+
+		size_t dataSize = 0;
+		if (vkGetPipelineCacheData(m_device, m_cache, &dataSize, nullptr) != VK_SUCCESS)
+			return false;
+		std::vector<char> data(dataSize);
+		if (vkGetPipelineCacheData(m_device, m_cache, &dataSize, data.data()) != VK_SUCCESS)
+			return false;
+
+		std::string tempFileName = m_fileName + ".tmp";
+		{
+			std::ofstream file(tempFileName, std::ios::binary | std::ios::trunc);
+			if (!file.is_open())
+				return false;
+			file.write(data.data(), static_cast<std::streamsize>(dataSize));
+			file.close();
+			if (!file.good())
+			{
+				std::remove(tempFileName.c_str());
+				return false;
+			}
+		}
+
+		if (!ReplaceFile(tempFileName.c_str(), m_fileName.c_str()))
+		{
+			std::remove(tempFileName.c_str());
+			return false;
+		}
+		return true;
+	}
+
+	VkPipelineCache PipelineCache::CreateThreadCache()
+	{
+		VkPipelineCache threadCache = CreateCache();
+
+		std::lock_guard<std::mutex> lock(m_threadCacheMutex);
+		m_threadCaches.push_back(threadCache);
+		return threadCache;
+	}
+
+	VkPipelineCache PipelineCache::CreateCache() const
+	{
+		VkPipelineCacheCreateInfo createInfo{};
+		createInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+		createInfo.initialDataSize = m_initialData.size();
+		createInfo.pInitialData = m_initialData.empty() ? nullptr : m_initialData.data();
+
+		VkPipelineCache cache;
+		if (vkCreatePipelineCache(m_device, &createInfo, nullptr, &cache) != VK_SUCCESS)
+			throw std::runtime_error("\nVULKAN ERROR : Failed to create pipeline cache !\n");
+		return cache;
+	}
+}
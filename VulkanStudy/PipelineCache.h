@@ -0,0 +1,43 @@
+#pragma once
+#include "VkUtils.h"
+
+#include <mutex>
+#include <string>
+
+namespace VkUtils
+{
+	// Pipeline cache kept on disk between launches, so shaders are compiled once per driver instead of at every start
+	// The file is the driver's cache data as is. Its header is checked against the device before the driver sees it :
+	// data from another GPU or driver version is dropped and the cache starts cold.
+	// Threads creating pipelines get a cache each, merged into the main one when saving, so they never contend on one.
+	class PipelineCache
+	{
+	public:
+		// Create the cache from fileName's data when it was written for physicalDevice, empty otherwise
+		void Init(VkPhysicalDevice physicalDevice, VkDevice device, const char* fileName);
+		void Destroy();
+
+		// Merge every thread's cache and write the result over the file Init read
+		// Written to a temporary file first and renamed, a crash never leaves half a cache behind
+		// No pipeline may be created from any of the caches meanwhile. Return false when the file couldn't be written
+		bool Save();
+
+		// Cache of the thread which called Init
+		VkPipelineCache Get() const { return m_cache; }
+		// Cache for another thread, seeded with the file's data, valid until Destroy. Thread safe
+		VkPipelineCache CreateThreadCache();
+
+		// Bytes of valid data Init found in the file, 0 for a cold cache
+		size_t GetLoadedSize() const { return m_initialData.size(); }
+	private:
+		VkPipelineCache CreateCache() const;
+
+		VkDevice m_device = VK_NULL_HANDLE;
+		std::string m_fileName;
+		std::vector<char> m_initialData;
+		VkPipelineCache m_cache = VK_NULL_HANDLE;
+
+		std::mutex m_threadCacheMutex;
+		std::vector<VkPipelineCache> m_threadCaches;
+	};
+}
@@ -0,0 +1,146 @@
+#include "PipelineManager.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace VkUtils
+{
+	void PipelineManager::Init(VkDevice device, PipelineCache& pipelineCache, uint32_t threadCount)
+	{
+		m_device = device;
+		m_isStopping = false;
+
+		// Caches are created here, a worker never touches the pipeline cache object itself
+		for (uint32_t i = 0; i < std::max(1u, threadCount); ++i)
+			m_workers.emplace_back(&PipelineManager::RunWorker, this, pipelineCache.CreateThreadCache());
+	}
+
+	void PipelineManager::Destroy()
+	{
+		if (m_device == VK_NULL_HANDLE)
+			return;
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_isStopping = true;
+			m_queue.clear();
+		}
+		m_requestReady.notify_all();
+		for (auto& worker : m_workers)
+			worker.join();
+		m_workers.clear();
+
+		for (auto& pipeline : m_pipelines)
+		{
+			if (pipeline.Handle != VK_NULL_HANDLE)
+				vkDestroyPipeline(m_device, pipeline.Handle, nullptr);
+		}
+		m_pipelines.clear();
+		m_handles.clear();
+		m_pendingCount = 0;
+		m_doneCount = 0;
+		m_reportedDoneCount = 0;
+		m_device = VK_NULL_HANDLE;
+	}
+
+	PipelineHandle PipelineManager::Request(uint64_t key, CreateFunction create)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		auto found = m_handles.find(key);
+		if (found != m_handles.end())
+			return found->second;
+
+		auto handle = static_cast<PipelineHandle>(m_pipelines.size());
+		m_pipelines.push_back({ std::move(create), VK_NULL_HANDLE, false, nullptr });
+		m_handles.emplace(key, handle);
+		m_queue.push_back(handle);
+		++m_pendingCount;
+		m_requestReady.notify_one();
+		return handle;
+	}
+
+	VkPipeline PipelineManager::Get(PipelineHandle handle) const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return handle < m_pipelines.size() ? m_pipelines[handle].Handle : VK_NULL_HANDLE;
+	}
+
+	VkPipeline PipelineManager::Get(PipelineHandle handle, PipelineHandle fallback) const
+	{
+		VkPipeline pipeline = Get(handle);
+		return pipeline != VK_NULL_HANDLE ? pipeline : Get(fallback);
+	}
+
+	void PipelineManager::Wait(PipelineHandle handle)
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_pipelineDone.wait(lock, [this, handle] { return m_pipelines[handle].IsDone; });
+		CheckError(m_pipelines[handle]);
+	}
+
+	bool PipelineManager::Update()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_doneCount == m_reportedDoneCount)
+			return false;
+
+		m_reportedDoneCount = m_doneCount;
+		for (const auto& pipeline : m_pipelines)
+			CheckError(pipeline);
+		return true;
+	}
+
+	uint32_t PipelineManager::GetPendingCount() const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_pendingCount;
+	}
+
+	void PipelineManager::RunWorker(VkPipelineCache threadCache)
+	{
+		while (true)
+		{
+			PipelineHandle handle;
+			CreateFunction create;
+			{
+				std::unique_lock<std::mutex> lock(m_mutex);
+				m_requestReady.wait(lock, [this] { return m_isStopping || !m_queue.empty(); });
+				if (m_isStopping)
+					return;
+				handle = m_queue.front();
+				m_queue.pop_front();
+				// Requests may grow the vector while the pipeline is created
+				create = m_pipelines[handle].Create;
+			}
+
+			VkPipeline pipeline = VK_NULL_HANDLE;
+			std::exception_ptr error;
+			try
+			{
+				pipeline = create(threadCache);
+			}
+			catch (...)
+			{
+				error = std::current_exception();
+			}
+
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				auto& entry = m_pipelines[handle];
+				entry.Handle = pipeline;
+				entry.IsDone = true;
+				entry.Error = error;
+				entry.Create = nullptr;
+				--m_pendingCount;
+				++m_doneCount;
+			}
+			m_pipelineDone.notify_all();
+		}
+	}
+
+	void PipelineManager::CheckError(const Pipeline& pipeline) const
+	{
+		if (pipeline.Error)
+			std::rethrow_exception(pipeline.Error);
+	}
+}
@@ -0,0 +1,75 @@
+#pragma once
+#include "VkUtils.h"
+#include "PipelineCache.h"
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <exception>
+#include <deque>
+#include <unordered_map>
+
+namespace VkUtils
+{
+	// Index of a requested pipeline, valid until the manager is destroyed
+	using PipelineHandle = uint32_t;
+	constexpr PipelineHandle kInvalidPipelineHandle = UINT32_MAX;
+
+	// Compile pipelines on worker threads, so a pipeline first needed mid-frame never stalls the render loop
+	// Request returns at once, the pipeline is VK_NULL_HANDLE until a worker created it : the caller draws with
+	// a fallback or skips the draw meanwhile. Each worker creates from its own thread cache of the pipeline cache.
+	// Requests, Update and Wait come from one thread, Get from any.
+	class PipelineManager
+	{
+	public:
+		// Build the pipeline from pipelineCache, called on a worker thread
+		using CreateFunction = std::function<VkPipeline(VkPipelineCache pipelineCache)>;
+
+		// pipelineCache must outlive the manager, save it once the manager is destroyed
+		void Init(VkDevice device, PipelineCache& pipelineCache, uint32_t threadCount);
+		// Wait for the pipelines being compiled, drop the queued ones and destroy every pipeline
+		void Destroy();
+
+		// Queue the pipeline identified by key, unless it was already requested : both get the same handle
+		PipelineHandle Request(uint64_t key, CreateFunction create);
+		// VK_NULL_HANDLE until the pipeline is ready
+		VkPipeline Get(PipelineHandle handle) const;
+		// Requested pipeline if it is ready, fallback's otherwise, which may not be ready either
+		VkPipeline Get(PipelineHandle handle, PipelineHandle fallback) const;
+		// Block until the pipeline is ready, for callers which can't do without it
+		void Wait(PipelineHandle handle);
+
+		// Return true when pipelines became ready since the last call, commands recorded with their fallback may switch to them
+		// Rethrow what a worker threw creating a pipeline
+		bool Update();
+		uint32_t GetPendingCount() const;
+	private:
+		struct Pipeline
+		{
+			CreateFunction Create;
+			VkPipeline Handle;
+			bool IsDone;
+			std::exception_ptr Error;
+		};
+
+		void RunWorker(VkPipelineCache threadCache);
+		// Throw the pipeline's error if its creation failed
+		void CheckError(const Pipeline& pipeline) const;
+
+		VkDevice m_device = VK_NULL_HANDLE;
+		std::vector<std::thread> m_workers;
+
+		mutable std::mutex m_mutex;
+		std::condition_variable m_requestReady;
+		std::condition_variable m_pipelineDone;
+		bool m_isStopping = false;
+		std::vector<Pipeline> m_pipelines;
+		std::unordered_map<uint64_t, PipelineHandle> m_handles;
+		std::deque<PipelineHandle> m_queue;
+		uint32_t m_pendingCount = 0;
+		// Pipelines done, and how many of them Update already reported
+		uint32_t m_doneCount = 0;
+		uint32_t m_reportedDoneCount = 0;
+	};
+}
@@ -0,0 +1,163 @@
+#include "SecondaryRecorder.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace VkUtils
+{
+	void SecondaryRecorder::Init(VkDevice device, uint32_t queueFamilyIndex, uint32_t threadCount, uint32_t frameCount)
+	{
+		m_device = device;
+		m_threadCount = std::max(1u, threadCount);
+		m_isStopping = false;
+
+		VkCommandPoolCreateInfo poolCreateInfo{};
+		poolCreateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+		poolCreateInfo.queueFamilyIndex = queueFamilyIndex;
+		// Pools are reset as a whole, command buffers are never reset one by one
+		poolCreateInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+
+		m_cmdPools.resize(frameCount * m_threadCount);
+		m_recordedCmdBuffers.resize(frameCount);
+		m_cmdBuffers.resize(m_cmdPools.size());
+		for (size_t i = 0; i < m_cmdPools.size(); ++i)
+		{
+			if (vkCreateCommandPool(m_device, &poolCreateInfo, nullptr, &m_cmdPools[i]) != VK_SUCCESS)
+				throw std::runtime_error("\nVULKAN ERROR : Failed to create secondary command pool !\n");
+
+			VkCommandBufferAllocateInfo allocInfo{};
+			allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+			allocInfo.commandPool = m_cmdPools[i];
+			allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+			allocInfo.commandBufferCount = 1;
+			if (vkAllocateCommandBuffers(m_device, &allocInfo, &m_cmdBuffers[i]) != VK_SUCCESS)
+				throw std::runtime_error("\nVULKAN ERROR : Failed to allocate secondary command buffer !\n");
+		}
+
+		m_errors.resize(m_threadCount);
+		for (uint32_t thread = 1; thread < m_threadCount; ++thread)
+			m_workers.emplace_back(&SecondaryRecorder::RunWorker, this, thread);
+	}
+
+	void SecondaryRecorder::Destroy()
+	{
+		if (m_device == VK_NULL_HANDLE)
+			return;
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_isStopping = true;
+		}
+		m_jobReady.notify_all();
+		for (auto& worker : m_workers)
+			worker.join();
+		m_workers.clear();
+
+		// Command buffers go with their pool
+		for (auto cmdPool : m_cmdPools)
+			vkDestroyCommandPool(m_device, cmdPool, nullptr);
+		m_cmdPools.clear();
+		m_cmdBuffers.clear();
+		m_recordedCmdBuffers.clear();
+		m_device = VK_NULL_HANDLE;
+	}
+
+	const std::vector<VkCommandBuffer>& SecondaryRecorder::Record(uint32_t frame, const VkCommandBufferInheritanceInfo& inheritance, uint32_t itemCount,
+		uint32_t threadCount, const RecordFunction& record)
+	{
+		auto& recordedCmdBuffers = m_recordedCmdBuffers[frame];
+		recordedCmdBuffers.clear();
+		if (itemCount == 0)
+			return recordedCmdBuffers;
+
+		threadCount = std::min(std::min(threadCount, m_threadCount), (itemCount + kMinItemsPerRecordingThread - 1) / kMinItemsPerRecordingThread);
+		threadCount = std::max(1u, threadCount);
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_jobFrame = frame;
+			m_jobItemCount = itemCount;
+			m_jobThreadCount = threadCount;
+			m_jobInheritance = inheritance;
+			m_jobRecord = &record;
+			m_pendingWorkers = threadCount - 1;
+			++m_jobId;
+		}
+		if (threadCount > 1)
+			m_jobReady.notify_all();
+
+		// First run is recorded here while the workers record theirs
+		RecordRun(0);
+
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_jobDone.wait(lock, [this] { return m_pendingWorkers == 0; });
+		}
+
+		for (uint32_t thread = 0; thread < threadCount; ++thread)
+		{
+			if (m_errors[thread])
+			{
+				auto error = m_errors[thread];
+				std::fill(m_errors.begin(), m_errors.end(), nullptr);
+				std::rethrow_exception(error);
+			}
+			recordedCmdBuffers.push_back(m_cmdBuffers[frame * m_threadCount + thread]);
+		}
+		return recordedCmdBuffers;
+	}
+
+	void SecondaryRecorder::RunWorker(uint32_t thread)
+	{
+		uint64_t lastJobId = 0;
+		while (true)
+		{
+			{
+				std::unique_lock<std::mutex> lock(m_mutex);
+				m_jobReady.wait(lock, [this, lastJobId] { return m_isStopping || m_jobId != lastJobId; });
+				if (m_isStopping)
+					return;
+				lastJobId = m_jobId;
+				// Jobs too small for every thread leave the last ones idle
+				if (thread >= m_jobThreadCount)
+					continue;
+			}
+
+			RecordRun(thread);
+
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (--m_pendingWorkers == 0)
+				m_jobDone.notify_one();
+		}
+	}
+
+	void SecondaryRecorder::RecordRun(uint32_t thread)
+	{
+		try
+		{
+			uint32_t firstItem = static_cast<uint32_t>(static_cast<uint64_t>(m_jobItemCount) * thread / m_jobThreadCount);
+			uint32_t endItem = static_cast<uint32_t>(static_cast<uint64_t>(m_jobItemCount) * (thread + 1) / m_jobThreadCount);
+			uint32_t index = m_jobFrame * m_threadCount + thread;
+
+			if (vkResetCommandPool(m_device, m_cmdPools[index], 0) != VK_SUCCESS)
+				throw std::runtime_error("\nVULKAN ERROR : Failed to reset secondary command pool !\n");
+
+			VkCommandBufferBeginInfo beginInfo{};
+			beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+			// Whole command buffer runs inside the render pass
+			beginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+			beginInfo.pInheritanceInfo = &m_jobInheritance;
+			if (vkBeginCommandBuffer(m_cmdBuffers[index], &beginInfo) != VK_SUCCESS)
+				throw std::runtime_error("\nVULKAN ERROR : Failed to start record secondary commands !\n");
+
+			(*m_jobRecord)(m_cmdBuffers[index], firstItem, endItem - firstItem);
+
+			if (vkEndCommandBuffer(m_cmdBuffers[index]) != VK_SUCCESS)
+				throw std::runtime_error("\nVULKAN ERROR : Failed to stop record secondary commands !\n");
+		}
+		catch (...)
+		{
+			m_errors[thread] = std::current_exception();
+		}
+	}
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include "VkUtils.h"
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <exception>
+
+namespace VkUtils
+{
+	// Fewer items aren't worth waking another thread for
+	constexpr uint32_t kMinItemsPerRecordingThread = 64;
+
+	// Record the contents of a render pass on several threads at once, each into its own secondary command buffer
+	// Items (draws, usually) are split in contiguous runs, one per thread, and the caller's thread records the first one.
+	// Every thread has a command pool per frame, reset as a whole before recording : a frame's secondary command buffers
+	// must not be pending anymore, the caller's fences guarantee that like for the primary ones executing them.
+	// Worker threads live as long as the recorder and sleep between recordings.
+	class SecondaryRecorder
+	{
+	public:
+		// Record the items [firstItem, firstItem + itemCount) to cmdBuffer, which is already begun. Called from any thread
+		using RecordFunction = std::function<void(VkCommandBuffer cmdBuffer, uint32_t firstItem, uint32_t itemCount)>;
+
+		// threadCount : most threads one recording may use, the caller's included
+		// frameCount : secondary command buffers per thread, one per frame recorded at once
+		void Init(VkDevice device, uint32_t queueFamilyIndex, uint32_t threadCount, uint32_t frameCount);
+		void Destroy();
+
+		// Split itemCount items among up to threadCount threads and wait for them, rethrow what a thread threw
+		// Return the frame's recorded command buffers in item order, to execute in the subpass inheritance describes
+		const std::vector<VkCommandBuffer>& Record(uint32_t frame, const VkCommandBufferInheritanceInfo& inheritance, uint32_t itemCount,
+			uint32_t threadCount, const RecordFunction& record);
+		// Command buffers the frame's last Record returned, they stay valid to execute again until the frame is recorded again
+		const std::vector<VkCommandBuffer>& GetCommandBuffers(uint32_t frame) const { return m_recordedCmdBuffers[frame]; }
+
+		uint32_t GetThreadCount() const { return m_threadCount; }
+	private:
+		void RunWorker(uint32_t thread);
+		// Record the thread's run of the current job
+		void RecordRun(uint32_t thread);
+
+		VkDevice m_device = VK_NULL_HANDLE;
+		uint32_t m_threadCount = 0;
+		// [frame * m_threadCount + thread]
+		std::vector<VkCommandPool> m_cmdPools;
+		std::vector<VkCommandBuffer> m_cmdBuffers;
+		// Per frame
+		std::vector<std::vector<VkCommandBuffer>> m_recordedCmdBuffers;
+
+		// Thread 0 is the caller's, the others have a worker
+		std::vector<std::thread> m_workers;
+		std::mutex m_mutex;
+		std::condition_variable m_jobReady;
+		std::condition_variable m_jobDone;
+		bool m_isStopping = false;
+		// Incremented by every job, workers wait for it to change
+		uint64_t m_jobId = 0;
+		uint32_t m_pendingWorkers = 0;
+
+		// Current job, set before it is published and only read by the threads recording it
+		uint32_t m_jobFrame = 0;
+		uint32_t m_jobItemCount = 0;
+		uint32_t m_jobThreadCount = 0;
+		VkCommandBufferInheritanceInfo m_jobInheritance{};
+		const RecordFunction* m_jobRecord = nullptr;
+		std::vector<std::exception_ptr> m_errors;
+	};
+}
@@ -0,0 +1,126 @@
+#include "../BuddyAllocator.h"
+#include "TestUtils.h"
+
+#include <algorithm>
+#include <map>
+#include <random>
+#include <stdexcept>
+
+namespace
+{
+	constexpr VkDeviceSize kSize = 1024 * 1024;
+	constexpr VkDeviceSize kMinAllocationSize = 256;
+
+	// Size of the range the allocator gives out for a request
+	VkDeviceSize GetRangeSize(VkDeviceSize size, VkDeviceSize alignment)
+	{
+		VkDeviceSize rangeSize = kMinAllocationSize;
+		while (rangeSize < size || rangeSize < alignment)
+			rangeSize *= 2;
+		return rangeSize;
+	}
+
+	bool ThrowsOnFree(VkUtils::BuddyAllocator& allocator, VkDeviceSize offset)
+	{
+		try
+		{
+			allocator.Free(offset);
+		}
+		catch (const std::runtime_error&)
+		{
+			return true;
+		}
+		return false;
+	}
+
+	void TestRandomAllocations()
+	{
+		VkUtils::BuddyAllocator allocator(kSize, kMinAllocationSize);
+		std::mt19937 random(42);
+		std::uniform_int_distribution<uint32_t> action(0, 99);
+		std::uniform_int_distribution<VkDeviceSize> size(1, 64 * 1024);
+		std::uniform_int_distribution<uint32_t> alignmentShift(0, 12);
+
+		// Offset to end of every range given out
+		std::map<VkDeviceSize, VkDeviceSize> ranges;
+		VkDeviceSize allocatedSize = 0;
+		uint32_t failedCount = 0;
+
+		for (uint32_t i = 0; i < 20000; ++i)
+		{
+			// Mostly allocate, so the range fills up and requests start failing
+			if (ranges.empty() || action(random) < 55)
+			{
+				VkDeviceSize requestedSize = size(random);
+				VkDeviceSize alignment = VkDeviceSize(1) << alignmentShift(random);
+				VkDeviceSize rangeSize = GetRangeSize(requestedSize, alignment);
+
+				VkDeviceSize offset;
+				if (!allocator.Allocate(requestedSize, alignment, &offset))
+				{
+					CHECK(allocator.GetLargestFreeSize() < rangeSize);
+					++failedCount;
+					continue;
+				}
+
+				CHECK(offset % alignment == 0);
+				CHECK(offset + rangeSize <= kSize);
+
+				// Neither the next range nor the previous one overlaps
+				auto next = ranges.lower_bound(offset);
+				CHECK(next == ranges.end() || next->first >= offset + rangeSize);
+				CHECK(next == ranges.begin() || std::prev(next)->second <= offset);
+
+				ranges.emplace(offset, offset + rangeSize);
+				allocatedSize += rangeSize;
+			}
+			else
+			{
+				auto range = ranges.begin();
+				std::advance(range, std::uniform_int_distribution<size_t>(0, ranges.size() - 1)(random));
+				allocator.Free(range->first);
+				allocatedSize -= range->second - range->first;
+				ranges.erase(range);
+			}
+
+			CHECK(allocator.GetAllocatedSize() == allocatedSize);
+		}
+		CHECK(failedCount > 0);
+
+		// Once everything is freed the buddies merge back into the whole range
+		std::vector<VkDeviceSize> offsets;
+		for (const auto& range : ranges)
+			offsets.push_back(range.first);
+		std::shuffle(offsets.begin(), offsets.end(), random);
+		for (auto offset : offsets)
+			allocator.Free(offset);
+
+		CHECK(allocator.IsEmpty());
+		CHECK(allocator.GetLargestFreeSize() == kSize);
+		VkDeviceSize offset = 1;
+		CHECK(allocator.Allocate(kSize, 1, &offset));
+		CHECK(offset == 0);
+	}
+
+	void TestFreeErrors()
+	{
+		VkUtils::BuddyAllocator allocator(kSize, kMinAllocationSize);
+		CHECK(ThrowsOnFree(allocator, 0));
+
+		VkDeviceSize offset;
+		CHECK(allocator.Allocate(4096, 1, &offset));
+		// Inside a range, past the end and freed twice
+		CHECK(ThrowsOnFree(allocator, offset + kMinAllocationSize));
+		CHECK(ThrowsOnFree(allocator, kSize));
+		CHECK(!ThrowsOnFree(allocator, offset));
+		CHECK(ThrowsOnFree(allocator, offset));
+		CHECK(allocator.IsEmpty());
+	}
+}
+
+int main()
+{
+	TestRandomAllocations();
+	TestFreeErrors();
+	return TestUtils::ReportResult("BUDDY ALLOCATOR TEST");
+}
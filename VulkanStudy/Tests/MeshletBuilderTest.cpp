@@ -0,0 +1,163 @@
+#include "../MeshletBuilder.h"
+#include "TestUtils.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <random>
+#include <set>
+
+namespace
+{
+	using Triangle = std::array<uint32_t, 3>;
+
+	// Quads on the z = 0 plane, counter clockwise seen from +z
+	void AddGrid(uint32_t size, std::vector<VkUtils::Vertex>& vertices, std::vector<uint32_t>& indices, std::vector<VkUtils::SubMesh>& subMeshes)
+	{
+		VkUtils::SubMesh subMesh{ static_cast<uint32_t>(indices.size()), 0, static_cast<int32_t>(vertices.size()) };
+		for (uint32_t y = 0; y <= size; ++y)
+		{
+			for (uint32_t x = 0; x <= size; ++x)
+				vertices.push_back({ glm::vec3(static_cast<float>(x), static_cast<float>(y), 0.0f), glm::vec3(1.0f), glm::vec2(0.0f) });
+		}
+		for (uint32_t y = 0; y < size; ++y)
+		{
+			for (uint32_t x = 0; x < size; ++x)
+			{
+				uint32_t corner = y * (size + 1) + x;
+				indices.insert(indices.end(), { corner, corner + 1, corner + size + 2, corner, corner + size + 2, corner + size + 1 });
+			}
+		}
+		subMesh.IndexCount = static_cast<uint32_t>(indices.size()) - subMesh.FirstIndex;
+		subMeshes.push_back(subMesh);
+	}
+
+	// Triangles between random vertices, few shared corners push meshlets to their vertex limit
+	void AddTriangleSoup(uint32_t vertexCount, uint32_t triangleCount, std::vector<VkUtils::Vertex>& vertices, std::vector<uint32_t>& indices,
+		std::vector<VkUtils::SubMesh>& subMeshes)
+	{
+		std::mt19937 random(42);
+		std::uniform_real_distribution<float> position(-10.0f, 10.0f);
+		std::uniform_int_distribution<uint32_t> vertex(0, vertexCount - 1);
+
+		VkUtils::SubMesh subMesh{ static_cast<uint32_t>(indices.size()), triangleCount * 3, static_cast<int32_t>(vertices.size()) };
+		for (uint32_t i = 0; i < vertexCount; ++i)
+			vertices.push_back({ glm::vec3(position(random), position(random), position(random)), glm::vec3(1.0f), glm::vec2(0.0f) });
+		for (uint32_t i = 0; i < triangleCount * 3; ++i)
+			indices.push_back(vertex(random));
+		subMeshes.push_back(subMesh);
+	}
+
+	// Triangles with their sub mesh's vertex offset applied, sorted to compare as multisets
+	std::vector<Triangle> GetSortedTriangles(const std::vector<uint32_t>& indices, uint32_t firstIndex, uint32_t indexCount, int32_t vertexOffset)
+	{
+		std::vector<Triangle> triangles;
+		for (uint32_t i = firstIndex; i < firstIndex + indexCount; i += 3)
+			triangles.push_back({ indices[i] + vertexOffset, indices[i + 1] + vertexOffset, indices[i + 2] + vertexOffset });
+		std::sort(triangles.begin(), triangles.end());
+		return triangles;
+	}
+
+	void CheckMeshlets(const std::vector<VkUtils::Vertex>& vertices, const std::vector<uint32_t>& inputIndices,
+		const std::vector<VkUtils::SubMesh>& subMeshes)
+	{
+		std::vector<uint32_t> indices;
+		VkUtils::MeshletStats stats;
+		auto meshlets = VkUtils::BuildMeshlets(vertices, inputIndices, subMeshes, indices, &stats);
+
+		CHECK(!meshlets.empty());
+		CHECK(stats.MeshletCount == meshlets.size());
+		CHECK(indices.size() == inputIndices.size());
+
+		std::vector<Triangle> inputTriangles;
+		for (const auto& subMesh : subMeshes)
+		{
+			auto subMeshTriangles = GetSortedTriangles(inputIndices, subMesh.FirstIndex, subMesh.IndexCount, subMesh.VertexOffset);
+			inputTriangles.insert(inputTriangles.end(), subMeshTriangles.begin(), subMeshTriangles.end());
+		}
+		std::sort(inputTriangles.begin(), inputTriangles.end());
+
+		std::vector<Triangle> meshletTriangles;
+		uint32_t nextIndex = 0;
+		for (const auto& meshlet : meshlets)
+		{
+			// Meshlets cover the meshlet index buffer one after the other
+			CHECK(meshlet.FirstIndex == nextIndex);
+			CHECK(meshlet.IndexCount % 3 == 0);
+			nextIndex = meshlet.FirstIndex + meshlet.IndexCount;
+
+			CHECK(meshlet.IndexCount / 3 <= VkUtils::kMaxMeshletTriangles);
+			std::set<uint32_t> meshletVertices(indices.begin() + meshlet.FirstIndex, indices.begin() + meshlet.FirstIndex + meshlet.IndexCount);
+			CHECK(meshletVertices.size() == meshlet.VertexCount);
+			CHECK(meshlet.VertexCount <= VkUtils::kMaxMeshletVertices);
+
+			for (auto vertex : meshletVertices)
+			{
+				float distance = glm::length(vertices[vertex + meshlet.VertexOffset].Pos - meshlet.Center);
+				CHECK(distance <= meshlet.Radius * 1.0001f + 1e-5f);
+			}
+
+			auto triangles = GetSortedTriangles(indices, meshlet.FirstIndex, meshlet.IndexCount, meshlet.VertexOffset);
+			meshletTriangles.insert(meshletTriangles.end(), triangles.begin(), triangles.end());
+		}
+		CHECK(nextIndex == indices.size());
+
+		// Every input triangle in exactly one meshlet, none made up
+		std::sort(meshletTriangles.begin(), meshletTriangles.end());
+		CHECK(meshletTriangles == inputTriangles);
+	}
+
+	void TestLimitsAndCoverage()
+	{
+		std::vector<VkUtils::Vertex> vertices;
+		std::vector<uint32_t> indices;
+		std::vector<VkUtils::SubMesh> subMeshes;
+		AddGrid(40, vertices, indices, subMeshes);
+		AddTriangleSoup(500, 3000, vertices, indices, subMeshes);
+		CheckMeshlets(vertices, indices, subMeshes);
+	}
+
+	void TestKnownCones()
+	{
+		// Faces towards +z, back facing seen from behind, whatever the distance to the axis
+		VkUtils::Meshlet narrow{};
+		narrow.Center = glm::vec3(0.0f);
+		narrow.Radius = 1.0f;
+		narrow.ConeAxis = glm::vec3(0.0f, 0.0f, 1.0f);
+		narrow.ConeCutoff = 0.5f;		// sin(30 degrees)
+		CHECK(VkUtils::IsMeshletBackFacing(narrow, glm::vec3(0.0f, 0.0f, -10.0f)));
+		CHECK(VkUtils::IsMeshletBackFacing(narrow, glm::vec3(2.0f, 0.0f, -10.0f)));
+		CHECK(!VkUtils::IsMeshletBackFacing(narrow, glm::vec3(0.0f, 0.0f, 10.0f)));
+		// Beside the cone and inside the bounding sphere
+		CHECK(!VkUtils::IsMeshletBackFacing(narrow, glm::vec3(10.0f, 0.0f, -1.0f)));
+		CHECK(!VkUtils::IsMeshletBackFacing(narrow, glm::vec3(0.0f, 0.0f, -0.5f)));
+
+		// Cutoff 1 is never back facing
+		VkUtils::Meshlet wide = narrow;
+		wide.ConeCutoff = 1.0f;
+		CHECK(!VkUtils::IsMeshletBackFacing(wide, glm::vec3(0.0f, 0.0f, -10.0f)));
+		CHECK(!VkUtils::IsMeshletBackFacing(wide, glm::vec3(0.0f, 0.0f, -1000.0f)));
+
+		// Built from a flat grid : a zero width cone along +z
+		std::vector<VkUtils::Vertex> vertices;
+		std::vector<uint32_t> indices;
+		std::vector<VkUtils::SubMesh> subMeshes;
+		AddGrid(16, vertices, indices, subMeshes);
+		std::vector<uint32_t> meshletIndices;
+		auto meshlets = VkUtils::BuildMeshlets(vertices, indices, subMeshes, meshletIndices);
+		for (const auto& meshlet : meshlets)
+		{
+			CHECK(std::abs(meshlet.ConeAxis.z - 1.0f) < 1e-4f);
+			CHECK(meshlet.ConeCutoff < 1e-2f);
+			CHECK(VkUtils::IsMeshletBackFacing(meshlet, meshlet.Center - glm::vec3(0.0f, 0.0f, 50.0f)));
+			CHECK(!VkUtils::IsMeshletBackFacing(meshlet, meshlet.Center + glm::vec3(0.0f, 0.0f, 50.0f)));
+		}
+	}
+}
+
+int main()
+{
+	TestLimitsAndCoverage();
+	TestKnownCones();
+	return TestUtils::ReportResult("MESHLET BUILDER TEST");
+}
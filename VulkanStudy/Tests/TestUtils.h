@@ -0,0 +1,29 @@
+#pragma once
+#include <iostream>
+
+// Checks for the CPU side tests run by ctest, a failed check is reported and the test keeps going
+namespace TestUtils
+{
+	inline int& GetFailureCount()
+	{
+		static int failureCount = 0;
+		return failureCount;
+	}
+
+	// Exit code of the test executable
+	inline int ReportResult(const char* testName)
+	{
+		std::cout << "\n" << testName << " : " << (GetFailureCount() == 0 ? "passed" : "FAILED") << ", " << GetFailureCount() << " failed checks\n";
+		return GetFailureCount() == 0 ? 0 : 1;
+	}
+}
+
+#define CHECK(condition) \
+	do \
+	{ \
+		if (!(condition)) \
+		{ \
+			std::cerr << __FILE__ << "(" << __LINE__ << ") : CHECK failed : " #condition "\n"; \
+			++TestUtils::GetFailureCount(); \
+		} \
+	} while (false)
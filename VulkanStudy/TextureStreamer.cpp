@@ -0,0 +1,344 @@
+#include "TextureStreamer.h"
+
+#include <cstring>
+#include <algorithm>
+#include <chrono>
+
+namespace VkUtils
+{
+	void TextureStreamer::Init(DeviceAllocator& allocator, VkDevice device, VkQueue graphicsQueue, uint32_t graphicsFamilyIndex,
+		VkQueue transferQueue, uint32_t transferFamilyIndex, VkDeviceSize budget, uint32_t framesInFlight)
+	{
+		m_allocator = &allocator;
+		m_device = device;
+		m_graphicsQueue = graphicsQueue;
+		m_transferQueue = transferQueue;
+		m_graphicsFamilyIndex = graphicsFamilyIndex;
+		m_transferFamilyIndex = transferFamilyIndex;
+		m_framesInFlight = framesInFlight;
+		m_stats.Budget = budget;
+
+		VkCommandPoolCreateInfo poolCreateInfo{};
+		poolCreateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+		poolCreateInfo.queueFamilyIndex = m_transferFamilyIndex;
+		poolCreateInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT | VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+		if (vkCreateCommandPool(m_device, &poolCreateInfo, nullptr, &m_cmdPool) != VK_SUCCESS)
+			throw std::runtime_error("\nVULKAN ERROR : Failed to create texture streaming command pool !\n");
+
+		VkCommandBufferAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocInfo.commandPool = m_cmdPool;
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		allocInfo.commandBufferCount = 1;
+		if (vkAllocateCommandBuffers(m_device, &allocInfo, &m_cmdBuffer) != VK_SUCCESS)
+			throw std::runtime_error("\nVULKAN ERROR : Failed to allocate texture streaming command buffer !\n");
+
+		if (m_transferFamilyIndex != m_graphicsFamilyIndex)
+		{
+			poolCreateInfo.queueFamilyIndex = m_graphicsFamilyIndex;
+			if (vkCreateCommandPool(m_device, &poolCreateInfo, nullptr, &m_acquireCmdPool) != VK_SUCCESS)
+				throw std::runtime_error("\nVULKAN ERROR : Failed to create texture streaming acquire command pool !\n");
+
+			allocInfo.commandPool = m_acquireCmdPool;
+			if (vkAllocateCommandBuffers(m_device, &allocInfo, &m_acquireCmdBuffer) != VK_SUCCESS)
+				throw std::runtime_error("\nVULKAN ERROR : Failed to allocate texture streaming acquire command buffer !\n");
+
+			VkSemaphoreCreateInfo semaphoreCreateInfo{};
+			semaphoreCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+			if (vkCreateSemaphore(m_device, &semaphoreCreateInfo, nullptr, &m_acquireSemaphore) != VK_SUCCESS)
+				throw std::runtime_error("\nVULKAN ERROR : Failed to create texture streaming semaphore !\n");
+		}
+
+		VkFenceCreateInfo fenceCreateInfo{};
+		fenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+		if (vkCreateFence(m_device, &fenceCreateInfo, nullptr, &m_uploadFence) != VK_SUCCESS)
+			throw std::runtime_error("\nVULKAN ERROR : Failed to create texture streaming fence !\n");
+	}
+
+	void TextureStreamer::Destroy()
+	{
+		if (m_device == VK_NULL_HANDLE)
+			return;
+
+		// Caller waited for the device to be idle, only the level copy may still run
+		if (m_upload)
+		{
+			if (m_upload->LevelCopy.valid())
+				m_upload->LevelCopy.wait();
+			m_retiredImages.push_back({ m_upload->Image, m_upload->Memory, m_upload->View, 0 });
+			vkDestroyBuffer(m_device, m_upload->StagingBuffer, nullptr);
+			m_allocator->Free(m_upload->StagingMemory);
+			m_upload.reset();
+		}
+
+		for (const auto& texture : m_textures)
+			m_retiredImages.push_back({ texture.Image, texture.Memory, texture.View, 0 });
+		for (const auto& retired : m_retiredImages)
+		{
+			vkDestroyImageView(m_device, retired.View, nullptr);
+			vkDestroyImage(m_device, retired.Image, nullptr);
+			m_allocator->Free(retired.Memory);
+		}
+		m_retiredImages.clear();
+		m_textures.clear();
+
+		vkDestroyFence(m_device, m_uploadFence, nullptr);
+		vkDestroySemaphore(m_device, m_acquireSemaphore, nullptr);
+		vkDestroyCommandPool(m_device, m_cmdPool, nullptr);
+		vkDestroyCommandPool(m_device, m_acquireCmdPool, nullptr);
+		m_device = VK_NULL_HANDLE;
+	}
+
+	uint32_t TextureStreamer::AddTexture(const StreamedTextureSource& source)
+	{
+		if (source.LevelData.empty() || source.LevelData.size() != source.LevelSizes.size())
+			throw std::runtime_error("\nERROR : Streamed texture needs its full mip chain !\n");
+
+		StreamedTexture texture{};
+		texture.Source = source;
+		texture.Image = VK_NULL_HANDLE;
+		texture.Memory = {};
+		texture.View = VK_NULL_HANDLE;
+
+		// Mip tail : coarsest levels fitting kInitialResidentBytes, at least the last one
+		uint32_t mipLevels = static_cast<uint32_t>(source.LevelData.size());
+		texture.TailLevel = mipLevels - 1;
+		while (texture.TailLevel > 0 && GetChainSize(texture, texture.TailLevel - 1) <= kInitialResidentBytes)
+			--texture.TailLevel;
+		texture.ResidentLevel = texture.TailLevel;
+		texture.RequestedLevel = texture.TailLevel;
+		texture.LastRequestFrame = m_frame;
+
+		// Finish whatever is streaming first, its level copy reads from m_textures
+		if (m_upload)
+		{
+			m_upload->LevelCopy.wait();
+			if (!m_upload->IsSubmitted)
+				SubmitUpload();
+			vkWaitForFences(m_device, 1, &m_uploadFence, VK_TRUE, UINT64_MAX);
+			FinishUpload();
+		}
+
+		uint32_t index = static_cast<uint32_t>(m_textures.size());
+		m_textures.push_back(texture);
+
+		// Tail is uploaded right away
+		StartUpload(index, texture.TailLevel);
+		m_upload->LevelCopy.wait();
+		SubmitUpload();
+		vkWaitForFences(m_device, 1, &m_uploadFence, VK_TRUE, UINT64_MAX);
+		FinishUpload();
+
+		return index;
+	}
+
+	void TextureStreamer::RequestLevel(uint32_t texture, uint32_t level)
+	{
+		auto& streamed = m_textures[texture];
+		streamed.RequestedLevel = std::min(level, GetMipLevels(texture) - 1);
+		streamed.LastRequestFrame = m_frame;
+	}
+
+	bool TextureStreamer::Update()
+	{
+		++m_frame;
+
+		// Frames submitted before the swap are done once framesInFlight more frames have waited their fence
+		auto retiredEnd = std::remove_if(m_retiredImages.begin(), m_retiredImages.end(), [&](const RetiredImage& retired)
+		{
+			if (retired.ReleaseFrame > m_frame)
+				return false;
+
+			vkDestroyImageView(m_device, retired.View, nullptr);
+			vkDestroyImage(m_device, retired.Image, nullptr);
+			m_allocator->Free(retired.Memory);
+			return true;
+		});
+		m_retiredImages.erase(retiredEnd, m_retiredImages.end());
+
+		// One residency change at a time, it never blocks the frame
+		if (m_upload)
+		{
+			if (m_upload->LevelCopy.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+				return false;
+			if (!m_upload->IsSubmitted)
+			{
+				SubmitUpload();
+				return false;
+			}
+			if (vkGetFenceStatus(m_device, m_uploadFence) != VK_SUCCESS)
+				return false;
+
+			FinishUpload();
+			return true;
+		}
+
+		// Over budget : drop the finest level of the least recently requested texture
+		if (m_stats.ResidentBytes > m_stats.Budget)
+		{
+			uint32_t victim = FindEvictionVictim(UINT64_MAX);
+			if (victim != UINT32_MAX)
+			{
+				++m_stats.EvictionCount;
+				StartUpload(victim, m_textures[victim].ResidentLevel + 1);
+			}
+			return false;
+		}
+
+		// Stream one more level of the most recently requested texture missing some
+		uint32_t candidate = UINT32_MAX;
+		for (uint32_t i = 0; i < m_textures.size(); ++i)
+		{
+			const auto& texture = m_textures[i];
+			if (texture.RequestedLevel < texture.ResidentLevel &&
+				(candidate == UINT32_MAX || texture.LastRequestFrame > m_textures[candidate].LastRequestFrame))
+				candidate = i;
+		}
+		if (candidate == UINT32_MAX)
+			return false;
+
+		const auto& texture = m_textures[candidate];
+		VkDeviceSize growth = GetChainSize(texture, texture.ResidentLevel - 1) - GetChainSize(texture, texture.ResidentLevel);
+		if (m_stats.ResidentBytes + growth <= m_stats.Budget)
+		{
+			StartUpload(candidate, texture.ResidentLevel - 1);
+			return false;
+		}
+
+		// Make room from textures requested less recently, never from ones as recent as this one
+		uint32_t victim = FindEvictionVictim(texture.LastRequestFrame);
+		if (victim != UINT32_MAX)
+		{
+			++m_stats.EvictionCount;
+			StartUpload(victim, m_textures[victim].ResidentLevel + 1);
+		}
+		return false;
+	}
+
+	VkDeviceSize TextureStreamer::GetChainSize(const StreamedTexture& texture, uint32_t level) const
+	{
+		VkDeviceSize size = 0;
+		for (size_t i = level; i < texture.Source.LevelSizes.size(); ++i)
+			size += texture.Source.LevelSizes[i];
+		return size;
+	}
+
+	uint32_t TextureStreamer::FindEvictionVictim(uint64_t beforeFrame) const
+	{
+		uint32_t victim = UINT32_MAX;
+		for (uint32_t i = 0; i < m_textures.size(); ++i)
+		{
+			const auto& texture = m_textures[i];
+			if (texture.ResidentLevel < texture.TailLevel && texture.LastRequestFrame < beforeFrame &&
+				(victim == UINT32_MAX || texture.LastRequestFrame < m_textures[victim].LastRequestFrame))
+				victim = i;
+		}
+
+		return victim;
+	}
+
+	void TextureStreamer::StartUpload(uint32_t texture, uint32_t level)
+	{
+		const auto& source = m_textures[texture].Source;
+		uint32_t levelCount = static_cast<uint32_t>(source.LevelData.size()) - level;
+
+		m_upload.reset(new Upload{});
+		m_upload->Texture = texture;
+		m_upload->Level = level;
+		m_upload->IsSubmitted = false;
+
+		VkDeviceSize stagingSize = 0;
+		m_upload->LevelOffsets.resize(levelCount);
+		for (uint32_t i = 0; i < levelCount; ++i)
+		{
+			m_upload->LevelOffsets[i] = stagingSize;
+			stagingSize += (source.LevelSizes[level + i] + kTextureLevelAlignment - 1) / kTextureLevelAlignment * kTextureLevelAlignment;
+		}
+
+		m_upload->StagingBuffer = CreateBuffer(m_device, stagingSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
+		if (m_upload->StagingBuffer == VK_NULL_HANDLE)
+			throw std::runtime_error("\nVULKAN ERROR : Failed to create staging buffer to stream TEXTURE !\n");
+		m_upload->StagingMemory = m_allocator->AllocateBuffer(m_upload->StagingBuffer,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, MemoryCategory::Staging);
+		uint8_t* data = m_upload->StagingMemory.MappedData;
+
+		// Reading levels is what touches the disk, keep it off the render thread
+		auto levelData = source.LevelData.data() + level;
+		auto levelSizes = source.LevelSizes.data() + level;
+		auto levelOffsets = m_upload->LevelOffsets.data();
+		m_upload->LevelCopy = std::async(std::launch::async, [=]()
+		{
+			for (uint32_t i = 0; i < levelCount; ++i)
+				memcpy(data + levelOffsets[i], levelData[i], levelSizes[i]);
+		});
+
+		VkExtent3D extent{ std::max(1u, source.Extent.width >> level), std::max(1u, source.Extent.height >> level), 1 };
+		AllocateImage2D(*m_allocator, m_device, extent, source.Format, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+			levelCount, VK_SAMPLE_COUNT_1_BIT, MemoryCategory::Texture, &m_upload->Image, &m_upload->Memory);
+		m_upload->View = CreateImageView2D(m_device, m_upload->Image, source.Format, VK_IMAGE_ASPECT_COLOR_BIT, levelCount);
+	}
+
+	void TextureStreamer::SubmitUpload()
+	{
+		const auto& source = m_textures[m_upload->Texture].Source;
+		uint32_t levelCount = static_cast<uint32_t>(m_upload->LevelOffsets.size());
+		VkExtent3D extent{ std::max(1u, source.Extent.width >> m_upload->Level), std::max(1u, source.Extent.height >> m_upload->Level), 1 };
+
+		VkCommandBufferBeginInfo beginInfo{};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+		vkBeginCommandBuffer(m_cmdBuffer, &beginInfo);
+		TransitionImageLayout(m_cmdBuffer, m_upload->Image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, levelCount);
+		CopyBufferToImageMipLevels(m_cmdBuffer, extent, m_upload->LevelOffsets, m_upload->StagingBuffer, m_upload->Image);
+
+		// Copy runs beside rendering, the graphics queue only takes the finished image over
+		if (m_transferFamilyIndex != m_graphicsFamilyIndex)
+		{
+			vkBeginCommandBuffer(m_acquireCmdBuffer, &beginInfo);
+			TransferImageOwnership(m_cmdBuffer, m_acquireCmdBuffer, m_upload->Image, levelCount,
+				VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+				m_transferFamilyIndex, m_graphicsFamilyIndex, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+			vkEndCommandBuffer(m_cmdBuffer);
+			vkEndCommandBuffer(m_acquireCmdBuffer);
+			SubmitWithOwnershipTransfer(m_transferQueue, m_cmdBuffer, m_graphicsQueue, m_acquireCmdBuffer, m_acquireSemaphore, m_uploadFence);
+		}
+		else
+		{
+			TransitionImageLayout(m_cmdBuffer, m_upload->Image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, levelCount);
+			vkEndCommandBuffer(m_cmdBuffer);
+
+			VkSubmitInfo submitInfo{};
+			submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+			submitInfo.commandBufferCount = 1;
+			submitInfo.pCommandBuffers = &m_cmdBuffer;
+			if (vkQueueSubmit(m_graphicsQueue, 1, &submitInfo, m_uploadFence) != VK_SUCCESS)
+				throw std::runtime_error("\nVULKAN ERROR : Failed to submit texture streaming upload !\n");
+		}
+
+		m_upload->IsSubmitted = true;
+	}
+
+	void TextureStreamer::FinishUpload()
+	{
+		auto& texture = m_textures[m_upload->Texture];
+
+		if (texture.Image != VK_NULL_HANDLE)
+			m_retiredImages.push_back({ texture.Image, texture.Memory, texture.View, m_frame + m_framesInFlight });
+
+		if (texture.Image != VK_NULL_HANDLE && m_upload->Level < texture.ResidentLevel)
+			++m_stats.UploadCount;
+		m_stats.ResidentBytes -= texture.Image != VK_NULL_HANDLE ? GetChainSize(texture, texture.ResidentLevel) : 0;
+		m_stats.ResidentBytes += GetChainSize(texture, m_upload->Level);
+
+		texture.Image = m_upload->Image;
+		texture.Memory = m_upload->Memory;
+		texture.View = m_upload->View;
+		texture.ResidentLevel = m_upload->Level;
+		++texture.Version;
+
+		vkDestroyBuffer(m_device, m_upload->StagingBuffer, nullptr);
+		m_allocator->Free(m_upload->StagingMemory);
+		vkResetFences(m_device, 1, &m_uploadFence);
+		m_upload.reset();
+	}
+}
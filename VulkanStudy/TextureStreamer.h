@@ -0,0 +1,132 @@
+#pragma once
+#include "VkUtils.h"
+#include "DeviceAllocator.h"
+
+#include <future>
+#include <memory>
+
+namespace VkUtils
+{
+	// Mip levels in staging buffers start at multiples of this, a multiple of every supported block size
+	constexpr VkDeviceSize kTextureLevelAlignment = 16;
+	// Smallest levels made resident as soon as a texture is added, before anything is drawn with it
+	constexpr VkDeviceSize kInitialResidentBytes = 64 * 1024;
+
+	// Full mip chain of a streamed texture, largest level first
+	// Level data is read again every time residency changes, it must stay valid until the streamer is destroyed
+	struct StreamedTextureSource
+	{
+		VkFormat Format;
+		VkExtent3D Extent;
+		std::vector<const void*> LevelData;
+		std::vector<VkDeviceSize> LevelSizes;
+	};
+
+	struct TextureStreamingStats
+	{
+		VkDeviceSize ResidentBytes = 0;		// level bytes of every resident chain
+		VkDeviceSize Budget = 0;
+		uint32_t UploadCount = 0;			// finer levels streamed in
+		uint32_t EvictionCount = 0;			// finest levels dropped to stay in budget
+	};
+
+	// Keep the finest mip levels each texture needs resident, within a memory budget
+	// A texture's image only holds its resident levels : its first level is the finest resident one, so memory really
+	// shrinks on eviction and sampling never reaches missing levels. Residency changes build a new image in the
+	// background (level copy on a worker thread, upload on the queue with its own fence), the old one is destroyed
+	// once the frames that may still sample it are done.
+	// Copies run on the transfer queue if the device has one, the graphics queue then only acquires the new image.
+	class TextureStreamer
+	{
+	public:
+		// framesInFlight : frames the caller may have queued at once
+		// Pass the graphics queue as transfer queue too if the device has no transfer only family
+		void Init(DeviceAllocator& allocator, VkDevice device, VkQueue graphicsQueue, uint32_t graphicsFamilyIndex,
+			VkQueue transferQueue, uint32_t transferFamilyIndex, VkDeviceSize budget, uint32_t framesInFlight);
+		void Destroy();
+
+		// Levels up to kInitialResidentBytes are uploaded before returning, finer ones stream in once requested
+		uint32_t AddTexture(const StreamedTextureSource& source);
+
+		// Texture is drawn this frame and would use level and the coarser ones
+		void RequestLevel(uint32_t texture, uint32_t level);
+
+		// Call once per frame, after waiting the frame's fence : destroy retired images, finish a completed upload
+		// and start the next one, evicting least recently requested levels when over budget
+		// Return true if an image view changed, descriptors using it must be rewritten before their next use
+		bool Update();
+
+		VkImageView GetImageView(uint32_t texture) const { return m_textures[texture].View; }
+		uint32_t GetMipLevels(uint32_t texture) const { return static_cast<uint32_t>(m_textures[texture].Source.LevelData.size()); }
+		// Finest resident level, the image view's level 0
+		uint32_t GetResidentLevel(uint32_t texture) const { return m_textures[texture].ResidentLevel; }
+		// Incremented every time the texture's image view is replaced
+		uint32_t GetVersion(uint32_t texture) const { return m_textures[texture].Version; }
+		const TextureStreamingStats& GetStats() const { return m_stats; }
+	private:
+		struct StreamedTexture
+		{
+			StreamedTextureSource Source;
+			VkImage Image;
+			DeviceAllocation Memory;
+			VkImageView View;
+			uint32_t ResidentLevel;
+			uint32_t TailLevel;				// never evicted past this one
+			uint32_t RequestedLevel;
+			uint64_t LastRequestFrame;
+			uint32_t Version;
+		};
+
+		struct RetiredImage
+		{
+			VkImage Image;
+			DeviceAllocation Memory;
+			VkImageView View;
+			uint64_t ReleaseFrame;
+		};
+
+		// New image holding levels [Level, mip count) of one texture
+		struct Upload
+		{
+			uint32_t Texture;
+			uint32_t Level;
+			VkBuffer StagingBuffer;
+			DeviceAllocation StagingMemory;
+			std::vector<VkDeviceSize> LevelOffsets;
+			std::future<void> LevelCopy;
+			bool IsSubmitted;
+			VkImage Image;
+			DeviceAllocation Memory;
+			VkImageView View;
+		};
+
+		VkDeviceSize GetChainSize(const StreamedTexture& texture, uint32_t level) const;
+		// Least recently requested texture with an evictable level, older than beforeFrame. UINT32_MAX if none
+		uint32_t FindEvictionVictim(uint64_t beforeFrame) const;
+
+		void StartUpload(uint32_t texture, uint32_t level);
+		void SubmitUpload();
+		void FinishUpload();
+
+		DeviceAllocator* m_allocator = nullptr;
+		VkDevice m_device = VK_NULL_HANDLE;
+		VkQueue m_graphicsQueue = VK_NULL_HANDLE;
+		VkQueue m_transferQueue = VK_NULL_HANDLE;
+		uint32_t m_graphicsFamilyIndex = 0;
+		uint32_t m_transferFamilyIndex = 0;
+		VkCommandPool m_cmdPool = VK_NULL_HANDLE;			// transfer family
+		VkCommandBuffer m_cmdBuffer = VK_NULL_HANDLE;
+		// Ownership acquire on the graphics queue, only with a transfer queue
+		VkCommandPool m_acquireCmdPool = VK_NULL_HANDLE;
+		VkCommandBuffer m_acquireCmdBuffer = VK_NULL_HANDLE;
+		VkSemaphore m_acquireSemaphore = VK_NULL_HANDLE;
+		VkFence m_uploadFence = VK_NULL_HANDLE;
+		uint32_t m_framesInFlight = 0;
+		uint64_t m_frame = 0;
+
+		std::vector<StreamedTexture> m_textures;
+		std::vector<RetiredImage> m_retiredImages;
+		std::unique_ptr<Upload> m_upload;
+		TextureStreamingStats m_stats;
+	};
+}
@@ -0,0 +1,61 @@
+#include "UniformRing.h"
+
+#include <stdexcept>
+
+namespace
+{
+	VkDeviceSize AlignUp(VkDeviceSize value, VkDeviceSize alignment)
+	{
+		return (value + alignment - 1) / alignment * alignment;
+	}
+}
+
+namespace VkUtils
+{
+	void UniformRing::Init(DeviceAllocator& allocator, VkPhysicalDevice physicalDevice, VkDevice device, VkDeviceSize frameSize, uint32_t frameCount)
+	{
+		m_device = device;
+		m_allocator = &allocator;
+
+		VkPhysicalDeviceProperties properties{};
+		vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+		m_alignment = properties.limits.minUniformBufferOffsetAlignment;
+		// Regions start aligned too
+		m_frameSize = AlignUp(frameSize, m_alignment);
+
+		m_buffer = CreateBuffer(m_device, m_frameSize * frameCount, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT);
+		if (m_buffer == VK_NULL_HANDLE)
+			throw std::runtime_error("\nVULKAN ERROR : Failed to create uniform ring buffer !\n");
+		m_memory = m_allocator->AllocateBuffer(m_buffer, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			MemoryCategory::Uniform);
+
+		BeginFrame(0);
+	}
+
+	void UniformRing::Destroy()
+	{
+		if (m_device == VK_NULL_HANDLE)
+			return;
+
+		vkDestroyBuffer(m_device, m_buffer, nullptr);
+		m_allocator->Free(m_memory);
+		m_device = VK_NULL_HANDLE;
+	}
+
+	void UniformRing::BeginFrame(uint32_t frame)
+	{
+		m_frame = frame;
+		m_head = m_frameSize * frame;
+	}
+
+	uint32_t UniformRing::Allocate(VkDeviceSize size, void** ppData)
+	{
+		VkDeviceSize offset = m_head;
+		if (offset + size > m_frameSize * (m_frame + 1))
+			throw std::runtime_error("\nERROR : Uniform ring frame is full !\n");
+
+		m_head = AlignUp(offset + size, m_alignment);
+		*ppData = m_memory.MappedData + offset;
+		return static_cast<uint32_t>(offset);
+	}
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include "VkUtils.h"
+#include "DeviceAllocator.h"
+
+#include <cstring>
+
+namespace VkUtils
+{
+	// One persistently mapped uniform buffer split in a region per frame, bound once as a dynamic uniform buffer
+	// Each frame bumps allocations through its region from the start, the dynamic offset of an allocation selects
+	// its data at bind time. A region is only rewritten once the frame that used it is done, the caller's fences
+	// guarantee that : frame indices must match the command buffers waited for.
+	// Nothing is mapped or unmapped after Init, memory is host coherent so nothing is flushed either.
+	class UniformRing
+	{
+	public:
+		// frameSize : bytes each frame may allocate, frameCount : regions, one per frame recorded at once
+		void Init(DeviceAllocator& allocator, VkPhysicalDevice physicalDevice, VkDevice device, VkDeviceSize frameSize, uint32_t frameCount);
+		void Destroy();
+
+		// Start allocating from the frame's region again, its previous data must not be in use anymore
+		void BeginFrame(uint32_t frame);
+		// Return the dynamic offset of size bytes, aligned for uniform buffer bindings. Throw when the region is full
+		uint32_t Allocate(VkDeviceSize size, void** ppData);
+		// Copy data to a new allocation, return its dynamic offset
+		template<typename T>
+		uint32_t Push(const T& data);
+
+		// Dynamic offset the first allocation of frame gets
+		uint32_t GetFrameOffset(uint32_t frame) const { return static_cast<uint32_t>(frame * m_frameSize); }
+		VkBuffer GetBuffer() const { return m_buffer; }
+		// Bytes allocated in the current frame
+		VkDeviceSize GetFrameUsage() const { return m_head - m_frameSize * m_frame; }
+	private:
+		VkDevice m_device = VK_NULL_HANDLE;
+		DeviceAllocator* m_allocator = nullptr;
+		VkBuffer m_buffer = VK_NULL_HANDLE;
+		DeviceAllocation m_memory;
+		VkDeviceSize m_alignment = 0;
+		VkDeviceSize m_frameSize = 0;
+		uint32_t m_frame = 0;
+		VkDeviceSize m_head = 0;
+	};
+
+	template<typename T>
+	uint32_t UniformRing::Push(const T& data)
+	{
+		void* pData = nullptr;
+		uint32_t offset = Allocate(sizeof(T), &pData);
+		memcpy(pData, &data, sizeof(T));
+		return offset;
+	}
+}
@@ -0,0 +1,337 @@
+#include "UploadManager.h"
+
+#include <cstring>
+#include <stdexcept>
+
+namespace
+{
+	uint64_t AlignUp(uint64_t value, uint64_t alignment)
+	{
+		return (value + alignment - 1) / alignment * alignment;
+	}
+}
+
+namespace VkUtils
+{
+	void UploadManager::Init(DeviceAllocator& allocator, VkDevice device, VkQueue graphicsQueue, uint32_t graphicsFamilyIndex,
+		VkQueue transferQueue, uint32_t transferFamilyIndex, VkDeviceSize ringSize)
+	{
+		m_allocator = &allocator;
+		m_device = device;
+		m_graphicsQueue = graphicsQueue;
+		m_transferQueue = transferQueue;
+		m_graphicsFamilyIndex = graphicsFamilyIndex;
+		m_transferFamilyIndex = transferFamilyIndex;
+		// Multiple of the alignment, so aligned positions stay aligned once wrapped
+		m_ringSize = AlignUp(ringSize, kUploadAlignment);
+
+		VkCommandPoolCreateInfo poolCreateInfo{};
+		poolCreateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+		poolCreateInfo.queueFamilyIndex = m_transferFamilyIndex;
+		poolCreateInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT | VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+		if (vkCreateCommandPool(m_device, &poolCreateInfo, nullptr, &m_cmdPool) != VK_SUCCESS)
+			throw std::runtime_error("\nVULKAN ERROR : Failed to create upload command pool !\n");
+
+		if (HasTransferQueue())
+		{
+			poolCreateInfo.queueFamilyIndex = m_graphicsFamilyIndex;
+			if (vkCreateCommandPool(m_device, &poolCreateInfo, nullptr, &m_acquireCmdPool) != VK_SUCCESS)
+				throw std::runtime_error("\nVULKAN ERROR : Failed to create upload acquire command pool !\n");
+		}
+
+		m_ringBuffer = CreateBuffer(m_device, m_ringSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
+		if (m_ringBuffer == VK_NULL_HANDLE)
+			throw std::runtime_error("\nVULKAN ERROR : Failed to create staging ring buffer !\n");
+		// Mapped by the allocator for the manager's whole life
+		m_ringAllocation = m_allocator->AllocateBuffer(m_ringBuffer, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			MemoryCategory::Staging);
+		m_ringData = m_ringAllocation.MappedData;
+	}
+
+	void UploadManager::Destroy()
+	{
+		if (m_device == VK_NULL_HANDLE)
+			return;
+
+		// Recorded work nobody waited for is still submitted, its destinations may be in use
+		Wait(GetCurrentTicket());
+
+		for (const auto& batch : m_freeBatches)
+		{
+			vkDestroyFence(m_device, batch.Fence, nullptr);
+			vkDestroySemaphore(m_device, batch.AcquireSemaphore, nullptr);
+		}
+		m_freeBatches.clear();
+
+		vkDestroyBuffer(m_device, m_ringBuffer, nullptr);
+		m_allocator->Free(m_ringAllocation);
+		// Frees every command buffer
+		vkDestroyCommandPool(m_device, m_cmdPool, nullptr);
+		vkDestroyCommandPool(m_device, m_acquireCmdPool, nullptr);
+		m_device = VK_NULL_HANDLE;
+	}
+
+	void UploadManager::UploadBuffer(VkBuffer dstBuffer, VkDeviceSize dstOffset, const void* data, VkDeviceSize size)
+	{
+		auto staging = AllocateStaging(size);
+		memcpy(staging.Data, data, size);
+
+		VkBufferCopy bufferCopy{};
+		bufferCopy.srcOffset = staging.Offset;
+		bufferCopy.dstOffset = dstOffset;
+		bufferCopy.size = size;
+		auto& batch = GetOpenBatch();
+		vkCmdCopyBuffer(batch.CmdBuffer, staging.Buffer, dstBuffer, 1, &bufferCopy);
+
+		// Usage of the buffer is unknown, every later read is covered
+		if (HasTransferQueue())
+			TransferBufferOwnership(batch.CmdBuffer, batch.AcquireCmdBuffer, dstBuffer, dstOffset, size, m_transferFamilyIndex, m_graphicsFamilyIndex,
+				VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_ACCESS_MEMORY_READ_BIT);
+
+		++m_stats.UploadCount;
+		m_stats.UploadedBytes += size;
+	}
+
+	void UploadManager::UploadImage(VkImage image, VkExtent3D extent, uint32_t mipLevels,
+		const std::vector<const void*>& levelData, const std::vector<VkDeviceSize>& levelSizes)
+	{
+		// Whole chain in one allocation, levels at aligned offsets
+		std::vector<VkDeviceSize> levelOffsets(levelData.size());
+		VkDeviceSize stagingSize = 0;
+		for (size_t level = 0; level < levelData.size(); ++level)
+		{
+			levelOffsets[level] = stagingSize;
+			stagingSize += AlignUp(levelSizes[level], kUploadAlignment);
+		}
+
+		auto staging = AllocateStaging(stagingSize);
+		for (size_t level = 0; level < levelData.size(); ++level)
+		{
+			memcpy(staging.Data + levelOffsets[level], levelData[level], levelSizes[level]);
+			levelOffsets[level] += staging.Offset;
+		}
+
+		// Whole levels are copied, so the transfer queue's image granularity never matters
+		auto& batch = GetOpenBatch();
+		TransitionImageLayout(batch.CmdBuffer, image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, mipLevels);
+		CopyBufferToImageMipLevels(batch.CmdBuffer, extent, levelOffsets, staging.Buffer, image);
+
+		// Blits need a graphics queue
+		bool isGeneratingMips = levelData.size() < mipLevels;
+		if (HasTransferQueue())
+		{
+			if (isGeneratingMips)
+				TransferImageOwnership(batch.CmdBuffer, batch.AcquireCmdBuffer, image, mipLevels, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+					m_transferFamilyIndex, m_graphicsFamilyIndex, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT);
+			else
+				TransferImageOwnership(batch.CmdBuffer, batch.AcquireCmdBuffer, image, mipLevels, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+					m_transferFamilyIndex, m_graphicsFamilyIndex, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+		}
+		else if (!isGeneratingMips)
+			TransitionImageLayout(batch.CmdBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, mipLevels);
+
+		if (isGeneratingMips)
+			GenerateMipmaps(GetGraphicsCommandBuffer(batch), image, extent, mipLevels);
+
+		++m_stats.UploadCount;
+		m_stats.UploadedBytes += stagingSize;
+	}
+
+	VkCommandBuffer UploadManager::GetCommandBuffer()
+	{
+		return GetGraphicsCommandBuffer(GetOpenBatch());
+	}
+
+	uint64_t UploadManager::Submit()
+	{
+		if (!m_isBatchOpen)
+			return m_submittedTicket;
+
+		if (HasTransferQueue())
+		{
+			vkEndCommandBuffer(m_openBatch.CmdBuffer);
+			vkEndCommandBuffer(m_openBatch.AcquireCmdBuffer);
+			SubmitWithOwnershipTransfer(m_transferQueue, m_openBatch.CmdBuffer, m_graphicsQueue, m_openBatch.AcquireCmdBuffer,
+				m_openBatch.AcquireSemaphore, m_openBatch.Fence);
+		}
+		else
+		{
+			// Copied buffers' usage is unknown, every later read is covered
+			VkMemoryBarrier barrier{};
+			barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+			barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+			vkCmdPipelineBarrier(m_openBatch.CmdBuffer,
+				VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+				0,
+				1, &barrier,
+				0, nullptr,
+				0, nullptr);
+			vkEndCommandBuffer(m_openBatch.CmdBuffer);
+
+			VkSubmitInfo submitInfo{};
+			submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+			submitInfo.commandBufferCount = 1;
+			submitInfo.pCommandBuffers = &m_openBatch.CmdBuffer;
+			if (vkQueueSubmit(m_graphicsQueue, 1, &submitInfo, m_openBatch.Fence) != VK_SUCCESS)
+				throw std::runtime_error("\nVULKAN ERROR : Failed to submit upload batch !\n");
+		}
+
+		m_openBatch.RingEnd = m_ringHead;
+		m_submittedTicket = m_openBatch.Ticket;
+		m_submittedBatches.push_back(std::move(m_openBatch));
+		m_isBatchOpen = false;
+		++m_stats.SubmitCount;
+
+		return m_submittedTicket;
+	}
+
+	bool UploadManager::IsComplete(uint64_t ticket)
+	{
+		Update();
+		return ticket <= m_completedTicket;
+	}
+
+	void UploadManager::Wait(uint64_t ticket)
+	{
+		if (ticket > m_submittedTicket)
+			Submit();
+		while (m_completedTicket < ticket)
+			WaitOldestBatch();
+	}
+
+	void UploadManager::Update()
+	{
+		while (!m_submittedBatches.empty() && vkGetFenceStatus(m_device, m_submittedBatches.front().Fence) == VK_SUCCESS)
+			RetireOldestBatch();
+	}
+
+	UploadManager::StagingAllocation UploadManager::AllocateStaging(VkDeviceSize size)
+	{
+		// Bigger than the ring : own buffer, destroyed with the batch
+		if (size > m_ringSize)
+		{
+			StagingAllocation allocation{};
+			allocation.Buffer = CreateBuffer(m_device, size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
+			if (allocation.Buffer == VK_NULL_HANDLE)
+				throw std::runtime_error("\nVULKAN ERROR : Failed to create dedicated staging buffer !\n");
+			auto memory = m_allocator->AllocateBuffer(allocation.Buffer, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				MemoryCategory::Staging);
+			allocation.Data = memory.MappedData;
+
+			auto& batch = GetOpenBatch();
+			batch.DedicatedBuffers.push_back(allocation.Buffer);
+			batch.DedicatedAllocations.push_back(memory);
+			++m_stats.DedicatedStagingCount;
+			return allocation;
+		}
+
+		bool isRingFull = false;
+		while (true)
+		{
+			// Allocations never wrap, the end of the ring is skipped instead
+			uint64_t start = AlignUp(m_ringHead, kUploadAlignment);
+			if (start % m_ringSize + size > m_ringSize)
+				start = AlignUp(start, m_ringSize);
+			// Nothing in use, skipped bytes are free too
+			if (m_ringHead == m_ringTail)
+				m_ringTail = start;
+
+			if (start + size - m_ringTail <= m_ringSize)
+			{
+				m_ringHead = start + size;
+				if (isRingFull)
+					++m_stats.RingFullCount;
+				return { m_ringBuffer, start % m_ringSize, m_ringData + start % m_ringSize };
+			}
+
+			// Only the open batch holds the ring, it has to complete first
+			if (m_submittedBatches.empty())
+				Submit();
+			WaitOldestBatch();
+			isRingFull = true;
+		}
+	}
+
+	UploadManager::Batch& UploadManager::GetOpenBatch()
+	{
+		if (m_isBatchOpen)
+			return m_openBatch;
+
+		Update();
+		if (!m_freeBatches.empty())
+		{
+			m_openBatch = std::move(m_freeBatches.back());
+			m_freeBatches.pop_back();
+		}
+		else
+		{
+			m_openBatch = {};
+
+			VkCommandBufferAllocateInfo allocInfo{};
+			allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+			allocInfo.commandPool = m_cmdPool;
+			allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+			allocInfo.commandBufferCount = 1;
+			if (vkAllocateCommandBuffers(m_device, &allocInfo, &m_openBatch.CmdBuffer) != VK_SUCCESS)
+				throw std::runtime_error("\nVULKAN ERROR : Failed to allocate upload command buffer !\n");
+
+			VkFenceCreateInfo fenceCreateInfo{};
+			fenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+			if (vkCreateFence(m_device, &fenceCreateInfo, nullptr, &m_openBatch.Fence) != VK_SUCCESS)
+				throw std::runtime_error("\nVULKAN ERROR : Failed to create upload fence !\n");
+
+			if (HasTransferQueue())
+			{
+				allocInfo.commandPool = m_acquireCmdPool;
+				if (vkAllocateCommandBuffers(m_device, &allocInfo, &m_openBatch.AcquireCmdBuffer) != VK_SUCCESS)
+					throw std::runtime_error("\nVULKAN ERROR : Failed to allocate upload acquire command buffer !\n");
+
+				VkSemaphoreCreateInfo semaphoreCreateInfo{};
+				semaphoreCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+				if (vkCreateSemaphore(m_device, &semaphoreCreateInfo, nullptr, &m_openBatch.AcquireSemaphore) != VK_SUCCESS)
+					throw std::runtime_error("\nVULKAN ERROR : Failed to create upload semaphore !\n");
+			}
+		}
+		m_openBatch.Ticket = m_submittedTicket + 1;
+
+		VkCommandBufferBeginInfo beginInfo{};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+		vkBeginCommandBuffer(m_openBatch.CmdBuffer, &beginInfo);
+		if (HasTransferQueue())
+			vkBeginCommandBuffer(m_openBatch.AcquireCmdBuffer, &beginInfo);
+
+		m_isBatchOpen = true;
+		return m_openBatch;
+	}
+
+	void UploadManager::WaitOldestBatch()
+	{
+		vkWaitForFences(m_device, 1, &m_submittedBatches.front().Fence, VK_TRUE, UINT64_MAX);
+		RetireOldestBatch();
+	}
+
+	void UploadManager::RetireOldestBatch()
+	{
+		Batch batch = std::move(m_submittedBatches.front());
+		m_submittedBatches.pop_front();
+
+		m_ringTail = batch.RingEnd;
+		m_completedTicket = batch.Ticket;
+
+		for (size_t i = 0; i < batch.DedicatedBuffers.size(); ++i)
+		{
+			vkDestroyBuffer(m_device, batch.DedicatedBuffers[i], nullptr);
+			m_allocator->Free(batch.DedicatedAllocations[i]);
+		}
+		batch.DedicatedBuffers.clear();
+		batch.DedicatedAllocations.clear();
+
+		vkResetFences(m_device, 1, &batch.Fence);
+		vkResetCommandBuffer(batch.CmdBuffer, 0);
+		if (HasTransferQueue())
+			vkResetCommandBuffer(batch.AcquireCmdBuffer, 0);
+		m_freeBatches.push_back(std::move(batch));
+	}
+}
@@ -0,0 +1,111 @@
+#pragma once
+#include "VkUtils.h"
+#include "DeviceAllocator.h"
+
+#include <deque>
+
+namespace VkUtils
+{
+	// Staging allocations start at multiples of this, a multiple of every texel block size and of the 4 bytes buffer copies need
+	constexpr VkDeviceSize kUploadAlignment = 16;
+
+	struct UploadStats
+	{
+		uint32_t UploadCount = 0;
+		VkDeviceSize UploadedBytes = 0;
+		uint32_t SubmitCount = 0;			// batches submitted, every upload of a batch shares one fence
+		uint32_t RingFullCount = 0;			// allocations that waited for older batches to free the ring
+		uint32_t DedicatedStagingCount = 0;	// uploads too big for the ring, staged in their own buffer
+	};
+
+	// Record uploads from a persistently mapped staging ring into batches, one command buffer and fence per batch
+	// Data is copied to staging memory right away, so the caller's memory can be released once the call returns.
+	// Nothing waits for the queue : callers get a ticket and query or wait for it before using the destination.
+	// Command buffers and fences of completed batches are reused. Not thread safe, call from the thread owning the queues.
+	// With a transfer family apart from the graphics one, copies run on the transfer queue beside rendering : the batch releases
+	// its destinations there, a graphics queue command buffer acquires them and does what copy engines can't (mip blits).
+	class UploadManager
+	{
+	public:
+		// Pass the graphics queue as transfer queue too if the device has no transfer only family
+		void Init(DeviceAllocator& allocator, VkDevice device, VkQueue graphicsQueue, uint32_t graphicsFamilyIndex,
+			VkQueue transferQueue, uint32_t transferFamilyIndex, VkDeviceSize ringSize);
+		// Wait for every batch, then destroy them
+		void Destroy();
+
+		void UploadBuffer(VkBuffer dstBuffer, VkDeviceSize dstOffset, const void* data, VkDeviceSize size);
+		// Copy levelData to the first mip levels of image, blit the remaining ones up to mipLevels, leave it in shader read layout
+		// Image content is discarded, it needs transfer src usage when levels are generated
+		void UploadImage(VkImage image, VkExtent3D extent, uint32_t mipLevels,
+			const std::vector<const void*>& levelData, const std::vector<VkDeviceSize>& levelSizes);
+
+		// Graphics queue command buffer of the open batch, runs after its copies
+		VkCommandBuffer GetCommandBuffer();
+		bool HasTransferQueue() const { return m_transferFamilyIndex != m_graphicsFamilyIndex; }
+
+		// Submit the open batch, return the ticket of everything recorded so far
+		uint64_t Submit();
+		// Ticket the work recorded so far completes with, submitted or not
+		uint64_t GetCurrentTicket() const { return m_isBatchOpen ? m_submittedTicket + 1 : m_submittedTicket; }
+		bool IsComplete(uint64_t ticket);
+		// Submit the open batch if ticket is in it
+		void Wait(uint64_t ticket);
+
+		// Recycle completed batches and their staging memory, call once per frame
+		void Update();
+
+		const UploadStats& GetStats() const { return m_stats; }
+	private:
+		struct Batch
+		{
+			VkCommandBuffer CmdBuffer;		// transfer queue
+			VkCommandBuffer AcquireCmdBuffer;	// graphics queue, only with a transfer queue
+			VkSemaphore AcquireSemaphore;	// signaled by CmdBuffer, waited by AcquireCmdBuffer
+			VkFence Fence;
+			uint64_t Ticket;
+			uint64_t RingEnd;				// ring position freed once the batch completes
+			std::vector<VkBuffer> DedicatedBuffers;
+			std::vector<DeviceAllocation> DedicatedAllocations;
+		};
+
+		struct StagingAllocation
+		{
+			VkBuffer Buffer;
+			VkDeviceSize Offset;
+			uint8_t* Data;
+		};
+
+		// Wait for older batches when the ring is full
+		StagingAllocation AllocateStaging(VkDeviceSize size);
+		Batch& GetOpenBatch();
+		// Command buffer running after the batch's copies on the graphics queue
+		VkCommandBuffer GetGraphicsCommandBuffer(const Batch& batch) const { return HasTransferQueue() ? batch.AcquireCmdBuffer : batch.CmdBuffer; }
+		void WaitOldestBatch();
+		void RetireOldestBatch();
+
+		DeviceAllocator* m_allocator = nullptr;
+		VkDevice m_device = VK_NULL_HANDLE;
+		VkQueue m_graphicsQueue = VK_NULL_HANDLE;
+		VkQueue m_transferQueue = VK_NULL_HANDLE;
+		uint32_t m_graphicsFamilyIndex = 0;
+		uint32_t m_transferFamilyIndex = 0;
+		VkCommandPool m_cmdPool = VK_NULL_HANDLE;			// transfer family
+		VkCommandPool m_acquireCmdPool = VK_NULL_HANDLE;	// graphics family, only with a transfer queue
+
+		VkBuffer m_ringBuffer = VK_NULL_HANDLE;
+		DeviceAllocation m_ringAllocation;
+		uint8_t* m_ringData = nullptr;
+		VkDeviceSize m_ringSize = 0;
+		// Ever growing positions, modulo m_ringSize in the buffer : [m_ringTail, m_ringHead) is in use
+		uint64_t m_ringHead = 0;
+		uint64_t m_ringTail = 0;
+
+		Batch m_openBatch{};
+		bool m_isBatchOpen = false;
+		std::deque<Batch> m_submittedBatches;
+		std::vector<Batch> m_freeBatches;
+		uint64_t m_submittedTicket = 0;
+		uint64_t m_completedTicket = 0;
+		UploadStats m_stats;
+	};
+}
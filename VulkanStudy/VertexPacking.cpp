@@ -0,0 +1,164 @@
+#include "VertexPacking.h"
+
+#include <algorithm>
+#include <numeric>
+#include <cstring>
+#include <cmath>
+
+namespace
+{
+	uint16_t QuantizeUnorm16(float value)
+	{
+		return static_cast<uint16_t>(std::min(std::max(value, 0.0f), 1.0f) * 65535.0f + 0.5f);
+	}
+
+	int16_t QuantizeSnorm16(float value)
+	{
+		return static_cast<int16_t>(std::round(std::min(std::max(value, -1.0f), 1.0f) * 32767.0f));
+	}
+
+	// Project the unit sphere on an octahedron, then unfold it into [-1, 1]^2
+	glm::vec2 EncodeOctahedral(const glm::vec3& normal)
+	{
+		float sum = std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z);
+		if (sum == 0.0f)
+			return glm::vec2(0.0f);
+
+		glm::vec2 result(normal.x / sum, normal.y / sum);
+		if (normal.z < 0.0f)
+		{
+			glm::vec2 folded((1.0f - std::abs(result.y)) * (result.x >= 0.0f ? 1.0f : -1.0f),
+				(1.0f - std::abs(result.x)) * (result.y >= 0.0f ? 1.0f : -1.0f));
+			result = folded;
+		}
+
+		return result;
+	}
+
+	// Smooth normal of every vertex, accumulated over all vertices sharing its position
+	std::vector<glm::vec3> ComputeNormals(const std::vector<VkUtils::Vertex>& vertices, const std::vector<uint32_t>& indices,
+		const std::vector<VkUtils::SubMesh>& subMeshes)
+	{
+		// Group vertices with identical positions
+		std::vector<uint32_t> order(vertices.size());
+		std::iota(order.begin(), order.end(), 0);
+		auto lessPosition = [&](uint32_t a, uint32_t b)
+		{
+			const auto& pa = vertices[a].Pos;
+			const auto& pb = vertices[b].Pos;
+			if (pa.x != pb.x) return pa.x < pb.x;
+			if (pa.y != pb.y) return pa.y < pb.y;
+			return pa.z < pb.z;
+		};
+		std::sort(order.begin(), order.end(), lessPosition);
+
+		std::vector<uint32_t> positionGroups(vertices.size());
+		uint32_t groupCount = 0;
+		for (size_t i = 0; i < order.size(); ++i)
+		{
+			if (i > 0 && lessPosition(order[i - 1], order[i]))
+				++groupCount;
+			positionGroups[order[i]] = groupCount;
+		}
+		++groupCount;
+
+		// Cross product length is twice the triangle area, which weights bigger triangles more
+		std::vector<glm::vec3> groupNormals(groupCount, glm::vec3(0.0f));
+		for (const auto& subMesh : subMeshes)
+		{
+			const uint32_t* subMeshIndices = indices.data() + subMesh.FirstIndex;
+			for (uint32_t i = 0; i + 2 < subMesh.IndexCount; i += 3)
+			{
+				uint32_t v0 = subMeshIndices[i + 0] + subMesh.VertexOffset;
+				uint32_t v1 = subMeshIndices[i + 1] + subMesh.VertexOffset;
+				uint32_t v2 = subMeshIndices[i + 2] + subMesh.VertexOffset;
+				glm::vec3 faceNormal = glm::cross(vertices[v1].Pos - vertices[v0].Pos, vertices[v2].Pos - vertices[v0].Pos);
+
+				groupNormals[positionGroups[v0]] += faceNormal;
+				groupNormals[positionGroups[v1]] += faceNormal;
+				groupNormals[positionGroups[v2]] += faceNormal;
+			}
+		}
+
+		std::vector<glm::vec3> normals(vertices.size());
+		for (size_t i = 0; i < vertices.size(); ++i)
+		{
+			const auto& normal = groupNormals[positionGroups[i]];
+			float length = glm::length(normal);
+			normals[i] = length > 0.0f ? normal / length : glm::vec3(0.0f, 0.0f, 1.0f);
+		}
+
+		return normals;
+	}
+}
+
+namespace VkUtils
+{
+	VertexQuantization PackVertices(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices,
+		const std::vector<SubMesh>& subMeshes, std::vector<PackedVertex>& packedVertices)
+	{
+		VertexQuantization quantization{};
+		packedVertices.resize(vertices.size());
+		if (vertices.empty())
+			return quantization;
+
+		glm::vec3 boundsMin = vertices[0].Pos;
+		glm::vec3 boundsMax = vertices[0].Pos;
+		for (const auto& vertex : vertices)
+		{
+			for (int axis = 0; axis < 3; ++axis)
+			{
+				boundsMin[axis] = std::min(boundsMin[axis], vertex.Pos[axis]);
+				boundsMax[axis] = std::max(boundsMax[axis], vertex.Pos[axis]);
+			}
+		}
+
+		glm::vec3 extent = boundsMax - boundsMin;
+		quantization.Offset = glm::vec4(boundsMin, 0.0f);
+		quantization.Scale = glm::vec4(extent, 0.0f);
+
+		auto normals = ComputeNormals(vertices, indices, subMeshes);
+
+		for (size_t i = 0; i < vertices.size(); ++i)
+		{
+			const auto& vertex = vertices[i];
+			auto& packed = packedVertices[i];
+
+			// Flat axis : every vertex sits at Offset, the quantized value doesn't matter
+			for (int axis = 0; axis < 3; ++axis)
+				packed.Pos[axis] = extent[axis] > 0.0f ? QuantizeUnorm16((vertex.Pos[axis] - boundsMin[axis]) / extent[axis]) : 0;
+			packed.Pos[3] = 0;
+
+			auto octahedral = EncodeOctahedral(normals[i]);
+			packed.Normal[0] = QuantizeSnorm16(octahedral.x);
+			packed.Normal[1] = QuantizeSnorm16(octahedral.y);
+
+			packed.TexCoord[0] = FloatToHalf(vertex.TexCoord.x);
+			packed.TexCoord[1] = FloatToHalf(vertex.TexCoord.y);
+		}
+
+		return quantization;
+	}
+
+	uint16_t FloatToHalf(float value)
+	{
+		uint32_t bits;
+		memcpy(&bits, &value, sizeof(bits));
+
+		uint32_t sign = (bits >> 16) & 0x8000;
+		uint32_t magnitude = bits & 0x7FFFFFFF;
+
+		// NaN stays NaN, infinity and everything rounding to 65520 or more become infinity
+		if (magnitude > 0x7F800000)
+			return static_cast<uint16_t>(sign | 0x7E00);
+		if (magnitude >= 0x477FF000)
+			return static_cast<uint16_t>(sign | 0x7C00);
+		// Under 2^-14, half denormals aren't worth it for UVs
+		if (magnitude < 0x38800000)
+			return static_cast<uint16_t>(sign);
+
+		// Rebias exponent from 127 to 15 and round the 13 dropped mantissa bits to nearest even
+		uint32_t rounded = magnitude - 0x38000000 + 0xFFF + ((magnitude >> 13) & 1);
+		return static_cast<uint16_t>(sign | (rounded >> 13));
+	}
+}
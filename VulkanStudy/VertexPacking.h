@@ -0,0 +1,15 @@
+#pragma once
+#include "VkUtils.h"
+
+namespace VkUtils
+{
+	// Convert vertices to PackedVertex, return what shader.vert needs to rebuild positions
+	// Normals are not stored in Vertex : they are rebuilt from the triangles, area weighted and
+	// shared by every vertex at the same position so UV seams don't split them.
+	// Only the triangles of subMeshes are used, pass the full detail ones so LODs don't bend the normals
+	VertexQuantization PackVertices(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices,
+		const std::vector<SubMesh>& subMeshes, std::vector<PackedVertex>& packedVertices);
+
+	// Round to nearest, out of range values become infinity, values under the smallest normal half become 0
+	uint16_t FloatToHalf(float value);
+}
@@ -1,10 +1,14 @@
 #include "VkApplication.h"
 
 #include <iostream>
+#include <fstream>
 #include <algorithm>
 #include <cstdint>
 #include <set>
 #include <array>
+#include <limits>
+#include <cmath>
+#include <thread>
 
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_DEPTH_ONE_TO_ZERO
@@ -12,6 +16,10 @@
 #include <glm/vec4.hpp>
 
 #include "VkUtils.h"
+#include "ObjLoader.h"
+#include "MeshOptimizer.h"
+#include "VertexPacking.h"
+#include "MeshSimplifier.h"
 
 namespace
 {
@@ -34,9 +42,75 @@ namespace
 
 const uint16_t MAX_FRAMES_IN_FLIGHT = 2;
 
+namespace
+{
+	// Built offline by AssetCooker from kModelPath and kTexturePath, ignored once they change
+	const char* kCookedPackagePath = "assets/cooked/viking_room.vkpk";
+	const char* kModelPath = "assets/models/viking_room.obj";
+	// Optional, block compressed with its mip chain by an external texture tool
+	const char* kKtx2TexturePath = "assets/models/viking_room.ktx2";
+	const char* kTexturePath = "assets/models/viking_room.png";
+	// Decoded texture is RGBA8
+	constexpr uint32_t kBytesPerPixel = 4;
+
+	// Parse model and decode texture on worker threads while Vulkan is initialized, false runs them serially
+	// at the upload stage instead, to compare time to first frame
+	constexpr bool kLoadAssetsInBackground = true;
+	// Power of two, holds every asset at once so loaders never wait for room
+	constexpr size_t kLoadedAssetQueueCapacity = 4;
+
+	// Stress test : draw this many viking rooms on a grid instead of a single one, 0 to disable
+	constexpr uint32_t kStressInstanceCount = 0;
+	// Distance between grid cells, in model bounding radii
+	constexpr float kInstanceGridSpacing = 2.5f;
+
+	// Cull instances and pick their LOD in a compute pass, draw them with one indirect call
+	// false (or a device without multi draw indirect) records one instanced draw per sub mesh on the CPU instead
+	constexpr bool kGpuDrivenRendering = true;
+	const char* kCullShaderPath = "assets/shaders/cull.spv";
+
+	// Uniform bytes each frame may write, room for many objects at the minimum offset alignment
+	constexpr VkDeviceSize kUniformRingFrameSize = 256 * 1024;
+
+	// Texture memory the streamer may keep resident
+	constexpr VkDeviceSize kTextureStreamingBudget = 64 * 1024 * 1024;
+	// Holds every startup upload at once, so they go in a single submission
+	constexpr VkDeviceSize kStagingRingSize = 32 * 1024 * 1024;
+	// Driver's compiled pipelines from earlier launches, in the working directory next to assets/
+	const char* kPipelineCachePath = "pipeline_cache.bin";
+	// Threads compiling pipelines in the background
+	constexpr uint32_t kPipelineCompileThreadCount = 2;
+
+	// Seconds between memory budget lines in debug builds
+	constexpr float kMemoryLogInterval = 5.0f;
+
+	// Most threads recording draws at once, the main one included
+	constexpr uint32_t kMaxRecordingThreads = 8;
+	// Draws recorded per thread count by the startup recording benchmark, 0 to disable
+	constexpr uint32_t kRecordingBenchmarkDrawCount = 0;
+	constexpr uint32_t kRecordingBenchmarkIterations = 20;
+
+	// Vertex format used when the model is loaded from OBJ
+	const VkUtils::VertexFormat kModelVertexFormat = VkUtils::VertexFormat::Packed;
+
+	const char* GetVertexShaderPath(VkUtils::VertexFormat format)
+	{
+		return format == VkUtils::VertexFormat::Packed ? "assets/shaders/vert_packed.spv" : "assets/shaders/vert.spv";
+	}
+
+	// Coarsest LOD whose error projects to at most this many pixels is drawn
+	constexpr float kLodPixelErrorThreshold = 1.0f;
+
+	bool FileExists(const char* fileName)
+	{
+		return std::ifstream(fileName).good();
+	}
+}
+
 
 VkApplication::VkApplication(int width, int height, const char* window_title):
-	m_screenWidth(width),m_screenHeight(height),m_title(window_title),m_currenFrame(0)
+	m_screenWidth(width),m_screenHeight(height),m_title(window_title),m_currenFrame(0),m_loadedAssets(kLoadedAssetQueueCapacity),
+	m_modelMatrix(1.0f),m_materialIndex(0),m_isGpuCulling(false),m_hasDrawIndirectCount(false),m_culledInstanceVersion(0),m_isCameraDirty(true),m_streamedTexture(UINT32_MAX)
 {
 #ifdef _DEBUG || DEBUG
 	m_enableValidationLayer = true;
@@ -47,12 +121,119 @@ VkApplication::VkApplication(int width, int height, const char* window_title):
 
 void VkApplication::Run()
 {
-	InitWindow();
-	InitVulkan();
+	m_startTime = std::chrono::high_resolution_clock::now();
+
+	StartAssetLoading();
+	try
+	{
+		InitWindow();
+		InitVulkan();
+	}
+	catch (...)
+	{
+		// Loaders use members, they must be done before the application goes away
+		JoinAssetLoaders();
+		throw;
+	}
 	MainLoop();
 	CleanUp();
 }
 
+void VkApplication::StartAssetLoading()
+{
+	// Mapping is cheap, both loaders read from it
+	if (!m_assetPackage.Open(kCookedPackagePath, kModelPath, kTexturePath))
+	{
+#ifdef _DEBUG || DEBUG
+		std::cout << "\nASSET PACKAGE : " << kCookedPackagePath << " is missing, stale or corrupted, loading the OBJ and PNG instead\n";
+#endif
+	}
+
+	if (kLoadAssetsInBackground)
+	{
+		m_modelLoader = std::thread(&VkApplication::RunAssetLoader, this, LoadedAssetType::Model, &VkApplication::LoadModelToBuffer);
+		m_textureLoader = std::thread(&VkApplication::RunAssetLoader, this, LoadedAssetType::Texture, &VkApplication::LoadTextureData);
+	}
+}
+
+void VkApplication::RunAssetLoader(LoadedAssetType type, void (VkApplication::*load)())
+{
+	auto startTime = std::chrono::high_resolution_clock::now();
+
+	LoadedAsset asset{};
+	asset.Type = type;
+	try
+	{
+		(this->*load)();
+	}
+	catch (...)
+	{
+		asset.Error = std::current_exception();
+	}
+	asset.LoadTime = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+
+	// Queue has room for every asset
+	m_loadedAssets.TryPush(asset);
+}
+
+void VkApplication::JoinAssetLoaders()
+{
+	if (m_modelLoader.joinable())
+		m_modelLoader.join();
+	if (m_textureLoader.joinable())
+		m_textureLoader.join();
+}
+
+void VkApplication::UploadLoadedAssets()
+{
+	if (!kLoadAssetsInBackground)
+	{
+		RunAssetLoader(LoadedAssetType::Model, &VkApplication::LoadModelToBuffer);
+		RunAssetLoader(LoadedAssetType::Texture, &VkApplication::LoadTextureData);
+	}
+
+#ifdef _DEBUG || DEBUG
+	auto startTime = std::chrono::high_resolution_clock::now();
+#endif
+	float loadTime = 0.0f;
+
+	for (uint32_t pendingCount = 2; pendingCount > 0;)
+	{
+		LoadedAsset asset;
+		if (!m_loadedAssets.TryPop(asset))
+		{
+			std::this_thread::yield();
+			continue;
+		}
+
+		if (asset.Error)
+		{
+			JoinAssetLoaders();
+			std::rethrow_exception(asset.Error);
+		}
+
+		loadTime += asset.LoadTime;
+		if (asset.Type == LoadedAssetType::Model)
+		{
+			CreateVertexBuffer();
+			CreateIndexBuffer();
+		}
+		else
+			CreateTexture();
+		--pendingCount;
+	}
+
+	JoinAssetLoaders();
+	// GPU copies run while the pipeline and the remaining resources are created
+	m_uploadManager.Submit();
+
+#ifdef _DEBUG || DEBUG
+	auto uploadTime = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+	std::cout << "\nASSETS LOADED : " << loadTime << " ms of loading on " << (kLoadAssetsInBackground ? "worker threads" : "the main thread")
+		<< ", upload stage took " << uploadTime << " ms including the wait for loaders\n";
+#endif
+}
+
 void VkApplication::InitWindow()
 {
 	glfwInit();
@@ -72,6 +253,15 @@ void VkApplication::InitVulkan()
 	PickVkPhysicalDevice();
 	CreateLogicalDevice();
 
+	m_pipelineCache.Init(m_mainDevice.physicalDevice, m_mainDevice.logicalDevice, kPipelineCachePath);
+#ifdef _DEBUG || DEBUG
+	if (m_pipelineCache.GetLoadedSize() > 0)
+		std::cout << "\nPIPELINE CACHE : warm, " << m_pipelineCache.GetLoadedSize() << " bytes loaded from " << kPipelineCachePath << "\n";
+	else
+		std::cout << "\nPIPELINE CACHE : cold, no cache file for this device and driver\n";
+#endif
+	m_pipelineManager.Init(m_mainDevice.logicalDevice, m_pipelineCache, kPipelineCompileThreadCount);
+
 	CreateSwapchain();
 	CreateSwapchainImageViews();
 	CreateRenderPass();
@@ -81,14 +271,13 @@ void VkApplication::InitVulkan()
 	CreateSyncObjects();
 
 	CreateDescriptorSetLayout();
-	CreateGraphicsPipeline();
-	
-	LoadModelToBuffer();
-	CreateVertexBuffer();
-	CreateIndexBuffer();
 	CreateUniformBuffer();
 
-	CreateTexture();
+	// Model and texture are uploaded as soon as their loader hands them over
+	UploadLoadedAssets();
+	// Model's vertex format decides the pipeline's vertex input and shader
+	CreateGraphicsPipeline();
+
 	CreateColorResources();
 	CreateDepthResources();
 	CreateFramebuffers();
@@ -96,15 +285,67 @@ void VkApplication::InitVulkan()
 	CreateDescriptorPool();
 	AllocateDescriptorSets();
 
-	RecordCommands();
+	CreateInstances();
+	CreateGpuCuller();
+
+	if (kRecordingBenchmarkDrawCount > 0)
+		BenchmarkRecording();
+	// Commands are recorded with each frame, draw segments only the first time and when they change
+	MarkDrawSegmentsDirty();
+
+	// Only wait for the GPU copies the first frame needs, once
+#ifdef _DEBUG || DEBUG
+	auto waitStartTime = std::chrono::high_resolution_clock::now();
+#endif
+	m_uploadManager.Wait(m_uploadManager.GetCurrentTicket());
+#ifdef _DEBUG || DEBUG
+	auto waitTime = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - waitStartTime).count();
+	const auto& uploadStats = m_uploadManager.GetStats();
+	std::cout << "\nSTARTUP UPLOADS : " << uploadStats.UploadCount << " uploads, " << uploadStats.UploadedBytes << " bytes staged in "
+		<< uploadStats.SubmitCount << " submission(s), waited " << waitTime << " ms for them\n";
+	m_allocator.PrintStats();
+	m_allocator.PrintBudget();
+#endif
+
+	// Everything is in GPU memory now, unless texture levels keep streaming from the package
+	if (m_streamedTexture == UINT32_MAX)
+		m_assetPackage.Close();
 }
 
 void VkApplication::MainLoop()
 {
+	bool isFirstFrame = true;
+#ifdef _DEBUG || DEBUG
+	auto lastMemoryLogTime = std::chrono::high_resolution_clock::now();
+#endif
 	while (!glfwWindowShouldClose(m_window))
 	{
 		glfwPollEvents();
 		RenderFrame();
+
+		if (isFirstFrame)
+		{
+			isFirstFrame = false;
+#ifdef _DEBUG || DEBUG
+			auto elapsed = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - m_startTime).count();
+			std::cout << "\nTIME TO FIRST FRAME : " << elapsed << " ms\n";
+#endif
+		}
+
+#ifdef _DEBUG || DEBUG
+		auto now = std::chrono::high_resolution_clock::now();
+		if (std::chrono::duration<float>(now - lastMemoryLogTime).count() >= kMemoryLogInterval)
+		{
+			lastMemoryLogTime = now;
+			m_allocator.PrintBudget();
+			if (m_isGpuCulling)
+			{
+				const auto& cullStats = m_gpuCuller.GetLastStats();
+				std::cout << "\nGPU CULLING : " << cullStats.VisibleCount << " / " << m_instanceScene.GetInstanceCount() << " objects visible, "
+					<< cullStats.DrawCount << " draws\n";
+			}
+		}
+#endif
 	}
 }
 
@@ -126,21 +367,24 @@ void VkApplication::CleanUp()
 	// Buffers and memories
 	vkDestroyBuffer(m_mainDevice.logicalDevice, m_vertexBuffer, nullptr);
 	vkDestroyBuffer(m_mainDevice.logicalDevice, m_indexBuffer, nullptr);
-	for (auto& buffer : m_uniformBuffers)
-		vkDestroyBuffer(m_mainDevice.logicalDevice, buffer, nullptr);
 	vkDestroyImage(m_mainDevice.logicalDevice, m_texImage, nullptr);
 	vkDestroyImage(m_mainDevice.logicalDevice, m_depthImage, nullptr);
 	vkDestroyImage(m_mainDevice.logicalDevice, m_colorImage, nullptr);
 
-	vkFreeMemory(m_mainDevice.logicalDevice, m_vertexBufferMemory, nullptr);
-	vkFreeMemory(m_mainDevice.logicalDevice, m_indexBufferMemory, nullptr);
-	for (auto& memory : m_uniformBufferMemorys)
-		vkFreeMemory(m_mainDevice.logicalDevice, memory, nullptr);
-	vkFreeMemory(m_mainDevice.logicalDevice, m_texMemory, nullptr);
-	vkFreeMemory(m_mainDevice.logicalDevice, m_depthMemory, nullptr);
-	vkFreeMemory(m_mainDevice.logicalDevice, m_colorMemory, nullptr);
-
-	vkDestroyImageView(m_mainDevice.logicalDevice, m_texImageView, nullptr);
+	m_allocator.Free(m_vertexBufferMemory);
+	m_allocator.Free(m_indexBufferMemory);
+	m_uniformRing.Destroy();
+	m_instanceScene.Destroy();
+	m_gpuCuller.Destroy();
+	m_allocator.Free(m_texMemory);
+	m_allocator.Free(m_depthMemory);
+	m_allocator.Free(m_colorMemory);
+
+	// Streamed texture's image and view belong to the streamer
+	m_textureStreamer.Destroy();
+	m_uploadManager.Destroy();
+	if (m_streamedTexture == UINT32_MAX)
+		vkDestroyImageView(m_mainDevice.logicalDevice, m_texImageView, nullptr);
 	vkDestroyImageView(m_mainDevice.logicalDevice, m_depthImageView, nullptr);
 	vkDestroyImageView(m_mainDevice.logicalDevice, m_colorImageView, nullptr);
 	vkDestroySampler(m_mainDevice.logicalDevice, m_texSampler, nullptr);
@@ -148,8 +392,19 @@ void VkApplication::CleanUp()
 	// Pipeline objects
 	for (auto& framebuffer : m_swapchainFramebuffers)
 		vkDestroyFramebuffer(m_mainDevice.logicalDevice, framebuffer, nullptr);
-	vkDestroyCommandPool(m_mainDevice.logicalDevice, m_cmdPool, nullptr);
-	vkDestroyPipeline(m_mainDevice.logicalDevice, m_graphicsPipeline, nullptr);
+	m_secondaryRecorder.Destroy();
+	for (auto& cmdPool : m_cmdPools)
+		vkDestroyCommandPool(m_mainDevice.logicalDevice, cmdPool, nullptr);
+	// Workers are done with their caches once the manager is destroyed
+	m_pipelineManager.Destroy();
+	// Next launch starts warm, a failure only costs it the compile time
+	if (!m_pipelineCache.Save())
+	{
+#ifdef _DEBUG || DEBUG
+		std::cout << "\nPIPELINE CACHE : failed to write " << kPipelineCachePath << "\n";
+#endif
+	}
+	m_pipelineCache.Destroy();
 	vkDestroyDescriptorSetLayout(m_mainDevice.logicalDevice, m_descriptorSetLayout, nullptr);
 	vkDestroyDescriptorPool(m_mainDevice.logicalDevice, m_descriptorPool, nullptr);
 	vkDestroyPipelineLayout(m_mainDevice.logicalDevice, m_pipelineLayout, nullptr);
@@ -161,6 +416,8 @@ void VkApplication::CleanUp()
 	vkDestroySwapchainKHR(m_mainDevice.logicalDevice, m_swapchain, nullptr);
 	vkDestroySurfaceKHR(m_instance, m_surface, nullptr);
 
+	// Every resource is destroyed, blocks can go
+	m_allocator.Destroy();
 	vkDestroyDevice(m_mainDevice.logicalDevice, nullptr);
 	vkDestroyInstance(m_instance, nullptr);
 
@@ -219,7 +476,7 @@ void VkApplication::CreateLogicalDevice()
 	// Use std::set to check if presentation queue is inside graphics queue or in the seperate queue
 	// If presentation queue is inside graphics queue -> only create one queue
 	// Else create the seperate queue for presentation queue
-	std::set<uint32_t> queueFamilyIndices = { indices.graphicsFamilyIndex, indices.presentationFamilyIndex };
+	std::set<uint32_t> queueFamilyIndices = { indices.graphicsFamilyIndex, indices.presentationFamilyIndex, indices.transferFamilyIndex };
 
 	std::vector <VkDeviceQueueCreateInfo> queueCreateInfos;
 	queueCreateInfos.reserve(queueFamilyIndices.size());
@@ -241,20 +498,54 @@ void VkApplication::CreateLogicalDevice()
 	createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
 	createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
 	createInfo.pQueueCreateInfos = queueCreateInfos.data();
-	createInfo.enabledExtensionCount = static_cast<uint32_t>(VkUtils::DEVICE_EXTENSIONS.size());
-	createInfo.ppEnabledExtensionNames = VkUtils::DEVICE_EXTENSIONS.data();
+	// Memory budget only feeds instrumentation, run without it
+	auto extensions = VkUtils::DEVICE_EXTENSIONS;
+	bool hasMemoryBudget = VkUtils::IsDeviceExtensionSupported(m_mainDevice.physicalDevice, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+	if (hasMemoryBudget)
+		extensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+	createInfo.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
+	createInfo.ppEnabledExtensionNames = extensions.data();
+
+	// GPU driven draws need one indirect call for many draws reading their instance, the draw count from a buffer is optional
+	VkPhysicalDeviceProperties properties{};
+	vkGetPhysicalDeviceProperties(m_mainDevice.physicalDevice, &properties);
+	VkPhysicalDeviceVulkan12Features supportedFeatures12{};
+	supportedFeatures12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+	VkPhysicalDeviceFeatures2 supportedFeatures{};
+	supportedFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+	if (properties.apiVersion >= VK_API_VERSION_1_2)
+		supportedFeatures.pNext = &supportedFeatures12;
+	vkGetPhysicalDeviceFeatures2(m_mainDevice.physicalDevice, &supportedFeatures);
+	m_isGpuCulling = kGpuDrivenRendering && supportedFeatures.features.multiDrawIndirect && supportedFeatures.features.drawIndirectFirstInstance;
+	m_hasDrawIndirectCount = m_isGpuCulling && supportedFeatures12.drawIndirectCount;
 
 	VkPhysicalDeviceFeatures features {};
 	features.samplerAnisotropy = VK_TRUE;
+	features.multiDrawIndirect = m_isGpuCulling;
+	features.drawIndirectFirstInstance = m_isGpuCulling;
 
 	createInfo.pEnabledFeatures = &features;
 
+	VkPhysicalDeviceVulkan12Features features12{};
+	features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+	features12.drawIndirectCount = VK_TRUE;
+	if (m_hasDrawIndirectCount)
+		createInfo.pNext = &features12;
+
 	if (vkCreateDevice(m_mainDevice.physicalDevice, &createInfo, nullptr, &m_mainDevice.logicalDevice) != VK_SUCCESS)
 		throw std::runtime_error("\nVULKAN INIT ERROR : Failed to create logical devices !\n");
 
 	// Get Queue that created inside logical device to use later
 	vkGetDeviceQueue(m_mainDevice.logicalDevice, indices.graphicsFamilyIndex, 0, &m_graphicsQueue);
 	vkGetDeviceQueue(m_mainDevice.logicalDevice, indices.presentationFamilyIndex, 0, &m_presentationQueue);
+	vkGetDeviceQueue(m_mainDevice.logicalDevice, indices.transferFamilyIndex, 0, &m_transferQueue);
+
+	m_allocator.Init(m_mainDevice.physicalDevice, m_mainDevice.logicalDevice, hasMemoryBudget);
+
+#ifdef _DEBUG || DEBUG
+	std::cout << "\nQUEUES : graphics family " << indices.graphicsFamilyIndex << ", transfer family " << indices.transferFamilyIndex
+		<< (indices.transferFamilyIndex != indices.graphicsFamilyIndex ? ", uploads run beside rendering\n" : ", uploads share the graphics queue\n");
+#endif
 }
 
 void VkApplication::CreateSurface()
@@ -413,7 +704,8 @@ void VkApplication::CreateDescriptorSetLayout()
 {
 	VkDescriptorSetLayoutBinding uniformBinding{};
 	uniformBinding.binding = 0;
-	uniformBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	// Offset given at bind time, selects the object's data in the uniform ring
+	uniformBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
 	uniformBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
 	uniformBinding.descriptorCount = 1;
 	uniformBinding.pImmutableSamplers = nullptr;
@@ -438,7 +730,33 @@ void VkApplication::CreateDescriptorSetLayout()
 
 void VkApplication::CreateGraphicsPipeline()
 {
-	VkShaderModule vertShaderModule = VkUtils::CreateShaderModule(m_mainDevice.logicalDevice, nullptr, "assets/shaders/vert.spv");
+	VkPipelineLayoutCreateInfo layoutCreateInfo{};
+	layoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	layoutCreateInfo.setLayoutCount = 1;
+	layoutCreateInfo.pSetLayouts = &m_descriptorSetLayout;
+	// Per draw transform, dequantization parameters of packed vertices and material
+	VkPushConstantRange pushConstantRange{};
+	pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+	pushConstantRange.offset = 0;
+	pushConstantRange.size = sizeof(VkUtils::DrawPushConstants);
+
+	layoutCreateInfo.pushConstantRangeCount = 1;
+	layoutCreateInfo.pPushConstantRanges = &pushConstantRange;
+
+	if (vkCreatePipelineLayout(m_mainDevice.logicalDevice, &layoutCreateInfo, nullptr, &m_pipelineLayout) != VK_SUCCESS)
+		throw std::runtime_error("\nVULKAN ERROR : Failed to create pipeline layout !\n");
+
+	// Frames are rendered without the model until its pipeline is compiled, one per vertex format
+	auto vertexFormat = m_vertexFormat;
+	m_graphicsPipeline = m_pipelineManager.Request(static_cast<uint64_t>(vertexFormat), [this, vertexFormat](VkPipelineCache pipelineCache)
+	{
+		return BuildGraphicsPipeline(vertexFormat, pipelineCache);
+	});
+}
+
+VkPipeline VkApplication::BuildGraphicsPipeline(VkUtils::VertexFormat vertexFormat, VkPipelineCache pipelineCache) const
+{
+	VkShaderModule vertShaderModule = VkUtils::CreateShaderModule(m_mainDevice.logicalDevice, nullptr, GetVertexShaderPath(vertexFormat));
 	VkShaderModule fragShaderModule = VkUtils::CreateShaderModule(m_mainDevice.logicalDevice, nullptr, "assets/shaders/frag.spv");
 
 	VkPipelineShaderStageCreateInfo vertStageCreateInfo {};
@@ -455,13 +773,19 @@ void VkApplication::CreateGraphicsPipeline()
 
 	VkPipelineShaderStageCreateInfo shaderStageCreateInfos[] = { vertStageCreateInfo , fragStageCreateInfo };
 	
-	auto bindingDescs = VkUtils::Vertex::GetBindingDescription();
-	auto attributeDescs = VkUtils::Vertex::GetAttributeDescriptions();
+	bool isPacked = vertexFormat == VkUtils::VertexFormat::Packed;
+	VkVertexInputBindingDescription bindingDescs[] = {
+		isPacked ? VkUtils::PackedVertex::GetBindingDescription() : VkUtils::Vertex::GetBindingDescription(),
+		VkUtils::InstanceData::GetBindingDescription()
+	};
+	auto attributeDescs = isPacked ? VkUtils::PackedVertex::GetAttributeDescriptions() : VkUtils::Vertex::GetAttributeDescriptions();
+	auto instanceAttributeDescs = VkUtils::InstanceData::GetAttributeDescriptions();
+	attributeDescs.insert(attributeDescs.end(), instanceAttributeDescs.begin(), instanceAttributeDescs.end());
 
 	VkPipelineVertexInputStateCreateInfo vertexInputCreateInfo {};
 	vertexInputCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-	vertexInputCreateInfo.vertexBindingDescriptionCount = 1;
-	vertexInputCreateInfo.pVertexBindingDescriptions = &bindingDescs;
+	vertexInputCreateInfo.vertexBindingDescriptionCount = _countof(bindingDescs);
+	vertexInputCreateInfo.pVertexBindingDescriptions = bindingDescs;
 	vertexInputCreateInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescs.size());
 	vertexInputCreateInfo.pVertexAttributeDescriptions = attributeDescs.data();
 
@@ -550,15 +874,6 @@ void VkApplication::CreateGraphicsPipeline()
 	dynamicCreateInfo.dynamicStateCount = _countof(dynamicStates);
 	dynamicCreateInfo.pDynamicStates = dynamicStates;
 
-	VkPipelineLayoutCreateInfo layoutCreateInfo{};
-	layoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-	layoutCreateInfo.setLayoutCount = 1;
-	layoutCreateInfo.pSetLayouts = &m_descriptorSetLayout;
-	layoutCreateInfo.pushConstantRangeCount = 0;
-	layoutCreateInfo.pPushConstantRanges = nullptr;
-
-	if (vkCreatePipelineLayout(m_mainDevice.logicalDevice, &layoutCreateInfo, nullptr, &m_pipelineLayout) != VK_SUCCESS)
-		throw std::runtime_error("\nVULKAN ERROR : Failed to create pipeline layout !\n");
 
 	VkGraphicsPipelineCreateInfo graphicsCreateInfo{};
 	graphicsCreateInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
@@ -578,12 +893,22 @@ void VkApplication::CreateGraphicsPipeline()
 	graphicsCreateInfo.basePipelineHandle = VK_NULL_HANDLE;
 	graphicsCreateInfo.basePipelineIndex = -1;
 
-	if (vkCreateGraphicsPipelines(m_mainDevice.logicalDevice, VK_NULL_HANDLE, 1, &graphicsCreateInfo, nullptr, &m_graphicsPipeline)
-		!= VK_SUCCESS)
-		throw std::runtime_error("\nVULKAN ERROR : Falied to create graphics pipeline !\n");
-
+#ifdef _DEBUG || DEBUG
+	auto pipelineStartTime = std::chrono::high_resolution_clock::now();
+#endif
+	VkPipeline pipeline;
+	VkResult result = vkCreateGraphicsPipelines(m_mainDevice.logicalDevice, pipelineCache, 1, &graphicsCreateInfo, nullptr, &pipeline);
 	vkDestroyShaderModule(m_mainDevice.logicalDevice, vertShaderModule, nullptr);
 	vkDestroyShaderModule(m_mainDevice.logicalDevice, fragShaderModule, nullptr);
+	if (result != VK_SUCCESS)
+		throw std::runtime_error("\nVULKAN ERROR : Falied to create graphics pipeline !\n");
+#ifdef _DEBUG || DEBUG
+	auto pipelineTime = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - pipelineStartTime).count();
+	std::cout << "\nGRAPHICS PIPELINE : compiled in " << pipelineTime << " ms in the background from a "
+		<< (m_pipelineCache.GetLoadedSize() > 0 ? "warm" : "cold") << " pipeline cache\n";
+#endif
+
+	return pipeline;
 }
 
 void VkApplication::CreateFramebuffers()
@@ -615,82 +940,196 @@ void VkApplication::CreateCommandPool()
 	VkCommandPoolCreateInfo createInfo{};
 	createInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
 	createInfo.queueFamilyIndex = indices.graphicsFamilyIndex;
+	// Primary command buffers live a frame, their pool is reset as a whole before recording the next one
+	createInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
 
-	if (vkCreateCommandPool(m_mainDevice.logicalDevice, &createInfo, nullptr, &m_cmdPool) != VK_SUCCESS)
-		throw std::runtime_error("\nVULKAN ERROR : Failed to create command pool !\n");
+	m_cmdPools.resize(m_swapchainImages.size());
+	for (auto& cmdPool : m_cmdPools)
+	{
+		if (vkCreateCommandPool(m_mainDevice.logicalDevice, &createInfo, nullptr, &cmdPool) != VK_SUCCESS)
+			throw std::runtime_error("\nVULKAN ERROR : Failed to create command pool !\n");
+	}
+
+	// Uploads are batched in their own command buffers
+	m_uploadManager.Init(m_allocator, m_mainDevice.logicalDevice, m_graphicsQueue, indices.graphicsFamilyIndex,
+		m_transferQueue, indices.transferFamilyIndex, kStagingRingSize);
 }
 
 void VkApplication::LoadModelToBuffer()
 {
-	VkUtils::LoadModel("assets/models/viking_room.obj", m_vertices, m_indices);
+	// Cooked package is preferred, its sections are copied to staging memory without any parsing
+	if (m_assetPackage.IsOpen())
+	{
+		auto vertexSection = m_assetPackage.FindSection(VkUtils::PackageSectionType::VertexData);
+		auto indexSection = m_assetPackage.FindSection(VkUtils::PackageSectionType::IndexData);
+		auto quantizationSection = m_assetPackage.FindSection(VkUtils::PackageSectionType::VertexQuantization);
+		auto subMeshSection = m_assetPackage.FindSection(VkUtils::PackageSectionType::SubMeshes);
+		auto meshletSection = m_assetPackage.FindSection(VkUtils::PackageSectionType::Meshlets);
+		auto meshletIndexSection = m_assetPackage.FindSection(VkUtils::PackageSectionType::MeshletIndices);
+		auto lodSection = m_assetPackage.FindSection(VkUtils::PackageSectionType::Lods);
+		auto boundsSection = m_assetPackage.FindSection(VkUtils::PackageSectionType::Bounds);
+
+		bool isPacked = vertexSection && vertexSection->Format == static_cast<uint32_t>(VkUtils::VertexFormat::Packed);
+		bool isVertexDataValid = vertexSection && (isPacked ?
+			vertexSection->ElementSize == sizeof(VkUtils::PackedVertex) && quantizationSection &&
+			quantizationSection->Size == sizeof(VkUtils::VertexQuantization) :
+			vertexSection->Format == static_cast<uint32_t>(VkUtils::VertexFormat::Standard) && vertexSection->ElementSize == sizeof(VkUtils::Vertex));
+
+		bool isIndexDataValid = indexSection && (indexSection->ElementSize == sizeof(uint16_t) || indexSection->ElementSize == sizeof(uint32_t)) &&
+			(!subMeshSection || subMeshSection->ElementSize == sizeof(VkUtils::SubMesh));
+
+		if (isVertexDataValid && isIndexDataValid)
+		{
+			m_vertexFormat = isPacked ? VkUtils::VertexFormat::Packed : VkUtils::VertexFormat::Standard;
+			if (isPacked && !FileExists(GetVertexShaderPath(m_vertexFormat)))
+				throw std::runtime_error("\nERROR : " + std::string(GetVertexShaderPath(m_vertexFormat)) + " is missing for the packed vertices of " + kCookedPackagePath + ", run compile-shader.bat !\n");
+			if (isPacked)
+				memcpy(&m_vertexQuantization, m_assetPackage.GetSectionData(*quantizationSection), sizeof(m_vertexQuantization));
+
+			m_vertexUploadData = m_assetPackage.GetSectionData(*vertexSection);
+			m_vertexUploadSize = vertexSection->Size;
+			m_indexUploadData = m_assetPackage.GetSectionData(*indexSection);
+			m_indexUploadSize = indexSection->Size;
+			m_indexType = indexSection->ElementSize == sizeof(uint16_t) ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+
+			if (subMeshSection)
+			{
+				auto subMeshes = static_cast<const VkUtils::SubMesh*>(m_assetPackage.GetSectionData(*subMeshSection));
+				m_subMeshes.assign(subMeshes, subMeshes + subMeshSection->ElementCount);
+			}
+			else
+				m_subMeshes.push_back({ 0, indexSection->ElementCount, 0 });
+
+			if (meshletSection && meshletSection->ElementSize == sizeof(VkUtils::Meshlet) && meshletIndexSection &&
+				meshletIndexSection->ElementSize == sizeof(uint16_t))
+			{
+				auto meshlets = static_cast<const VkUtils::Meshlet*>(m_assetPackage.GetSectionData(*meshletSection));
+				m_meshlets.assign(meshlets, meshlets + meshletSection->ElementCount);
+				auto meshletIndices = static_cast<const uint16_t*>(m_assetPackage.GetSectionData(*meshletIndexSection));
+				m_meshletIndices.assign(meshletIndices, meshletIndices + meshletIndexSection->ElementCount);
+
+				bool isMeshletRangeValid = true;
+				for (const auto& meshlet : m_meshlets)
+					isMeshletRangeValid = isMeshletRangeValid && meshlet.FirstIndex + static_cast<uint64_t>(meshlet.IndexCount) <= m_meshletIndices.size();
+				if (!isMeshletRangeValid)
+				{
+					m_meshlets.clear();
+					m_meshletIndices.clear();
+				}
+			}
+
+			if (lodSection && lodSection->ElementSize == sizeof(VkUtils::MeshLod) && boundsSection &&
+				boundsSection->Size == sizeof(VkUtils::BoundingSphere))
+			{
+				auto lods = static_cast<const VkUtils::MeshLod*>(m_assetPackage.GetSectionData(*lodSection));
+				m_lods.assign(lods, lods + lodSection->ElementCount);
+				memcpy(&m_modelBounds, m_assetPackage.GetSectionData(*boundsSection), sizeof(m_modelBounds));
+
+				bool isLodRangeValid = !m_lods.empty();
+				for (const auto& lod : m_lods)
+					isLodRangeValid = isLodRangeValid && lod.FirstSubMesh + lod.SubMeshCount <= m_subMeshes.size();
+				if (!isLodRangeValid)
+					m_lods.clear();
+			}
+
+			// Without LODs every sub mesh is drawn, always
+			if (m_lods.empty())
+			{
+				m_lods.push_back({ 0, static_cast<uint32_t>(m_subMeshes.size()), 0.0f, indexSection->ElementCount });
+				m_modelBounds = { glm::vec3(0.0f), 0.0f };
+			}
+
+#ifdef _DEBUG || DEBUG
+			std::cout << "\nMODEL LOADED FROM PACKAGE : " << vertexSection->ElementCount << (isPacked ? " packed" : "") << " vertices, "
+				<< indexSection->ElementCount << " indices of " << indexSection->ElementSize << " bytes, " << m_subMeshes.size() << " sub meshes, "
+				<< m_meshlets.size() << " meshlets\n";
+			VkUtils::PrintLodChain("viking_room", m_lods);
+#endif
+			return;
+		}
+	}
+
+	VkUtils::ModelLoadStats stats;
+	VkUtils::LoadModelParallel(kModelPath, m_vertices, m_indices, &stats);
+	auto optimizationStats = VkUtils::OptimizeMesh(m_vertices, m_indices);
+
+	// Keep every sub mesh addressable with 16 bit indices
+	size_t optimizedVertexCount = m_vertices.size();
+	m_subMeshes = VkUtils::SplitMeshForShortIndices(m_vertices, m_indices);
+	// Meshlets get their own copy of the triangles, the overdraw order of m_indices is kept for drawing
+	VkUtils::MeshletStats meshletStats;
+	std::vector<uint32_t> meshletIndices;
+	m_meshlets = VkUtils::BuildMeshlets(m_vertices, m_indices, m_subMeshes, meshletIndices, &meshletStats);
+	m_meshletIndices = VkUtils::ConvertToShortIndices(meshletIndices);
+	// Simplified levels share the vertices, only their indices and sub meshes are appended
+	m_lods = VkUtils::BuildLodChain(m_vertices, m_indices, m_subMeshes);
+	m_modelBounds = VkUtils::ComputeBoundingSphere(m_vertices);
+	m_shortIndices = VkUtils::ConvertToShortIndices(m_indices);
+	m_indexType = VK_INDEX_TYPE_UINT16;
+
+	// Packed vertices need their own vertex shader, compiled by compile-shader.bat
+	m_vertexFormat = kModelVertexFormat;
+	if (m_vertexFormat == VkUtils::VertexFormat::Packed && !FileExists(GetVertexShaderPath(m_vertexFormat)))
+		throw std::runtime_error("\nERROR : " + std::string(GetVertexShaderPath(m_vertexFormat)) + " is missing for kModelVertexFormat, run compile-shader.bat !\n");
+
+	if (m_vertexFormat == VkUtils::VertexFormat::Packed)
+	{
+		std::vector<VkUtils::SubMesh> fullDetailSubMeshes(m_subMeshes.begin(), m_subMeshes.begin() + m_lods[0].SubMeshCount);
+		m_vertexQuantization = VkUtils::PackVertices(m_vertices, m_indices, fullDetailSubMeshes, m_packedVertices);
+		m_vertexUploadData = m_packedVertices.data();
+		m_vertexUploadSize = sizeof(m_packedVertices[0]) * m_packedVertices.size();
+	}
+	else
+	{
+		m_vertexUploadData = m_vertices.data();
+		m_vertexUploadSize = sizeof(m_vertices[0]) * m_vertices.size();
+	}
+
+	m_indexUploadData = m_shortIndices.data();
+	m_indexUploadSize = sizeof(m_shortIndices[0]) * m_shortIndices.size();
+
+#ifdef _DEBUG || DEBUG
+	std::cout << "\nMODEL LOADED : " << stats.UniqueVertexCount << " unique vertices from " << stats.RawVertexCount
+		<< " face corners (" << (stats.RawVertexCount > 0 ? 100.0 * stats.UniqueVertexCount / stats.RawVertexCount : 0.0)
+		<< "%), " << stats.IndexCount << " indices\n";
+	std::cout << "\tVertex memory : " << m_vertexUploadSize << " bytes instead of "
+		<< stats.RawVertexCount * sizeof(VkUtils::Vertex) << " bytes" << (m_vertexFormat == VkUtils::VertexFormat::Packed ? " (packed)" : "") << "\n";
+	std::cout << "\tIndex memory : " << m_indexUploadSize << " bytes instead of " << sizeof(uint32_t) * m_indices.size() << " bytes, "
+		<< m_subMeshes.size() << " sub meshes, " << m_vertices.size() - optimizedVertexCount << " vertices duplicated by splitting\n";
+	VkUtils::PrintMeshOptimizationStats("viking_room", optimizationStats);
+	VkUtils::PrintMeshletStats("viking_room", meshletStats);
+	VkUtils::PrintLodChain("viking_room", m_lods);
+#endif
 }
 
 void VkApplication::CreateVertexBuffer()
 {
 	// Create vertex buffer and allocate memory
-	auto bufferSize = sizeof(m_vertices[0]) * m_vertices.size();
+	auto bufferSize = m_vertexUploadSize;
 	m_vertexBuffer = VkUtils::CreateBuffer(m_mainDevice.logicalDevice, bufferSize, 
 						VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
 	if (m_vertexBuffer == VK_NULL_HANDLE)
 		throw std::runtime_error("\nVULKAN ERROR : Failed to create vertex buffer !\n");
-	m_vertexBufferMemory = VkUtils::AllocateBufferMemory(m_mainDevice.physicalDevice, m_mainDevice.logicalDevice, m_vertexBuffer,
-		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-
-	// Create transfer buffer and allocate memory (to upload data to GPU's buffer)
-	VkBuffer transferBuffer = VkUtils::CreateBuffer(m_mainDevice.logicalDevice, bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
-	if (transferBuffer == VK_NULL_HANDLE)
-		throw std::runtime_error("\nVULKAN ERROR : Failed to create transfer buffer !\n");
-	VkDeviceMemory transferMemory = VkUtils::AllocateBufferMemory(m_mainDevice.physicalDevice, m_mainDevice.logicalDevice, transferBuffer,
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-
-	// Map data to transfer buffer
-	void* data = nullptr;
-	vkMapMemory(m_mainDevice.logicalDevice, transferMemory, 0, bufferSize, 0, &data);
-	memcpy(data, m_vertices.data(), bufferSize);
-	vkUnmapMemory(m_mainDevice.logicalDevice, transferMemory);
-
-	VkCommandBuffer tempCmdBuffer;
-	VkUtils::BeginSingleTimeCommands(m_mainDevice.logicalDevice, m_cmdPool, &tempCmdBuffer);
-	VkUtils::CopyBuffer(tempCmdBuffer, transferBuffer, m_vertexBuffer, bufferSize);
-	VkUtils::EndSingleTimeCommands(m_graphicsQueue, tempCmdBuffer);
-
-	// Release transfer resources
-	vkDestroyBuffer(m_mainDevice.logicalDevice, transferBuffer, nullptr);
-	vkFreeMemory(m_mainDevice.logicalDevice, transferMemory, nullptr);
+	m_vertexBufferMemory = m_allocator.AllocateBuffer(m_vertexBuffer, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VkUtils::MemoryCategory::Vertex);
+
+	m_uploadManager.UploadBuffer(m_vertexBuffer, 0, m_vertexUploadData, bufferSize);
 }
 
 void VkApplication::CreateIndexBuffer()
 {
-	VkDeviceSize bufferSize = sizeof(m_indices[0]) * m_indices.size();
+	VkDeviceSize bufferSize = m_indexUploadSize;
 	m_indexBuffer = VkUtils::CreateBuffer(m_mainDevice.logicalDevice, bufferSize, VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
 	if (m_indexBuffer == VK_NULL_HANDLE)
 		throw std::runtime_error("\nVULKAN ERROR : Failed to create index buffer !\n");
-	m_indexBufferMemory = VkUtils::AllocateBufferMemory(m_mainDevice.physicalDevice, m_mainDevice.logicalDevice, m_indexBuffer, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-
-	auto transferBuffer = VkUtils::CreateBuffer(m_mainDevice.logicalDevice, bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
-	if (transferBuffer == VK_NULL_HANDLE)
-		throw std::runtime_error("\nVULKAN ERROR : Failed to create staging buffer to transfer resources to INDEX buffer !\n");
-	auto transferMemory = VkUtils::AllocateBufferMemory(m_mainDevice.physicalDevice, m_mainDevice.logicalDevice, transferBuffer, 
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-
-	void* data = nullptr;
-	vkMapMemory(m_mainDevice.logicalDevice, transferMemory, 0, bufferSize, 0, &data);
-	memcpy(data, m_indices.data(), bufferSize);
-	vkUnmapMemory(m_mainDevice.logicalDevice, transferMemory);
-	
-	VkCommandBuffer tempCmdBuffer;
-	VkUtils::BeginSingleTimeCommands(m_mainDevice.logicalDevice, m_cmdPool, &tempCmdBuffer);
-	VkUtils::CopyBuffer(tempCmdBuffer, transferBuffer, m_indexBuffer, bufferSize);
-	VkUtils::EndSingleTimeCommands(m_graphicsQueue, tempCmdBuffer);
+	m_indexBufferMemory = m_allocator.AllocateBuffer(m_indexBuffer, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VkUtils::MemoryCategory::Index);
 
-	vkDestroyBuffer(m_mainDevice.logicalDevice, transferBuffer, nullptr);
-	vkFreeMemory(m_mainDevice.logicalDevice, transferMemory, nullptr);
+	m_uploadManager.UploadBuffer(m_indexBuffer, 0, m_indexUploadData, bufferSize);
 }
 
 void VkApplication::CreateDescriptorPool()
 {
 	VkDescriptorPoolSize uniformPoolSize{};
-	uniformPoolSize.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	uniformPoolSize.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
 	uniformPoolSize.descriptorCount = static_cast<uint32_t>(m_swapchainImages.size());
 
 	VkDescriptorPoolSize samplerPoolSize{};
@@ -727,7 +1166,8 @@ void VkApplication::AllocateDescriptorSets()
 	for (size_t i = 0; i < m_descriptorSets.size(); ++i)
 	{
 		VkDescriptorBufferInfo bufferInfo{};
-		bufferInfo.buffer = m_uniformBuffers[i];
+		// Every set sees the whole ring, they only differ by the texture view
+		bufferInfo.buffer = m_uniformRing.GetBuffer();
 		bufferInfo.offset = 0;
 		bufferInfo.range = sizeof(VkUtils::UniformBufferObject);
 
@@ -743,7 +1183,7 @@ void VkApplication::AllocateDescriptorSets()
 		writeBuffer.dstArrayElement = 0;
 		writeBuffer.pBufferInfo = &bufferInfo;
 		writeBuffer.descriptorCount = 1;
-		writeBuffer.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+		writeBuffer.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
 
 		VkWriteDescriptorSet writeImage{};
 		writeImage.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
@@ -758,62 +1198,258 @@ void VkApplication::AllocateDescriptorSets()
 
 		vkUpdateDescriptorSets(m_mainDevice.logicalDevice, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
 	}
+
+	m_textureVersions.assign(m_descriptorSets.size(), m_streamedTexture != UINT32_MAX ? m_textureStreamer.GetVersion(m_streamedTexture) : 0);
+}
+
+void VkApplication::UpdateTextureDescriptor(uint32_t imageIndex)
+{
+	VkDescriptorImageInfo imageInfo{};
+	imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	imageInfo.imageView = m_texImageView;
+	imageInfo.sampler = m_texSampler;
+
+	VkWriteDescriptorSet writeImage{};
+	writeImage.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	writeImage.dstSet = m_descriptorSets[imageIndex];
+	writeImage.dstBinding = 1;
+	writeImage.dstArrayElement = 0;
+	writeImage.pImageInfo = &imageInfo;
+	writeImage.descriptorCount = 1;
+	writeImage.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+
+	vkUpdateDescriptorSets(m_mainDevice.logicalDevice, 1, &writeImage, 0, nullptr);
+	m_textureVersions[imageIndex] = m_textureStreamer.GetVersion(m_streamedTexture);
 }
 
 void VkApplication::CreateUniformBuffer()
 {
-	VkDeviceSize bufferSize = sizeof(VkUtils::UniformBufferObject);
-	auto imageCount = m_swapchainImages.size();
+	auto imageCount = static_cast<uint32_t>(m_swapchainImages.size());
+	m_uniformRing.Init(m_allocator, m_mainDevice.physicalDevice, m_mainDevice.logicalDevice, kUniformRingFrameSize, imageCount);
+
+	// Where each image's first frame will write, so commands recorded before it need no update
+	m_uniformOffsets.resize(imageCount);
+	for (uint32_t i = 0; i < imageCount; ++i)
+		m_uniformOffsets[i] = m_uniformRing.GetFrameOffset(i);
+	// Valid offsets until the first frame writes the culling uniforms, commands recorded before are recorded again then
+	m_cullUniformOffsets = m_uniformOffsets;
+}
 
-	m_uniformBuffers.resize(imageCount);
-	m_uniformBufferMemorys.resize(imageCount);
+void VkApplication::CreateInstances()
+{
+	m_instanceScene.Init(m_allocator, m_mainDevice.logicalDevice, static_cast<uint32_t>(m_swapchainImages.size()));
 
-	for (uint16_t i = 0; i < imageCount; ++i)
+	if (kStressInstanceCount > 0)
 	{
-		auto& buffer = m_uniformBuffers[i];
-		auto& memory = m_uniformBufferMemorys[i];
+		SpawnInstanceGrid(kStressInstanceCount);
+	}
+	else
+	{
+		m_instanceScene.AddInstance(glm::mat4(1.0f));
+		m_sceneBounds = m_modelBounds;
+	}
+
+	// Commands are recorded right after, with every image's buffer
+	for (uint32_t i = 0; i < m_swapchainImages.size(); ++i)
+		m_instanceScene.UpdateFrame(i);
+	// Everything is drawn until the first frame culls
+	m_visibleInstances.resize(m_instanceScene.GetInstanceCount());
+	for (uint32_t i = 0; i < m_visibleInstances.size(); ++i)
+		m_visibleInstances[i] = i;
+	VkUtils::BuildInstanceRuns(m_visibleInstances, m_instanceRuns);
+}
+
+void VkApplication::CreateGpuCuller()
+{
+	if (!m_isGpuCulling)
+		return;
+
+	// kGpuDrivenRendering asks for it, quietly culling on the CPU instead would hide a broken build
+	if (!FileExists(kCullShaderPath))
+		throw std::runtime_error("\nERROR : " + std::string(kCullShaderPath) + " is missing, run compile-shader.bat !\n");
+
+	auto imageCount = static_cast<uint32_t>(m_swapchainImages.size());
+	m_gpuCuller.Init(m_allocator, m_mainDevice.physicalDevice, m_mainDevice.logicalDevice, m_uploadManager, m_uniformRing, kCullShaderPath,
+		m_pipelineCache.Get(), imageCount, m_hasDrawIndirectCount, m_subMeshes, m_lods, m_modelBounds, kLodPixelErrorThreshold);
+	for (uint32_t i = 0; i < imageCount; ++i)
+		m_gpuCuller.UpdateFrame(i, m_instanceScene.GetBuffer(i), m_instanceScene.GetInstanceCount());
 
-		buffer = VkUtils::CreateBuffer(m_mainDevice.logicalDevice, bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT);
-		if (buffer == VK_NULL_HANDLE)
-			throw std::runtime_error("\nVULKAN ERROR : Failed to create Uniform Buffer !\n");
+#ifdef _DEBUG || DEBUG
+	std::cout << "\nGPU CULLING : compute culled indirect draws, draw count read " << (m_hasDrawIndirectCount ? "on the GPU\n" : "from cleared commands\n");
+#endif
+}
+
+void VkApplication::SpawnInstanceGrid(uint32_t count)
+{
+	float spacing = kInstanceGridSpacing * std::max(m_modelBounds.Radius, 1.0f);
+	uint32_t side = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<float>(count))));
+	float halfExtent = (side - 1) * spacing * 0.5f;
 
-		memory = VkUtils::AllocateBufferMemory(m_mainDevice.physicalDevice, m_mainDevice.logicalDevice, buffer,
-			VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+	m_instanceScene.Clear();
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		glm::vec3 position((i % side) * spacing - halfExtent, (i / side) * spacing - halfExtent, 0.0f);
+		m_instanceScene.AddInstance(glm::translate(glm::mat4(1.0f), position));
 	}
+
+	// Grid's corner cells are the farthest from its center
+	m_sceneBounds = { m_modelBounds.Center, std::sqrt(2.0f) * halfExtent + m_modelBounds.Radius };
+	m_isCameraDirty = true;
+
+#ifdef _DEBUG || DEBUG
+	std::cout << "\nINSTANCES : " << count << " on a " << side << " x " << side << " grid, " << spacing << " units apart\n";
+#endif
 }
 
 void VkApplication::CreateTexture()
 {
-	VkBuffer imageBuffer;
-	VkDeviceMemory imageBufferMemory;
-	VkExtent3D extent;
-	VkUtils::CreateImageFromFile("assets/models/viking_room.png", m_mainDevice.physicalDevice, m_mainDevice.logicalDevice, m_graphicsQueue,
-		m_cmdPool, &imageBuffer, &imageBufferMemory, &extent);
-	m_texMipLevels = VkUtils::CalculateMipLevels(extent);
-
-	VkUtils::AllocateImage2D(m_mainDevice.physicalDevice, m_mainDevice.logicalDevice, extent, VK_FORMAT_R8G8B8A8_SRGB, 
-		VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
-		m_texMipLevels, VK_SAMPLE_COUNT_1_BIT , &m_texImage, &m_texMemory);
-
-	VkCommandBuffer tmpCmdBuffer;
-	VkUtils::BeginSingleTimeCommands(m_mainDevice.logicalDevice, m_cmdPool, &tmpCmdBuffer);
-	VkUtils::TransitionImageLayout(tmpCmdBuffer, m_texImage, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, m_texMipLevels);
-	VkUtils::CopyBufferToImage(tmpCmdBuffer, extent, imageBuffer, m_texImage);
-	VkUtils::EndSingleTimeCommands(m_graphicsQueue, tmpCmdBuffer);
-
-	vkDestroyBuffer(m_mainDevice.logicalDevice, imageBuffer, nullptr);
-	vkFreeMemory(m_mainDevice.logicalDevice, imageBufferMemory, nullptr);
-
-	VkUtils::GenerateMipmaps(m_mainDevice.physicalDevice, m_mainDevice.logicalDevice, m_cmdPool, m_graphicsQueue, m_texImage, VK_FORMAT_R8G8B8A8_SRGB, extent, m_texMipLevels);
-	m_texImageView = VkUtils::CreateImageView2D(m_mainDevice.logicalDevice, m_texImage, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_ASPECT_COLOR_BIT, m_texMipLevels);
+	auto indices = VkUtils::GetQueueFamiilyIndices(m_mainDevice.physicalDevice, m_surface);
+	m_textureStreamer.Init(m_allocator, m_mainDevice.logicalDevice, m_graphicsQueue, indices.graphicsFamilyIndex,
+		m_transferQueue, indices.transferFamilyIndex, kTextureStreamingBudget, MAX_FRAMES_IN_FLIGHT);
+
+	// Block compressed texture with prebuilt mips is the smallest on GPU and needs no decoding
+	if (m_ktx2Texture.IsOpen() && CreateTextureFromKtx2())
+		return;
+
+	// Cooked texture already has every mip level, no decoding and no blits
+	auto textureSection = m_assetPackage.IsOpen() ? m_assetPackage.FindSection(VkUtils::PackageSectionType::TextureData) : nullptr;
+	if (textureSection && textureSection->Format == VK_FORMAT_R8G8B8A8_SRGB && textureSection->ElementSize == kBytesPerPixel)
+	{
+		CreateTextureFromPackage(*textureSection);
+		return;
+	}
+
+	// KTX2 can't be sampled here, it wasn't decoded by the loader
+	if (!m_texPixels)
+		m_texPixels = VkUtils::DecodeImageFile(kTexturePath, &m_texExtent);
+	if (!m_texPixels)
+		throw std::runtime_error("\nERROR : Failed to load texture image from file !\n");
+
+	// Decoded level 0 goes straight to staging memory, the other levels are blitted in the same submission
+	std::vector<const void*> levelData = { m_texPixels.get() };
+	std::vector<VkDeviceSize> levelSizes = { VkUtils::GetMipLevelSize(m_texExtent.width, m_texExtent.height, 0, kBytesPerPixel) };
+	CreateTextureFromMipChain(VK_FORMAT_R8G8B8A8_SRGB, m_texExtent, VkUtils::CalculateMipLevels(m_texExtent), levelData, levelSizes);
+	// Pixels are in GPU memory now
+	m_texPixels.reset();
+}
+
+void VkApplication::CreateTextureFromPackage(const VkUtils::PackageSection& section)
+{
+	auto data = static_cast<const uint8_t*>(m_assetPackage.GetSectionData(section));
+
+	std::vector<const void*> levelData(section.MipLevels);
+	std::vector<VkDeviceSize> levelSizes(section.MipLevels);
+	uint64_t offset = 0;
+	for (uint32_t level = 0; level < section.MipLevels; ++level)
+	{
+		levelData[level] = data + offset;
+		levelSizes[level] = VkUtils::GetMipLevelSize(section.Width, section.Height, level, section.ElementSize);
+		offset += levelSizes[level];
+	}
+
+	CreateTextureFromMipChain(static_cast<VkFormat>(section.Format), { section.Width, section.Height, 1 }, section.MipLevels, levelData, levelSizes);
+}
+
+void VkApplication::LoadTextureData()
+{
+	// Block compressed KTX2 only needs mapping, its format support is checked once the device exists
+	if (m_ktx2Texture.Open(kKtx2TexturePath))
+		return;
+
+	// Cooked texture is used as is from the package
+	auto textureSection = m_assetPackage.IsOpen() ? m_assetPackage.FindSection(VkUtils::PackageSectionType::TextureData) : nullptr;
+	if (textureSection && textureSection->Format == VK_FORMAT_R8G8B8A8_SRGB && textureSection->ElementSize == kBytesPerPixel)
+		return;
+
+	m_texPixels = VkUtils::DecodeImageFile(kTexturePath, &m_texExtent);
+	if (!m_texPixels)
+		throw std::runtime_error("\nERROR : Failed to load texture image from file !\n");
+}
+
+bool VkApplication::CreateTextureFromKtx2()
+{
+	// Kept open, streamed levels are read from it
+	auto& texture = m_ktx2Texture;
+
+	// BC formats are optional (mostly missing on mobile GPUs), the PNG is used instead then
+	auto format = texture.GetFormat();
+	if (!VkUtils::IsFormatSupported(m_mainDevice.physicalDevice, format, VK_IMAGE_TILING_OPTIMAL,
+		VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT))
+	{
+		texture.Close();
+		return false;
+	}
+
+	std::vector<const void*> levelData(texture.GetMipLevels());
+	std::vector<VkDeviceSize> levelSizes(texture.GetMipLevels());
+	for (uint32_t level = 0; level < texture.GetMipLevels(); ++level)
+	{
+		levelData[level] = texture.GetLevelData(level);
+		levelSizes[level] = texture.GetLevelSize(level);
+	}
+
+	// Uncompressed textures stored without mips get them generated, compressed ones can't be blitted to
+	uint32_t mipLevels = texture.GetMipLevels();
+	if (mipLevels == 1 && !VkUtils::IsBlockCompressedFormat(format))
+		mipLevels = VkUtils::CalculateMipLevels(texture.GetExtent());
+
+	CreateTextureFromMipChain(format, texture.GetExtent(), mipLevels, levelData, levelSizes);
+
+#ifdef _DEBUG || DEBUG
+	VkDeviceSize textureSize = 0;
+	for (auto size : levelSizes)
+		textureSize += size;
+	std::cout << "\nTEXTURE LOADED FROM KTX2 : " << kKtx2TexturePath << ", " << texture.GetExtent().width << "x" << texture.GetExtent().height
+		<< ", VkFormat " << format << ", " << texture.GetMipLevels() << " mip levels stored, " << textureSize << " bytes\n";
+#endif
+	return true;
+}
+
+void VkApplication::CreateTextureFromMipChain(VkFormat format, VkExtent3D extent, uint32_t mipLevels,
+	const std::vector<const void*>& levelData, const std::vector<VkDeviceSize>& levelSizes)
+{
+	m_texMipLevels = mipLevels;
+	m_texExtent = extent;
 	m_texSampler = VkUtils::CreateSampler(m_mainDevice.physicalDevice, m_mainDevice.logicalDevice, m_texMipLevels);
+
+	// Whole chain is stored : only the mip tail is uploaded now, finer levels stream in once on screen
+	if (levelData.size() == mipLevels)
+	{
+		VkUtils::StreamedTextureSource source{ format, extent, levelData, levelSizes };
+		m_streamedTexture = m_textureStreamer.AddTexture(source);
+		m_texImage = VK_NULL_HANDLE;
+		m_texMemory = {};
+		m_texImageView = m_textureStreamer.GetImageView(m_streamedTexture);
+
+#ifdef _DEBUG || DEBUG
+		std::cout << "\nTEXTURE STREAMING : level " << m_textureStreamer.GetResidentLevel(m_streamedTexture) << " of " << mipLevels
+			<< " resident at start, " << m_textureStreamer.GetStats().ResidentBytes << " bytes, budget " << kTextureStreamingBudget << " bytes\n";
+#endif
+		return;
+	}
+
+	bool isGeneratingMips = levelData.size() < mipLevels;
+	VkImageUsageFlags usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+	if (isGeneratingMips)
+	{
+		if (!VkUtils::IsFormatSupported(m_mainDevice.physicalDevice, format, VK_IMAGE_TILING_OPTIMAL, VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT))
+			throw std::runtime_error("\nVULKAN ERROR : Texture image format does not support linear blitting!\n");
+		usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+	}
+	VkUtils::AllocateImage2D(m_allocator, m_mainDevice.logicalDevice, extent, format, usage,
+		m_texMipLevels, VK_SAMPLE_COUNT_1_BIT, VkUtils::MemoryCategory::Texture, &m_texImage, &m_texMemory);
+
+	// Copy and mip generation are recorded in the startup upload batch
+	m_uploadManager.UploadImage(m_texImage, extent, m_texMipLevels, levelData, levelSizes);
+
+	m_texImageView = VkUtils::CreateImageView2D(m_mainDevice.logicalDevice, m_texImage, format, VK_IMAGE_ASPECT_COLOR_BIT, m_texMipLevels);
 }
 
 void VkApplication::CreateColorResources()
 {
 	VkExtent3D extent = { m_swapchainExtent.width, m_swapchainExtent.height, 1 };
-	VkUtils::AllocateImage2D(m_mainDevice.physicalDevice, m_mainDevice.logicalDevice, extent, m_swapchainFormat, VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
-		1, m_msaaSamples, &m_colorImage, &m_colorMemory);
+	VkUtils::AllocateImage2D(m_allocator, m_mainDevice.logicalDevice, extent, m_swapchainFormat, VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
+		1, m_msaaSamples, VkUtils::MemoryCategory::Attachment, &m_colorImage, &m_colorMemory);
 	m_colorImageView = VkUtils::CreateImageView2D(m_mainDevice.logicalDevice, m_colorImage, m_swapchainFormat, VK_IMAGE_ASPECT_COLOR_BIT, 1);
 }
 
@@ -821,14 +1457,11 @@ void VkApplication::CreateDepthResources()
 {
 	VkExtent3D extent{ m_swapchainExtent.width, m_swapchainExtent.height, 1.0 };
 	VkFormat depthFormat = VkUtils::FindDepthFormat(m_mainDevice.physicalDevice, VK_IMAGE_TILING_OPTIMAL);
-	VkUtils::AllocateImage2D(m_mainDevice.physicalDevice, m_mainDevice.logicalDevice, extent, depthFormat, 
-		VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, 1, m_msaaSamples, &m_depthImage, &m_depthMemory);
+	VkUtils::AllocateImage2D(m_allocator, m_mainDevice.logicalDevice, extent, depthFormat, 
+		VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, 1, m_msaaSamples, VkUtils::MemoryCategory::Attachment, &m_depthImage, &m_depthMemory);
 
+	// No layout transition, the render pass starts from an undefined layout
 	m_depthImageView = VkUtils::CreateImageView2D(m_mainDevice.logicalDevice, m_depthImage, depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT, 1);
-	VkCommandBuffer tmpCmdBuffer;
-	VkUtils::BeginSingleTimeCommands(m_mainDevice.logicalDevice, m_cmdPool, &tmpCmdBuffer);
-	VkUtils::TransitionImageLayout(tmpCmdBuffer, m_depthImage, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, 1);
-	VkUtils::EndSingleTimeCommands(m_graphicsQueue, tmpCmdBuffer);
 }
 
 void VkApplication::AllocateCommandBuffers()
@@ -837,12 +1470,22 @@ void VkApplication::AllocateCommandBuffers()
 
 	VkCommandBufferAllocateInfo allocInfo{};
 	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-	allocInfo.commandPool = m_cmdPool;
 	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-	allocInfo.commandBufferCount = static_cast<uint32_t>(m_cmdBuffers.size());
+	allocInfo.commandBufferCount = 1;
 
-	if (vkAllocateCommandBuffers(m_mainDevice.logicalDevice, &allocInfo, m_cmdBuffers.data()) != VK_SUCCESS)
-		throw std::runtime_error("\nVULKAN ERROR : Failed to allocate command buffers!\n");
+	// Resetting the pool takes its command buffer back to the initial state, it is allocated once
+	for (size_t i = 0; i < m_cmdBuffers.size(); ++i)
+	{
+		allocInfo.commandPool = m_cmdPools[i];
+		if (vkAllocateCommandBuffers(m_mainDevice.logicalDevice, &allocInfo, &m_cmdBuffers[i]) != VK_SUCCESS)
+			throw std::runtime_error("\nVULKAN ERROR : Failed to allocate command buffers!\n");
+	}
+
+	// Recorder always has room for the benchmark's threads, frames use as many as there are cores
+	auto indices = VkUtils::GetQueueFamiilyIndices(m_mainDevice.physicalDevice, m_surface);
+	m_secondaryRecorder.Init(m_mainDevice.logicalDevice, indices.graphicsFamilyIndex, kMaxRecordingThreads,
+		static_cast<uint32_t>(m_cmdBuffers.size()));
+	m_recordingThreadCount = std::min(std::max(1u, std::thread::hardware_concurrency()), kMaxRecordingThreads);
 }
 
 void VkApplication::CreateSyncObjects()
@@ -870,10 +1513,23 @@ void VkApplication::CreateSyncObjects()
 	}
 }
 
-void VkApplication::RecordCommands()
+void VkApplication::MarkDrawSegmentsDirty()
 {
+	m_isDrawSegmentDirty.assign(m_cmdBuffers.size(), true);
+	m_recordedLods.resize(m_cmdBuffers.size());
+	m_recordedUniformOffsets.resize(m_cmdBuffers.size());
+	m_recordedInstanceRuns.resize(m_cmdBuffers.size());
+}
+
+void VkApplication::RecordCommandBuffer(uint32_t imageIndex, uint32_t lod)
+{
+	// Image's fence is signaled, nothing recorded from its pool is pending
+	if (vkResetCommandPool(m_mainDevice.logicalDevice, m_cmdPools[imageIndex], 0) != VK_SUCCESS)
+		throw std::runtime_error("\nVULKAN ERROR : Failed to reset command pool !\n");
+
 	VkCommandBufferBeginInfo cmdBeginInfo{};
 	cmdBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	cmdBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
 
 	VkRenderPassBeginInfo renderBeginInfo{};
 	renderBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
@@ -887,28 +1543,134 @@ void VkApplication::RecordCommands()
 
 	renderBeginInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
 	renderBeginInfo.pClearValues = clearValues.data();
+	renderBeginInfo.framebuffer = m_swapchainFramebuffers[imageIndex];
+
+	auto& cmdBuffer = m_cmdBuffers[imageIndex];
+
+	if (vkBeginCommandBuffer(cmdBuffer, &cmdBeginInfo) != VK_SUCCESS)
+		throw std::runtime_error("\nVULKAN ERROR : Failed to start record commands !\n");
+
+	// Record
+	// Draws are written by a compute pass, it runs outside the render pass
+	bool isGpuCulled = m_isGpuCulling && m_instanceScene.GetInstanceCount() > 0;
+	if (isGpuCulled)
+		m_gpuCuller.RecordCulling(cmdBuffer, imageIndex, m_cullUniformOffsets[imageIndex]);
+
+	if (m_isDrawSegmentDirty[imageIndex])
+		RecordDrawSegment(imageIndex, lod);
+
+	vkCmdBeginRenderPass(cmdBuffer, &renderBeginInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+	const auto& secondaryCmdBuffers = m_secondaryRecorder.GetCommandBuffers(imageIndex);
+	if (!secondaryCmdBuffers.empty())
+		vkCmdExecuteCommands(cmdBuffer, static_cast<uint32_t>(secondaryCmdBuffers.size()), secondaryCmdBuffers.data());
+	vkCmdEndRenderPass(cmdBuffer);
 
-	for (int i = 0; i < m_swapchainFramebuffers.size(); ++i)
+	if (isGpuCulled)
+		m_gpuCuller.RecordReadback(cmdBuffer, imageIndex);
+
+	if (vkEndCommandBuffer(cmdBuffer) != VK_SUCCESS)
+		throw std::runtime_error("\nVULKAN ERROR : Failed to stop record commands !\n");
+}
+
+void VkApplication::RecordDrawSegment(uint32_t imageIndex, uint32_t lod)
+{
+	// Nothing to draw without instances, and no instance buffer to bind either
+	uint32_t instanceCount = m_instanceScene.GetInstanceCount();
+	bool isGpuCulled = m_isGpuCulling && instanceCount > 0;
+
+	// Draws are split among the recording threads, each into a secondary command buffer continuing the render pass
+	VkCommandBufferInheritanceInfo inheritanceInfo{};
+	inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+	inheritanceInfo.renderPass = m_renderPass;
+	inheritanceInfo.subpass = 0;
+	inheritanceInfo.framebuffer = m_swapchainFramebuffers[imageIndex];
+
+	// Indirect draws are a single command, CPU culled ones are a draw per run and sub mesh of the LOD
+	// Nothing is drawn while the pipeline compiles, the segment is marked dirty once it is ready
+	const auto& meshLod = m_lods[lod];
+	VkPipeline pipeline = m_pipelineManager.Get(m_graphicsPipeline);
+	uint32_t itemCount = 0;
+	if (instanceCount > 0 && pipeline != VK_NULL_HANDLE)
+		itemCount = isGpuCulled ? 1 : static_cast<uint32_t>(m_instanceRuns.size()) * meshLod.SubMeshCount;
+
+	m_secondaryRecorder.Record(imageIndex, inheritanceInfo, itemCount, m_recordingThreadCount,
+		[this, imageIndex, isGpuCulled, pipeline, &meshLod](VkCommandBuffer secondaryCmdBuffer, uint32_t firstItem, uint32_t runItemCount)
+	{
+		BindDrawState(secondaryCmdBuffer, imageIndex, pipeline);
+		if (isGpuCulled)
+		{
+			m_gpuCuller.RecordDraws(secondaryCmdBuffer, imageIndex);
+			return;
+		}
+
+		// One instanced draw per run of visible instances, firstInstance offsets into the instance buffer
+		for (uint32_t item = firstItem; item < firstItem + runItemCount; ++item)
+		{
+			const auto& run = m_instanceRuns[item / meshLod.SubMeshCount];
+			const auto& subMesh = m_subMeshes[meshLod.FirstSubMesh + item % meshLod.SubMeshCount];
+			vkCmdDrawIndexed(secondaryCmdBuffer, subMesh.IndexCount, run.InstanceCount, subMesh.FirstIndex, subMesh.VertexOffset, run.FirstInstance);
+		}
+	});
+
+	m_isDrawSegmentDirty[imageIndex] = false;
+	m_recordedLods[imageIndex] = lod;
+	m_recordedUniformOffsets[imageIndex] = m_uniformOffsets[imageIndex];
+	m_recordedInstanceRuns[imageIndex] = m_instanceRuns;
+}
+
+void VkApplication::BindDrawState(VkCommandBuffer cmdBuffer, uint32_t imageIndex, VkPipeline pipeline)
+{
+	vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+
+	VkBuffer buffers[] = { m_vertexBuffer, m_instanceScene.GetBuffer(imageIndex) };
+	VkDeviceSize deviceSizes[] = { 0, 0 };
+	vkCmdBindVertexBuffers(cmdBuffer, 0, _countof(buffers), buffers, deviceSizes);
+	vkCmdBindIndexBuffer(cmdBuffer, m_indexBuffer, 0, m_indexType);
+	vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelineLayout, 0, 1, &m_descriptorSets[imageIndex],
+		1, &m_uniformOffsets[imageIndex]);
+	VkUtils::DrawPushConstants drawConstants{ m_modelMatrix, m_vertexQuantization, m_materialIndex };
+	vkCmdPushConstants(cmdBuffer, m_pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(drawConstants), &drawConstants);
+}
+
+void VkApplication::BenchmarkRecording()
+{
+	uint32_t instanceCount = m_instanceScene.GetInstanceCount();
+	if (instanceCount == 0)
+		return;
+	// Compile time isn't what is measured
+	m_pipelineManager.Wait(m_graphicsPipeline);
+	VkPipeline pipeline = m_pipelineManager.Get(m_graphicsPipeline);
+
+	VkCommandBufferInheritanceInfo inheritanceInfo{};
+	inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+	inheritanceInfo.renderPass = m_renderPass;
+	inheritanceInfo.subpass = 0;
+	inheritanceInfo.framebuffer = m_swapchainFramebuffers[0];
+
+	// A draw per instance and sub mesh of the full mesh, wrapping around the instances, as CPU culling records them
+	const auto& meshLod = m_lods[0];
+	auto record = [this, instanceCount, pipeline, &meshLod](VkCommandBuffer cmdBuffer, uint32_t firstItem, uint32_t itemCount)
+	{
+		BindDrawState(cmdBuffer, 0, pipeline);
+		for (uint32_t item = firstItem; item < firstItem + itemCount; ++item)
+		{
+			const auto& subMesh = m_subMeshes[meshLod.FirstSubMesh + item % meshLod.SubMeshCount];
+			vkCmdDrawIndexed(cmdBuffer, subMesh.IndexCount, 1, subMesh.FirstIndex, subMesh.VertexOffset, (item / meshLod.SubMeshCount) % instanceCount);
+		}
+	};
+
+	std::cout << "\nRECORDING BENCHMARK : " << kRecordingBenchmarkDrawCount << " draws, " << std::thread::hardware_concurrency() << " cores\n";
+	float singleThreadTime = 0.0f;
+	for (uint32_t threadCount = 1; threadCount <= kMaxRecordingThreads; threadCount *= 2)
 	{
-		renderBeginInfo.framebuffer = m_swapchainFramebuffers[i];
-		auto& cmdBuffer = m_cmdBuffers[i];
-
-		if (vkBeginCommandBuffer(cmdBuffer, &cmdBeginInfo) != VK_SUCCESS)
-			throw std::runtime_error("\nVULKAN ERROR : Failed to start record commands !\n");
-
-		// Record
-		vkCmdBeginRenderPass(cmdBuffer, &renderBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
-		vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_graphicsPipeline);
-		VkBuffer buffers[] = { m_vertexBuffer };
-		VkDeviceSize deviceSizes[] = { 0 };
-		vkCmdBindVertexBuffers(cmdBuffer, 0, 1, buffers, deviceSizes);
-		vkCmdBindIndexBuffer(cmdBuffer, m_indexBuffer, 0, VK_INDEX_TYPE_UINT32);
-		vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelineLayout, 0, 1, &m_descriptorSets[i], 0, nullptr);
-		vkCmdDrawIndexed(cmdBuffer, static_cast<uint32_t>(m_indices.size()), 1, 0, 0, 0);
-		vkCmdEndRenderPass(cmdBuffer);
-
-		if (vkEndCommandBuffer(cmdBuffer) != VK_SUCCESS)
-			throw std::runtime_error("\nVULKAN ERROR : Failed to stop record commands !\n");
+		auto startTime = std::chrono::high_resolution_clock::now();
+		for (uint32_t i = 0; i < kRecordingBenchmarkIterations; ++i)
+			m_secondaryRecorder.Record(0, inheritanceInfo, kRecordingBenchmarkDrawCount, threadCount, record);
+		auto time = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count() / kRecordingBenchmarkIterations;
+		if (threadCount == 1)
+			singleThreadTime = time;
+
+		std::cout << "\t" << threadCount << " thread(s) : " << time << " ms, x" << singleThreadTime / time << "\n";
 	}
 }
 
@@ -918,10 +1680,70 @@ void VkApplication::RenderFrame()
 	if (vkAcquireNextImageKHR(m_mainDevice.logicalDevice, m_swapchain, UINT64_MAX, m_imageAvailableSemaphores[m_currenFrame], VK_NULL_HANDLE, &imageIndex) != VK_SUCCESS)
 		throw std::runtime_error("\nVULKAN ERROR : Failed to acquire swap chain's image !\n");
 
+	// Image may still be rendered by an older frame, its command buffer can't be touched before that is done
+	if (m_imagesInFlight[imageIndex] != VK_NULL_HANDLE && m_imagesInFlight[imageIndex] != m_inFlightFences[m_currenFrame])
+		vkWaitForFences(m_mainDevice.logicalDevice, 1, &m_imagesInFlight[imageIndex], VK_TRUE, UINT64_MAX);
 	m_imagesInFlight[imageIndex] = m_inFlightFences[m_currenFrame];
 
 	vkWaitForFences(m_mainDevice.logicalDevice, 1, &m_imagesInFlight[imageIndex], VK_TRUE, UINT64_MAX);
 	vkResetFences(m_mainDevice.logicalDevice, 1, &m_imagesInFlight[imageIndex]);
+
+	// Image's fence is signaled, its ring region and instance buffer are free
+	m_uniformRing.BeginFrame(imageIndex);
+	// Segments recorded while a pipeline compiled skipped its draws
+	if (m_pipelineManager.Update())
+		MarkDrawSegmentsDirty();
+	// Instance count and buffers are part of the recorded draws
+	if (m_instanceScene.UpdateFrame(imageIndex))
+	{
+		if (m_isGpuCulling)
+			m_gpuCuller.UpdateFrame(imageIndex, m_instanceScene.GetBuffer(imageIndex), m_instanceScene.GetInstanceCount());
+		m_isDrawSegmentDirty[imageIndex] = true;
+	}
+
+	auto ubo = UpdateUniformBuffer(imageIndex);
+	uint32_t lod = 0;
+	float pixelsPerUnit = 0.0f;
+	if (m_isGpuCulling)
+	{
+		// Every object got its own LOD on the GPU, the texture follows the most detailed one this image's last frame drew
+		// Nothing here loops over the instances
+		pixelsPerUnit = m_gpuCuller.ReadStats(imageIndex).MaxPixelsPerUnit;
+	}
+	else
+	{
+		CullInstances(ubo);
+		pixelsPerUnit = GetModelPixelsPerUnit(ubo, GetClosestInstanceModel(ubo));
+		lod = SelectLod(pixelsPerUnit);
+	}
+	// Offset only moves when what is written per frame changes, runs when the camera or the instances move
+	// Culling's offset is recorded in the primary command buffer, every frame
+	if (m_recordedLods[imageIndex] != lod || m_recordedUniformOffsets[imageIndex] != m_uniformOffsets[imageIndex] ||
+		m_recordedInstanceRuns[imageIndex] != m_instanceRuns)
+		m_isDrawSegmentDirty[imageIndex] = true;
+
+	if (m_streamedTexture != UINT32_MAX)
+	{
+		m_textureStreamer.RequestLevel(m_streamedTexture, SelectTextureMipLevel(pixelsPerUnit));
+		if (m_textureStreamer.Update())
+		{
+			m_texImageView = m_textureStreamer.GetImageView(m_streamedTexture);
+#ifdef _DEBUG || DEBUG
+			const auto& stats = m_textureStreamer.GetStats();
+			std::cout << "\nTEXTURE STREAMING : level " << m_textureStreamer.GetResidentLevel(m_streamedTexture) << " resident, "
+				<< stats.ResidentBytes << " / " << stats.Budget << " bytes, " << stats.UploadCount << " uploads, " << stats.EvictionCount << " evictions\n";
+#endif
+		}
+
+		// Bound descriptor sets can't change under a recorded command buffer, the draw segment is recorded again
+		if (m_textureVersions[imageIndex] != m_textureStreamer.GetVersion(m_streamedTexture))
+		{
+			UpdateTextureDescriptor(imageIndex);
+			m_isDrawSegmentDirty[imageIndex] = true;
+		}
+	}
+
+	RecordCommandBuffer(imageIndex, lod);
 		
 	VkSubmitInfo submitInfo{};
 	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
@@ -938,8 +1760,6 @@ void VkApplication::RenderFrame()
 	VkSemaphore signalSemaphores[] = { m_renderFinishedSemapheres[m_currenFrame] };
 	submitInfo.signalSemaphoreCount = _countof(signalSemaphores);
 	submitInfo.pSignalSemaphores = signalSemaphores;
-	
-	UpdateUniformBuffer(imageIndex);
 
 	if (vkQueueSubmit(m_graphicsQueue, 1, &submitInfo, m_imagesInFlight[imageIndex]) != VK_SUCCESS)
 		throw std::runtime_error("\nVULKAN ERROR : Failed to submit rendering to swap chain's image !\n");
@@ -960,25 +1780,124 @@ void VkApplication::RenderFrame()
 	m_currenFrame = (m_currenFrame + 1) % MAX_FRAMES_IN_FLIGHT;
 }
 
-void VkApplication::UpdateUniformBuffer(uint16_t imageIndex)
+VkUtils::UniformBufferObject VkApplication::UpdateUniformBuffer(uint16_t imageIndex)
 {
-	VkDeviceSize bufferSize = sizeof(VkUtils::UniformBufferObject);
-	auto& memory = m_uniformBufferMemorys[imageIndex];
-
-	static auto s_startTime = std::chrono::high_resolution_clock::now();
-	auto currentTime = std::chrono::high_resolution_clock::now();
-	float time = std::chrono::duration<float, std::chrono::seconds::period>(currentTime - s_startTime).count();
+	if (m_isCameraDirty)
+		UpdateCamera();
 
 	VkUtils::UniformBufferObject ubo{};
-	ubo.Model = glm::rotate(glm::mat4(1.0f), glm::radians(0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-	ubo.View = glm::lookAt(glm::vec3(2.0f, 2.0f, 2.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-	ubo.Proj = glm::perspective(glm::radians(45.0f), static_cast<float>(m_screenWidth) / m_screenHeight, 0.1f, 10.0f);
-	ubo.Proj[1][1] *= -1;
-
-	void* data = nullptr;
-	vkMapMemory(m_mainDevice.logicalDevice, memory, 0, bufferSize, 0, &data);
-	memcpy(data, &ubo, bufferSize);
-	vkUnmapMemory(m_mainDevice.logicalDevice, memory);
+	ubo.View = m_viewMatrix;
+	ubo.Proj = m_projMatrix;
+
+	m_uniformOffsets[imageIndex] = m_uniformRing.Push(ubo);
+	if (m_isGpuCulling)
+		m_cullUniformOffsets[imageIndex] = m_gpuCuller.PushUniforms(m_uniformRing, imageIndex, ubo, m_modelMatrix,
+			static_cast<float>(m_swapchainExtent.height));
+
+	return ubo;
+}
+
+void VkApplication::UpdateCamera()
+{
+	float fovY = glm::radians(45.0f);
+	glm::vec3 eye(2.0f, 2.0f, 2.0f);
+	glm::vec3 target(0.0f);
+	float farPlane = 10.0f;
+	// Back off along the same direction until the whole grid is in view
+	if (m_instanceScene.GetInstanceCount() > 1)
+	{
+		float distance = m_sceneBounds.Radius / std::sin(fovY * 0.5f);
+		target = m_sceneBounds.Center;
+		eye = target + glm::normalize(glm::vec3(1.0f)) * distance;
+		farPlane = distance + m_sceneBounds.Radius;
+	}
+
+	m_viewMatrix = glm::lookAt(eye, target, glm::vec3(0.0f, 0.0f, 1.0f));
+	m_projMatrix = glm::perspective(fovY, static_cast<float>(m_screenWidth) / m_screenHeight, 0.1f, farPlane);
+	m_projMatrix[1][1] *= -1;
+	m_isCameraDirty = false;
+}
+
+float VkApplication::GetModelPixelsPerUnit(const VkUtils::UniformBufferObject& ubo, const glm::mat4& model) const
+{
+	// Distance from the eye to the nearest point of the model's bounding sphere
+	glm::vec4 viewCenter = ubo.View * model * glm::vec4(m_modelBounds.Center, 1.0f);
+	float modelScale = std::max(glm::length(glm::vec3(model[0])), std::max(glm::length(glm::vec3(model[1])),
+		glm::length(glm::vec3(model[2]))));
+	float distance = glm::length(glm::vec3(viewCenter)) - m_modelBounds.Radius * modelScale;
+	// Camera inside the sphere, only full detail will do
+	if (distance <= 0.0f)
+		return std::numeric_limits<float>::max();
+
+	// Proj[1][1] is 1 / tan(fovY / 2) : pixels covered by one object space unit at that distance
+	return std::abs(ubo.Proj[1][1]) * m_swapchainExtent.height * 0.5f * modelScale / distance;
+}
+
+void VkApplication::CullInstances(const VkUtils::UniformBufferObject& ubo)
+{
+	// Bounds only change with the instances, the BVH is rebuilt then
+	if (m_culledInstanceVersion != m_instanceScene.GetVersion())
+	{
+		const auto& instances = m_instanceScene.GetInstances();
+		std::vector<VkUtils::BoundingSphere> bounds(instances.size());
+		for (size_t i = 0; i < instances.size(); ++i)
+			bounds[i] = VkUtils::TransformBoundingSphere(m_modelBounds, m_modelMatrix * instances[i].Model);
+		m_frustumCuller.SetObjects(bounds);
+		m_culledInstanceVersion = m_instanceScene.GetVersion();
+	}
+
+	glm::vec4 frustumPlanes[6];
+	VkUtils::GetFrustumPlanes(ubo.Proj * ubo.View, frustumPlanes);
+	m_visibleInstances.clear();
+	m_frustumCuller.Cull(frustumPlanes, m_visibleInstances);
+	VkUtils::BuildInstanceRuns(m_visibleInstances, m_instanceRuns);
+}
+
+glm::mat4 VkApplication::GetClosestInstanceModel(const VkUtils::UniformBufferObject& ubo) const
+{
+	glm::mat4 closestModel = m_modelMatrix;
+	float maxPixelsPerUnit = -1.0f;
+	const auto& instances = m_instanceScene.GetInstances();
+	for (auto index : m_visibleInstances)
+	{
+		glm::mat4 model = m_modelMatrix * instances[index].Model;
+		float pixelsPerUnit = GetModelPixelsPerUnit(ubo, model);
+		if (pixelsPerUnit > maxPixelsPerUnit)
+		{
+			maxPixelsPerUnit = pixelsPerUnit;
+			closestModel = model;
+		}
+	}
+
+	return closestModel;
+}
+
+uint32_t VkApplication::SelectLod(float pixelsPerUnit) const
+{
+	if (m_lods.size() < 2)
+		return 0;
+
+	uint32_t lod = static_cast<uint32_t>(m_lods.size()) - 1;
+	while (lod > 0 && m_lods[lod].Error * pixelsPerUnit > kLodPixelErrorThreshold)
+		--lod;
+	return lod;
+}
+
+uint32_t VkApplication::SelectTextureMipLevel(float pixelsPerUnit) const
+{
+	if (m_modelBounds.Radius <= 0.0f)
+		return 0;
+	// Nothing visible, the smallest level will do
+	if (pixelsPerUnit <= 0.0f)
+		return m_texMipLevels - 1;
+
+	// Texture is assumed spread over the model's projected diameter, level 0 is needed once it gets a texel per pixel
+	float projectedSize = 2.0f * m_modelBounds.Radius * pixelsPerUnit;
+	float textureSize = static_cast<float>(std::max(m_texExtent.width, m_texExtent.height));
+	if (projectedSize >= textureSize)
+		return 0;
+
+	return std::min(m_texMipLevels - 1, static_cast<uint32_t>(std::log2(textureSize / projectedSize)));
 }
 
 void VkApplication::SetUpVkDebugMessengerEXT()
@@ -1,6 +1,22 @@
 #pragma once
 
 #include "VkUtils.h"
+#include "AssetPackage.h"
+#include "MeshletBuilder.h"
+#include "KtxLoader.h"
+#include "TextureStreamer.h"
+#include "UploadManager.h"
+#include "DeviceAllocator.h"
+#include "UniformRing.h"
+#include "InstanceScene.h"
+#include "GpuCuller.h"
+#include "FrustumCuller.h"
+#include "SecondaryRecorder.h"
+#include "PipelineCache.h"
+#include "PipelineManager.h"
+#include "LockFreeQueue.h"
+#include <thread>
+#include <exception>
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
 
@@ -16,6 +32,27 @@ private:
 	int m_screenHeight;
 	const char* m_title;
 private:
+	enum class LoadedAssetType
+	{
+		Model,
+		Texture,
+	};
+
+	// Handed from a loader thread to the upload stage, the CPU data itself is in the members the loader filled
+	struct LoadedAsset
+	{
+		LoadedAssetType Type;
+		std::exception_ptr Error;		// loader threw, rethrown by the upload stage
+		float LoadTime;					// ms
+	};
+
+	// Start loading model and texture on worker threads, InitVulkan uploads them
+	void StartAssetLoading();
+	void RunAssetLoader(LoadedAssetType type, void (VkApplication::*load)());
+	void JoinAssetLoaders();
+	// Upload every asset as its loader finishes, in completion order
+	void UploadLoadedAssets();
+
 	void InitWindow();
 	void InitVulkan();
 	void MainLoop();
@@ -34,26 +71,64 @@ private:
 	void CreateSyncObjects();
 	
 	void CreateDescriptorSetLayout();
+	// Create the pipeline layout and request the pipeline for the model's vertex format, compiled in the background
 	void CreateGraphicsPipeline();
+	// Called on a pipeline manager's worker, only reads what is set before CreateGraphicsPipeline
+	VkPipeline BuildGraphicsPipeline(VkUtils::VertexFormat vertexFormat, VkPipelineCache pipelineCache) const;
 	
 	void LoadModelToBuffer();
 	void CreateVertexBuffer();
 	void CreateIndexBuffer();
 	void CreateUniformBuffer();
+	// One model at the origin, or the stress test grid
+	void CreateInstances();
+	// count copies of the model on a square grid in the XY plane, centered on the origin
+	void SpawnInstanceGrid(uint32_t count);
+	// Compute culling and indirect draws of the instances, if the device and the compiled shader allow it
+	void CreateGpuCuller();
+	// Without GPU culling : find the instances in the frustum and the runs of them to draw
+	void CullInstances(const VkUtils::UniformBufferObject& ubo);
 
 	void CreateTexture();
+	void CreateTextureFromPackage(const VkUtils::PackageSection& section);
+	// Return false if the mapped KTX2 texture's format can't be sampled by this device
+	bool CreateTextureFromKtx2();
+	// CPU side of the texture, runs on a loader thread : map KTX2 file, or decode PNG if no preprocessed texture exists
+	void LoadTextureData();
+	// Upload levelData as the first mip levels of the texture, the remaining ones up to mipLevels are generated
+	void CreateTextureFromMipChain(VkFormat format, VkExtent3D extent, uint32_t mipLevels,
+		const std::vector<const void*>& levelData, const std::vector<VkDeviceSize>& levelSizes);
 	void CreateColorResources();
 	void CreateDepthResources();
 	void CreateFramebuffers();
 	
 	void CreateDescriptorPool();
 	void AllocateDescriptorSets();
+	// Point imageIndex's descriptor set at the current texture view
+	void UpdateTextureDescriptor(uint32_t imageIndex);
 	
-	void RecordCommands();
+	// Have every swapchain image record its draw segment again before its next frame
+	void MarkDrawSegmentsDirty();
+	// Record imageIndex's primary command buffer, its draw segment too if it is dirty
+	void RecordCommandBuffer(uint32_t imageIndex, uint32_t lod);
+	void RecordDrawSegment(uint32_t imageIndex, uint32_t lod);
+	// Bind what every draw of the render pass uses, each secondary command buffer starts without state
+	void BindDrawState(VkCommandBuffer cmdBuffer, uint32_t imageIndex, VkPipeline pipeline);
+	// Time recording the same draws with 1, 2, 4 and 8 threads, before anything is submitted
+	void BenchmarkRecording();
 
 	void RenderFrame();
 
-	void UpdateUniformBuffer(uint16_t imageIndex);
+	// Write this frame's uniforms to imageIndex's ring region
+	VkUtils::UniformBufferObject UpdateUniformBuffer(uint16_t imageIndex);
+	void UpdateCamera();
+	// Pixels covered by one model space unit at the model's nearest point
+	float GetModelPixelsPerUnit(const VkUtils::UniformBufferObject& ubo, const glm::mat4& model) const;
+	// pixelsPerUnit : of the model as GetModelPixelsPerUnit measures it
+	uint32_t SelectLod(float pixelsPerUnit) const;
+	uint32_t SelectTextureMipLevel(float pixelsPerUnit) const;
+	// Transform of the visible instance covering the most pixels per unit, every instance shares its LOD and texture level
+	glm::mat4 GetClosestInstanceModel(const VkUtils::UniformBufferObject& ubo) const;
 private:
 
 	void SetUpVkDebugMessengerEXT();
@@ -76,6 +151,8 @@ private:
 		VkDevice logicalDevice;
 	}m_mainDevice;
 	VkQueue m_graphicsQueue;
+	// Graphics queue itself if the device has no transfer only family
+	VkQueue m_transferQueue;
 	VkQueue m_presentationQueue;
 
 	VkSurfaceKHR m_surface;
@@ -88,42 +165,120 @@ private:
 	VkRenderPass m_renderPass;
 	VkDescriptorSetLayout m_descriptorSetLayout;
 	VkPipelineLayout m_pipelineLayout;
-	VkPipeline m_graphicsPipeline;
+	// Draws are skipped until the pipeline manager has compiled it
+	VkUtils::PipelineHandle m_graphicsPipeline;
+	// Read at startup, every pipeline is created from it, written back at shutdown
+	VkUtils::PipelineCache m_pipelineCache;
+	VkUtils::PipelineManager m_pipelineManager;
 
 	std::vector<VkFramebuffer> m_swapchainFramebuffers;
-	VkCommandPool m_cmdPool;
+	// One per swapchain image, reset whenever the image's primary command buffer is recorded, every frame
+	std::vector<VkCommandPool> m_cmdPools;
 	std::vector<VkCommandBuffer> m_cmdBuffers;
+	// Draw segments : draws of the render pass, recorded on several threads into secondary command buffers
+	// and cached across frames, the primary command buffers execute them
+	VkUtils::SecondaryRecorder m_secondaryRecorder;
+	uint32_t m_recordingThreadCount;
 	std::vector<VkSemaphore> m_imageAvailableSemaphores;
 	std::vector<VkSemaphore> m_renderFinishedSemapheres;
 	std::vector<VkFence> m_inFlightFences;
 	std::vector<VkFence> m_imagesInFlight;
+	// Swapchain images whose draw segment must be recorded again, what it was recorded with has changed
+	std::vector<bool> m_isDrawSegmentDirty;
+	// LOD each swapchain image's draw segment currently draws
+	std::vector<uint32_t> m_recordedLods;
+	// Dynamic uniform offset each swapchain image's draw segment binds
+	std::vector<uint32_t> m_recordedUniformOffsets;
+	// Instance runs each swapchain image's draw segment draws, without GPU culling
+	std::vector<std::vector<VkUtils::InstanceRun>> m_recordedInstanceRuns;
 	uint16_t m_currenFrame;
 
+	std::chrono::high_resolution_clock::time_point m_startTime;
+
+	std::thread m_modelLoader;
+	std::thread m_textureLoader;
+	VkUtils::LockFreeQueue<LoadedAsset> m_loadedAssets;
+
+	// Cooked assets, mapped during InitVulkan only
+	VkUtils::AssetPackage m_assetPackage;
+
+	VkUtils::VertexFormat m_vertexFormat;
+	VkUtils::VertexQuantization m_vertexQuantization;
+	// Pushed with the draw when command buffers are recorded
+	glm::mat4 m_modelMatrix;
+	uint32_t m_materialIndex;
 	std::vector<VkUtils::Vertex> m_vertices;
+	std::vector<VkUtils::PackedVertex> m_packedVertices;
 	std::vector<uint32_t> m_indices;
+	std::vector<uint16_t> m_shortIndices;
+	std::vector<VkUtils::SubMesh> m_subMeshes;
+	std::vector<VkUtils::Meshlet> m_meshlets;
+	// Meshlet triangles, the draw indices keep their own order
+	std::vector<uint16_t> m_meshletIndices;
+	std::vector<VkUtils::MeshLod> m_lods;
+	VkUtils::BoundingSphere m_modelBounds;
+	// Copies of the model, drawn with one instanced draw per submesh
+	VkUtils::InstanceScene m_instanceScene;
+	// Bounds of every instance, framed by the camera
+	VkUtils::BoundingSphere m_sceneBounds;
+	// Instances are culled and their LOD picked on the GPU, drawn with one indirect call
+	VkUtils::GpuCuller m_gpuCuller;
+	bool m_isGpuCulling;
+	bool m_hasDrawIndirectCount;
+	// Otherwise instances are culled on the CPU, visible ones are drawn as runs of consecutive instances
+	VkUtils::FrustumCuller m_frustumCuller;
+	// Instance version the culler's bounds were set from
+	uint64_t m_culledInstanceVersion;
+	std::vector<uint32_t> m_visibleInstances;
+	std::vector<VkUtils::InstanceRun> m_instanceRuns;
+	VkIndexType m_indexType;
+	// Bytes uploaded to vertex/index buffers, point either into the vectors above or into the mapped package
+	const void* m_vertexUploadData;
+	VkDeviceSize m_vertexUploadSize;
+	const void* m_indexUploadData;
+	VkDeviceSize m_indexUploadSize;
 	VkBuffer m_vertexBuffer;
-	VkDeviceMemory m_vertexBufferMemory;
+	VkUtils::DeviceAllocation m_vertexBufferMemory;
 	VkBuffer m_indexBuffer;
-	VkDeviceMemory m_indexBufferMemory;
+	VkUtils::DeviceAllocation m_indexBufferMemory;
 
-	std::vector<VkBuffer> m_uniformBuffers;
-	std::vector<VkDeviceMemory> m_uniformBufferMemorys;
+	// A region per swapchain image, rewritten once the image's fence is signaled
+	VkUtils::UniformRing m_uniformRing;
+	// Dynamic offset of this frame's uniforms, per swapchain image
+	std::vector<uint32_t> m_uniformOffsets;
+	std::vector<uint32_t> m_cullUniformOffsets;
+	// Camera only changes with the extent, not every frame
+	glm::mat4 m_viewMatrix;
+	glm::mat4 m_projMatrix;
+	bool m_isCameraDirty;
 	VkDescriptorPool m_descriptorPool;
 	std::vector<VkDescriptorSet> m_descriptorSets;
 
 	uint32_t m_texMipLevels;
+	VkExtent3D m_texExtent;
+	VkUtils::Ktx2Texture m_ktx2Texture;
+	// Decoded PNG, until uploaded
+	VkUtils::DecodedPixels m_texPixels;
+	// Device memory of every buffer and image
+	VkUtils::DeviceAllocator m_allocator;
+	VkUtils::TextureStreamer m_textureStreamer;
+	VkUtils::UploadManager m_uploadManager;
+	// Index in m_textureStreamer, UINT32_MAX when the texture is fully uploaded at start instead
+	uint32_t m_streamedTexture;
+	// Texture version each swapchain image's descriptor set points to
+	std::vector<uint32_t> m_textureVersions;
 	VkImage m_texImage;
-	VkDeviceMemory m_texMemory;
+	VkUtils::DeviceAllocation m_texMemory;
 	VkImageView m_texImageView;
 	VkSampler m_texSampler;
 
 	VkImage m_depthImage;
-	VkDeviceMemory m_depthMemory;
+	VkUtils::DeviceAllocation m_depthMemory;
 	VkImageView m_depthImageView;
 
 	VkSampleCountFlagBits m_msaaSamples;
 	VkImage m_colorImage;
-	VkDeviceMemory m_colorMemory;
+	VkUtils::DeviceAllocation m_colorMemory;
 	VkImageView m_colorImageView;
 };
 
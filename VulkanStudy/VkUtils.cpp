@@ -2,6 +2,9 @@
 
 #include <iostream>
 #include <fstream>
+#include <thread>
+#include <algorithm>
+#include <cmath>
 
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
@@ -9,10 +12,9 @@
 #define TINYOBJLOADER_IMPLEMENTATION
 #include <tiny_obj_loader.h>
 
-namespace
-{
-	constexpr int kBytesPerPixel = 4;
-}
+#include "MeshUtils.h"
+#include "ObjLoader.h"
+#include "DeviceAllocator.h"
 
 static VKAPI_ATTR VkBool32 VKAPI_CALL VkDebugCallback(
 	VkDebugUtilsMessageSeverityFlagBitsEXT messageServerities,
@@ -59,6 +61,64 @@ namespace VkUtils
 
 		return descs;
 	}
+
+	VkVertexInputBindingDescription PackedVertex::GetBindingDescription()
+	{
+		VkVertexInputBindingDescription desc{};
+		desc.binding = 0;
+		desc.stride = sizeof(PackedVertex);
+		desc.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+		return desc;
+	}
+
+	std::vector<VkVertexInputAttributeDescription> PackedVertex::GetAttributeDescriptions()
+	{
+		std::vector<VkVertexInputAttributeDescription> descs;
+		descs.resize(3, {});
+
+		descs[0].binding = 0;
+		descs[0].location = 0;
+		descs[0].format = VK_FORMAT_R16G16B16A16_UNORM;
+		descs[0].offset = offsetof(PackedVertex, Pos);
+
+		descs[1].binding = 0;
+		descs[1].location = 1;
+		descs[1].format = VK_FORMAT_R16G16_SNORM;
+		descs[1].offset = offsetof(PackedVertex, Normal);
+
+		descs[2].binding = 0;
+		descs[2].location = 2;
+		descs[2].format = VK_FORMAT_R16G16_SFLOAT;
+		descs[2].offset = offsetof(PackedVertex, TexCoord);
+
+		return descs;
+	}
+
+	VkVertexInputBindingDescription InstanceData::GetBindingDescription()
+	{
+		VkVertexInputBindingDescription desc{};
+		desc.binding = 1;
+		desc.stride = sizeof(InstanceData);
+		desc.inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
+		return desc;
+	}
+
+	std::vector<VkVertexInputAttributeDescription> InstanceData::GetAttributeDescriptions()
+	{
+		std::vector<VkVertexInputAttributeDescription> descs;
+		descs.resize(4, {});
+
+		// A mat4 attribute takes a location per column
+		for (uint32_t i = 0; i < 4; ++i)
+		{
+			descs[i].binding = 1;
+			descs[i].location = 3 + i;
+			descs[i].format = VK_FORMAT_R32G32B32A32_SFLOAT;
+			descs[i].offset = offsetof(InstanceData, Model) + i * sizeof(glm::vec4);
+		}
+
+		return descs;
+	}
 }
 
 namespace VkUtils
@@ -204,6 +264,21 @@ namespace VkUtils
 		return true;
 	}
 
+	bool IsDeviceExtensionSupported(VkPhysicalDevice device, const char* extensionName)
+	{
+		uint32_t extensionCount = 0;
+		vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
+		std::vector<VkExtensionProperties> extensions(extensionCount);
+		vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, extensions.data());
+
+		for (const auto& extension : extensions)
+		{
+			if (strcmp(extensionName, extension.extensionName) == 0)
+				return true;
+		}
+
+		return false;
+	}
 
 	bool CheckVkPhysicalDeviceSuitable(VkPhysicalDevice device, VkSurfaceKHR surface)
 	{
@@ -247,21 +322,27 @@ namespace VkUtils
 		int index = 0;
 		for (const auto& queueFamily : queueFamilies)
 		{
-			if (queueFamily.queueCount > 0 && queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT)
+			if (queueFamily.queueCount > 0 && queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT && indices.graphicsFamilyIndex == UINT32_MAX)
 				indices.graphicsFamilyIndex = index;
 
 			VkBool32 presentationSupported = false;
 			vkGetPhysicalDeviceSurfaceSupportKHR(device, index, surface, &presentationSupported);
 
-			if (queueFamily.queueCount > 0 && presentationSupported)
+			if (queueFamily.queueCount > 0 && presentationSupported && indices.presentationFamilyIndex == UINT32_MAX)
 				indices.presentationFamilyIndex = index;
 
-			if (indices.IsValid())
-				break;
+			// Family without graphics is a copy engine, or an async compute one still able to copy if there's no pure transfer family
+			bool isTransferOnly = queueFamily.queueCount > 0 && queueFamily.queueFlags & VK_QUEUE_TRANSFER_BIT &&
+				!(queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT);
+			if (isTransferOnly && (indices.transferFamilyIndex == UINT32_MAX || !(queueFamily.queueFlags & VK_QUEUE_COMPUTE_BIT)))
+				indices.transferFamilyIndex = index;
 
 			++index;
 		}
 
+		if (indices.transferFamilyIndex == UINT32_MAX)
+			indices.transferFamilyIndex = indices.graphicsFamilyIndex;
+
 		return indices;
 	}
 
@@ -347,33 +428,8 @@ namespace VkUtils
 		return buffer;
 	}
 
-	VkDeviceMemory AllocateBufferMemory(VkPhysicalDevice physDevice, VkDevice device, VkBuffer buffer, VkMemoryPropertyFlags memProps)
-	{
-		VkDeviceMemory mem = VK_NULL_HANDLE;
-
-		VkMemoryRequirements memRequire{};
-		vkGetBufferMemoryRequirements(device, buffer, &memRequire);
-
-		auto suitableMemType = VkUtils::FindMemoryType(physDevice, memRequire.memoryTypeBits, memProps);
-		if (suitableMemType == UINT32_MAX)
-			throw std::runtime_error("\nVULKAN ERROR : Failed to find suitable memory type for VERTEX BUFFER !\n");
-
-		VkMemoryAllocateInfo allocInfo{};
-		allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-		allocInfo.allocationSize = memRequire.size;
-		allocInfo.memoryTypeIndex = suitableMemType;
-
-		if (vkAllocateMemory(device, &allocInfo, nullptr, &mem) != VK_SUCCESS)
-			throw std::runtime_error("\nVULKAN ERROR : Failed to allocate memory !\n");
-
-		if (vkBindBufferMemory(device, buffer, mem, 0) != VK_SUCCESS)
-			throw std::runtime_error("\nVULKAN ERROR : Failed to bind VERTEX BUFFER and DEVICE MEMORY !\n");
-
-		return mem;
-	}
-
-	void AllocateImage2D(VkPhysicalDevice physicalDevice, VkDevice device, VkExtent3D extent, VkFormat format, VkImageUsageFlags usage, uint32_t mipLevels,
-		VkSampleCountFlagBits samples, VkImage* pImage, VkDeviceMemory* pMemory)
+	void AllocateImage2D(DeviceAllocator& allocator, VkDevice device, VkExtent3D extent, VkFormat format, VkImageUsageFlags usage, uint32_t mipLevels,
+		VkSampleCountFlagBits samples, MemoryCategory category, VkImage* pImage, DeviceAllocation* pAllocation)
 	{
 		VkImageCreateInfo createInfo{};
 		createInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
@@ -391,18 +447,7 @@ namespace VkUtils
 		if (vkCreateImage(device, &createInfo, nullptr, pImage) != VK_SUCCESS)
 			throw std::runtime_error("\nVULKAN ERROR : Failed to create image !\n");
 
-		VkMemoryRequirements memRequire{};
-		vkGetImageMemoryRequirements(device, *pImage, &memRequire);
-
-		VkMemoryAllocateInfo allocInfo{};
-		allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-		allocInfo.allocationSize = memRequire.size;
-		allocInfo.memoryTypeIndex = VkUtils::FindMemoryType(physicalDevice, memRequire.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-
-		if (vkAllocateMemory(device, &allocInfo, nullptr, pMemory) != VK_SUCCESS)
-			throw std::runtime_error("\nVULKAN ERROR : Failed to allocate memory for image !\n");
-
-		vkBindImageMemory(device, *pImage, *pMemory, 0);
+		*pAllocation = allocator.AllocateImage(*pImage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, category);
 	}
 
 	uint32_t FindMemoryType(VkPhysicalDevice physicalDevice, uint32_t allowedType, VkMemoryPropertyFlags properties)
@@ -432,22 +477,62 @@ namespace VkUtils
 
 	VkFormat FindSupportedFormat(VkPhysicalDevice physicalDevice, const std::vector<VkFormat>& formats, VkImageTiling imageTiling, VkFormatFeatureFlags feature)
 	{
-		VkFormatProperties props{};
 		for (const auto& format : formats)
 		{
-			vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &props);
-
-			bool is_supported_linear_feature = (props.linearTilingFeatures & feature) == feature;
-			bool is_supported_optimal_feature = (props.optimalTilingFeatures & feature) == feature;
-			if (imageTiling == VK_IMAGE_TILING_LINEAR && is_supported_linear_feature)
-				return format;
-			else if (imageTiling == VK_IMAGE_TILING_OPTIMAL && is_supported_optimal_feature)
+			if (IsFormatSupported(physicalDevice, format, imageTiling, feature))
 				return format;
 		}
 		
 		throw std::runtime_error("\nVULKAN ERROR : Don't find any supported formats !\n");
 	}
 
+	bool IsFormatSupported(VkPhysicalDevice physicalDevice, VkFormat format, VkImageTiling imageTiling, VkFormatFeatureFlags feature)
+	{
+		VkFormatProperties props{};
+		vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &props);
+
+		bool is_supported_linear_feature = (props.linearTilingFeatures & feature) == feature;
+		bool is_supported_optimal_feature = (props.optimalTilingFeatures & feature) == feature;
+		if (imageTiling == VK_IMAGE_TILING_LINEAR)
+			return is_supported_linear_feature;
+		else if (imageTiling == VK_IMAGE_TILING_OPTIMAL)
+			return is_supported_optimal_feature;
+
+		return false;
+	}
+
+	uint32_t GetTextureFormatBlockExtent(VkFormat format)
+	{
+		return IsBlockCompressedFormat(format) ? 4 : 1;
+	}
+
+	uint32_t GetTextureFormatBlockSize(VkFormat format)
+	{
+		switch (format)
+		{
+		case VK_FORMAT_R8G8B8A8_UNORM:
+		case VK_FORMAT_R8G8B8A8_SRGB:
+			return 4;
+		case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+		case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+		case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+		case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+			return 8;
+		case VK_FORMAT_BC3_UNORM_BLOCK:
+		case VK_FORMAT_BC3_SRGB_BLOCK:
+		case VK_FORMAT_BC7_UNORM_BLOCK:
+		case VK_FORMAT_BC7_SRGB_BLOCK:
+			return 16;
+		default:
+			return 0;
+		}
+	}
+
+	bool IsBlockCompressedFormat(VkFormat format)
+	{
+		return GetTextureFormatBlockSize(format) != 0 && format != VK_FORMAT_R8G8B8A8_UNORM && format != VK_FORMAT_R8G8B8A8_SRGB;
+	}
+
 	VkSampleCountFlagBits FindMaxUsableSampleCount(VkPhysicalDevice physicalDevice)
 	{
 		VkPhysicalDeviceProperties physicalDeviceProperties;
@@ -469,35 +554,6 @@ namespace VkUtils
 		return format == VK_FORMAT_D32_SFLOAT_S8_UINT || format == VK_FORMAT_D24_UNORM_S8_UINT;
 	}
 
-	void BeginSingleTimeCommands(VkDevice device, VkCommandPool cmdPool, VkCommandBuffer* pCmdBuffer)
-	{
-		VkCommandBufferAllocateInfo allocInfo{};
-		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-		allocInfo.commandPool = cmdPool;
-		allocInfo.commandBufferCount = 1;
-		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-		vkAllocateCommandBuffers(device, &allocInfo, pCmdBuffer);
-
-		VkCommandBufferBeginInfo beginInfo{};
-		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-		vkBeginCommandBuffer(*pCmdBuffer, &beginInfo);
-
-	}
-
-	void EndSingleTimeCommands(VkQueue queue, VkCommandBuffer cmdBuffer)
-	{
-		vkEndCommandBuffer(cmdBuffer);
-
-		VkSubmitInfo submitInfo{};
-		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-		submitInfo.commandBufferCount = 1;
-		submitInfo.pCommandBuffers = &cmdBuffer;
-		vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE);
-
-		vkQueueWaitIdle(queue);
-	}
-
 	void CopyBuffer(VkCommandBuffer cmdBuffer, VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize bufferSize)
 	{
 		VkBufferCopy bufferCopy{};
@@ -507,38 +563,23 @@ namespace VkUtils
 		vkCmdCopyBuffer(cmdBuffer, srcBuffer, dstBuffer, 1, &bufferCopy);
 	}
 
-	void CreateImageFromFile(const char* fileName, VkPhysicalDevice physicalDevice, VkDevice device, VkQueue queue, VkCommandPool cmdPool,
-		VkBuffer* pBuffer, VkDeviceMemory* pMemory, VkExtent3D* extent)
+	void DecodedPixelsDeleter::operator()(uint8_t* pixels) const
+	{
+		stbi_image_free(pixels);
+	}
+
+	DecodedPixels DecodeImageFile(const char* fileName, VkExtent3D* pExtent)
 	{
 		int width, height, channel;
 
-		stbi_uc* pixels = stbi_load(fileName, &width, &height, &channel, STBI_rgb_alpha);
+		DecodedPixels pixels(stbi_load(fileName, &width, &height, &channel, STBI_rgb_alpha));
 		if (!pixels)
-			throw std::runtime_error("\nERROR : Failed to load texture image from file !\n");
-
-		extent->width = width;
-		extent->height = height;
-		extent->depth = 1;
-		VkDeviceSize imageSize = width * height * kBytesPerPixel;
-		*pBuffer = CreateBuffer(device, imageSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
-		*pMemory = AllocateBufferMemory(physicalDevice, device, *pBuffer, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-
-		auto transferBuffer = CreateBuffer(device, imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
-		auto transferMemory = AllocateBufferMemory(physicalDevice, device, transferBuffer, 
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-
-		void* data = nullptr;
-		vkMapMemory(device, transferMemory, 0, imageSize, 0, &data);
-		memcpy(data, pixels, imageSize);
-		vkUnmapMemory(device, transferMemory);
-
-		VkCommandBuffer tmpCmdBuffer;
-		BeginSingleTimeCommands(device, cmdPool, &tmpCmdBuffer);
-		CopyBuffer(tmpCmdBuffer, transferBuffer, *pBuffer, imageSize);
-		EndSingleTimeCommands(queue, tmpCmdBuffer);
+			return nullptr;
 
-		vkDestroyBuffer(device, transferBuffer, nullptr);
-		vkFreeMemory(device, transferMemory, nullptr);
+		pExtent->width = width;
+		pExtent->height = height;
+		pExtent->depth = 1;
+		return pixels;
 	}
 
 	uint32_t CalculateMipLevels(const VkExtent3D& extent)
@@ -546,6 +587,21 @@ namespace VkUtils
 		return static_cast<uint32_t>(std::floor(std::log2(std::max(extent.width, extent.height)))) + 1;;
 	}
 
+	void GetFrustumPlanes(const glm::mat4& viewProj, glm::vec4 planes[6])
+	{
+		// Clip space is -w <= x, y <= w and 0 <= z <= w, each bound is a combination of viewProj's rows
+		glm::mat4 rows = glm::transpose(viewProj);
+		planes[0] = rows[3] + rows[0];		// left
+		planes[1] = rows[3] - rows[0];		// right
+		planes[2] = rows[3] + rows[1];		// bottom
+		planes[3] = rows[3] - rows[1];		// top
+		planes[4] = rows[2];				// near
+		planes[5] = rows[3] - rows[2];		// far
+
+		for (uint32_t i = 0; i < 6; ++i)
+			planes[i] /= glm::length(glm::vec3(planes[i]));
+	}
+
 	void TransitionImageLayout(VkCommandBuffer cmdBuffer, VkImage image, VkImageLayout oldLayout, VkImageLayout newLayout, uint32_t mipLevels)
 	{
 		VkImageMemoryBarrier barrier{};
@@ -601,6 +657,98 @@ namespace VkUtils
 			1, &barrier);
 	}
 
+	void TransferBufferOwnership(VkCommandBuffer srcCmdBuffer, VkCommandBuffer dstCmdBuffer, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size,
+		uint32_t srcFamilyIndex, uint32_t dstFamilyIndex, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess)
+	{
+		VkBufferMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+		barrier.buffer = buffer;
+		barrier.offset = offset;
+		barrier.size = size;
+		barrier.srcQueueFamilyIndex = srcFamilyIndex;
+		barrier.dstQueueFamilyIndex = dstFamilyIndex;
+
+		// Release only makes the writes available, acquire makes them visible
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = 0;
+		vkCmdPipelineBarrier(srcCmdBuffer,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+			0,
+			0, nullptr,
+			1, &barrier,
+			0, nullptr);
+
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = dstAccess;
+		vkCmdPipelineBarrier(dstCmdBuffer,
+			VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, dstStage,
+			0,
+			0, nullptr,
+			1, &barrier,
+			0, nullptr);
+	}
+
+	void TransferImageOwnership(VkCommandBuffer srcCmdBuffer, VkCommandBuffer dstCmdBuffer, VkImage image, uint32_t mipLevels,
+		VkImageLayout oldLayout, VkImageLayout newLayout, uint32_t srcFamilyIndex, uint32_t dstFamilyIndex, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess)
+	{
+		VkImageMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.image = image;
+		// Both halves must do the same layout change
+		barrier.oldLayout = oldLayout;
+		barrier.newLayout = newLayout;
+		barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		barrier.subresourceRange.levelCount = mipLevels;
+		barrier.subresourceRange.baseMipLevel = 0;
+		barrier.subresourceRange.layerCount = 1;
+		barrier.subresourceRange.baseArrayLayer = 0;
+		barrier.srcQueueFamilyIndex = srcFamilyIndex;
+		barrier.dstQueueFamilyIndex = dstFamilyIndex;
+
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = 0;
+		vkCmdPipelineBarrier(srcCmdBuffer,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+			0,
+			0, nullptr,
+			0, nullptr,
+			1, &barrier);
+
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = dstAccess;
+		vkCmdPipelineBarrier(dstCmdBuffer,
+			VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, dstStage,
+			0,
+			0, nullptr,
+			0, nullptr,
+			1, &barrier);
+	}
+
+	void SubmitWithOwnershipTransfer(VkQueue srcQueue, VkCommandBuffer srcCmdBuffer, VkQueue dstQueue, VkCommandBuffer dstCmdBuffer,
+		VkSemaphore semaphore, VkFence fence)
+	{
+		VkSubmitInfo submitInfo{};
+		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &srcCmdBuffer;
+		submitInfo.signalSemaphoreCount = 1;
+		submitInfo.pSignalSemaphores = &semaphore;
+		if (vkQueueSubmit(srcQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS)
+			throw std::runtime_error("\nVULKAN ERROR : Failed to submit ownership release !\n");
+
+		// Acquire barriers start at top of pipe
+		VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+		submitInfo = {};
+		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submitInfo.waitSemaphoreCount = 1;
+		submitInfo.pWaitSemaphores = &semaphore;
+		submitInfo.pWaitDstStageMask = &waitStage;
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &dstCmdBuffer;
+		if (vkQueueSubmit(dstQueue, 1, &submitInfo, fence) != VK_SUCCESS)
+			throw std::runtime_error("\nVULKAN ERROR : Failed to submit ownership acquire !\n");
+	}
+
 	void CopyBufferToImage(VkCommandBuffer cmdBuffer, VkExtent3D imageExtent, VkBuffer srcBuffer, VkImage dstImage)
 	{
 		VkBufferImageCopy region{};
@@ -617,6 +765,32 @@ namespace VkUtils
 		vkCmdCopyBufferToImage(cmdBuffer, srcBuffer, dstImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
 	}
 
+	void CopyBufferToImageMipLevels(VkCommandBuffer cmdBuffer, VkExtent3D imageExtent, const std::vector<VkDeviceSize>& levelOffsets,
+		VkBuffer srcBuffer, VkImage dstImage)
+	{
+		std::vector<VkBufferImageCopy> regions(levelOffsets.size());
+
+		for (uint32_t level = 0; level < levelOffsets.size(); ++level)
+		{
+			uint32_t mipWidth = std::max(1u, imageExtent.width >> level);
+			uint32_t mipHeight = std::max(1u, imageExtent.height >> level);
+
+			auto& region = regions[level];
+			region = {};
+			region.bufferOffset = levelOffsets[level];
+			region.bufferRowLength = 0;
+			region.bufferImageHeight = 0;
+			region.imageExtent = { mipWidth, mipHeight, 1 };
+			region.imageOffset = { 0,0,0 };
+			region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			region.imageSubresource.layerCount = 1;
+			region.imageSubresource.baseArrayLayer = 0;
+			region.imageSubresource.mipLevel = level;
+		}
+
+		vkCmdCopyBufferToImage(cmdBuffer, srcBuffer, dstImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast<uint32_t>(regions.size()), regions.data());
+	}
+
 	VkImageView CreateImageView2D(VkDevice device, VkImage image, VkFormat format, VkImageAspectFlags aspect, uint32_t mipLevels)
 	{
 		VkImageViewCreateInfo createInfo{};
@@ -666,7 +840,7 @@ namespace VkUtils
 		return sampler;
 	}
 
-	void LoadModel(const char* modelPath, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices)
+	void LoadModel(const char* modelPath, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices, ModelLoadStats* pStats)
 	{
 		tinyobj::attrib_t attrib;
 		std::vector<tinyobj::shape_t> shapes;
@@ -677,40 +851,108 @@ namespace VkUtils
 			throw std::runtime_error(warn + err);
 		}
 
+		size_t cornerCount = 0;
+		for (const auto& shape : shapes)
+			cornerCount += shape.mesh.indices.size();
+
+		indices.reserve(indices.size() + cornerCount);
+
+		// Unique vertices can't exceed corner count, so the map never has to grow
+		VertexIndexMap uniqueVertices(cornerCount);
+		size_t firstVertex = vertices.size();
+
 		for (const auto& shape : shapes) {
 			for (const auto& index : shape.mesh.indices) {
-				Vertex vertex{};
+				VertexKey key{ index.vertex_index, index.texcoord_index, index.normal_index };
+				auto newIndex = static_cast<uint32_t>(vertices.size());
+				auto vertexIndex = uniqueVertices.FindOrInsert(key, newIndex);
 
-				vertex.Pos = {
-				attrib.vertices[3 * index.vertex_index + 0],
-				attrib.vertices[3 * index.vertex_index + 1],
-				attrib.vertices[3 * index.vertex_index + 2]
-				};
+				if (vertexIndex == newIndex) {
+					Vertex vertex{};
 
-				vertex.TexCoord = {
-				attrib.texcoords[2 * index.texcoord_index + 0],
-				1.0f - attrib.texcoords[2 * index.texcoord_index + 1]
-				};
+					vertex.Pos = {
+					attrib.vertices[3 * index.vertex_index + 0],
+					attrib.vertices[3 * index.vertex_index + 1],
+					attrib.vertices[3 * index.vertex_index + 2]
+					};
 
-				vertex.Color = { 1.0f, 1.0f, 1.0f };
+					if (index.texcoord_index >= 0) {
+						vertex.TexCoord = {
+						attrib.texcoords[2 * index.texcoord_index + 0],
+						1.0f - attrib.texcoords[2 * index.texcoord_index + 1]
+						};
+					}
 
-				vertices.push_back(vertex);
-				indices.push_back(static_cast<uint32_t>(indices.size()));
+					vertex.Color = { 1.0f, 1.0f, 1.0f };
+
+					vertices.push_back(vertex);
+				}
+
+				indices.push_back(vertexIndex);
 			}
 		}
+
+		if (pStats)
+		{
+			pStats->RawVertexCount = cornerCount;
+			pStats->UniqueVertexCount = vertices.size() - firstVertex;
+			pStats->IndexCount = cornerCount;
+		}
 	}
-	void GenerateMipmaps(VkPhysicalDevice physicalDevice, VkDevice device, VkCommandPool cmdPool, VkQueue queue, VkImage image, VkFormat format, VkExtent3D extent, uint32_t mipLevels)
+
+	void BenchmarkModelLoaders(const char* modelPath, uint32_t iterations)
 	{
-		VkFormatProperties formatProperties;
-		vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &formatProperties);
+		using Clock = std::chrono::high_resolution_clock;
+		iterations = std::max(1u, iterations);
+
+		std::vector<Vertex> tinyobjVertices, parallelVertices;
+		std::vector<uint32_t> tinyobjIndices, parallelIndices;
+		ModelLoadStats tinyobjStats, parallelStats;
+
+		double tinyobjMs = 0.0;
+		for (uint32_t i = 0; i < iterations; ++i)
+		{
+			tinyobjVertices.clear();
+			tinyobjIndices.clear();
+			auto start = Clock::now();
+			LoadModel(modelPath, tinyobjVertices, tinyobjIndices, &tinyobjStats);
+			tinyobjMs += std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+		}
 
-		if (!(formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT)) {
-			throw std::runtime_error("\nVULKAN ERROR : Texture image format does not support linear blitting!\n");
+		double parallelMs = 0.0;
+		for (uint32_t i = 0; i < iterations; ++i)
+		{
+			parallelVertices.clear();
+			parallelIndices.clear();
+			auto start = Clock::now();
+			LoadModelParallel(modelPath, parallelVertices, parallelIndices, &parallelStats);
+			parallelMs += std::chrono::duration<double, std::milli>(Clock::now() - start).count();
 		}
 
-		VkCommandBuffer cmdBuffer;
-		BeginSingleTimeCommands(device, cmdPool, &cmdBuffer);
+		tinyobjMs /= iterations;
+		parallelMs /= iterations;
+
+		std::cout << "\nOBJ LOADER BENCHMARK : " << modelPath << " (" << iterations << " iterations)\n";
+		std::cout << "\ttinyobj + weld : " << tinyobjMs << " ms, " << tinyobjStats.UniqueVertexCount << " vertices, "
+			<< tinyobjStats.IndexCount << " indices\n";
+		std::cout << "\tparallel (" << std::max(1u, std::thread::hardware_concurrency()) << " threads) : " << parallelMs << " ms, "
+			<< parallelStats.UniqueVertexCount << " vertices, " << parallelStats.IndexCount << " indices\n";
+		std::cout << "\tspeed up : " << (parallelMs > 0.0 ? tinyobjMs / parallelMs : 0.0) << "x\n";
+
+		// Both weld in file order, so the buffers match one for one. Float parsers may round the last bit differently
+		auto isSameFloat = [](float a, float b) { return std::abs(a - b) <= 1e-6f * std::max(1.0f, std::abs(a)); };
+		auto isSameVertex = [&isSameFloat](const Vertex& a, const Vertex& b) {
+			return isSameFloat(a.Pos.x, b.Pos.x) && isSameFloat(a.Pos.y, b.Pos.y) && isSameFloat(a.Pos.z, b.Pos.z) &&
+				a.Color == b.Color && isSameFloat(a.TexCoord.x, b.TexCoord.x) && isSameFloat(a.TexCoord.y, b.TexCoord.y);
+		};
+
+		if (tinyobjIndices != parallelIndices || tinyobjVertices.size() != parallelVertices.size() ||
+			!std::equal(tinyobjVertices.begin(), tinyobjVertices.end(), parallelVertices.begin(), isSameVertex))
+			std::cout << "\tWARNING : loaders produced different meshes !\n";
+	}
 
+	void GenerateMipmaps(VkCommandBuffer cmdBuffer, VkImage image, VkExtent3D extent, uint32_t mipLevels)
+	{
 		VkImageMemoryBarrier barrier{};
 		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
 		barrier.image = image;
@@ -783,7 +1025,5 @@ namespace VkUtils
 			0, nullptr,
 			0, nullptr,
 			1, &barrier);
-
-		EndSingleTimeCommands(queue, cmdBuffer);
 	}
 }
@@ -1,6 +1,7 @@
 #pragma once
 #include <vector>
 #include <chrono>
+#include <memory>
 
 #include <vulkan/vulkan.h>
 
@@ -16,10 +17,16 @@ namespace VkUtils
 
 namespace VkUtils
 {
+	class DeviceAllocator;
+	struct DeviceAllocation;
+	enum class MemoryCategory;
+
 	struct QueueFamilyIndices
 	{
 		uint32_t graphicsFamilyIndex = UINT32_MAX;
 		uint32_t presentationFamilyIndex = UINT32_MAX;
+		// Transfer only family if the device has one (copy engine running beside rendering), graphics family otherwise
+		uint32_t transferFamilyIndex = UINT32_MAX;
 
 		bool IsValid(){ return graphicsFamilyIndex != UINT32_MAX && presentationFamilyIndex != UINT32_MAX; }
 	};
@@ -41,12 +48,86 @@ namespace VkUtils
 		static std::vector<VkVertexInputAttributeDescription> GetAttributeDescriptions();
 	};
 
+	// Vertex layouts a mesh can be uploaded with, each one has its own vertex shader
+	enum class VertexFormat : uint32_t
+	{
+		Standard = 0,		// Vertex
+		Packed = 1,			// PackedVertex
+	};
+
+	// 16 bytes instead of 32, dequantized in shader.vert :
+	// position in unorm16 inside mesh bounds, octahedral normal in snorm16, half float UVs, no color
+	struct PackedVertex
+	{
+		uint16_t Pos[4];			// w is padding
+		int16_t Normal[2];
+		uint16_t TexCoord[2];
+
+		static VkVertexInputBindingDescription GetBindingDescription();
+		static std::vector<VkVertexInputAttributeDescription> GetAttributeDescriptions();
+	};
+
+	// Per instance attributes, vertex binding 1 at instance rate after either vertex layout's binding 0
+	struct InstanceData
+	{
+		glm::mat4 Model;			// locations 3 to 6, one column each
+
+		static VkVertexInputBindingDescription GetBindingDescription();
+		static std::vector<VkVertexInputAttributeDescription> GetAttributeDescriptions();
+	};
+
+	// Part of a mesh drawn with one vkCmdDrawIndexed, indices are relative to VertexOffset
+	struct SubMesh
+	{
+		uint32_t FirstIndex;
+		uint32_t IndexCount;
+		int32_t VertexOffset;
+	};
+
+	// One level of detail : a run of sub meshes drawn instead of the full mesh
+	struct MeshLod
+	{
+		uint32_t FirstSubMesh;
+		uint32_t SubMeshCount;
+		float Error;				// object space distance the level may be off the full mesh, 0 for LOD 0
+		uint32_t IndexCount;		// of all its sub meshes
+	};
+
+	struct BoundingSphere
+	{
+		glm::vec3 Center;
+		float Radius;
+	};
+
+	// Position = PackedVertex::Pos * Scale + Offset, pushed to shader.vert within DrawPushConstants
+	struct VertexQuantization
+	{
+		glm::vec4 Offset;
+		glm::vec4 Scale;
+	};
+
+	struct ModelLoadStats
+	{
+		size_t RawVertexCount = 0;			// face corners in the file, one vertex each without welding
+		size_t UniqueVertexCount = 0;		// vertices left after welding identical corners
+		size_t IndexCount = 0;
+	};
+
+	// Per frame, shared by every draw
 	struct UniformBufferObject
 	{
-		glm::mat4 Model;
 		glm::mat4 View;
 		glm::mat4 Proj;
 	};
+
+	// Per draw, pushed without touching descriptors or buffers. Matches shader.vert's DrawConstants block,
+	// 100 bytes fit the 128 every device supports
+	struct DrawPushConstants
+	{
+		glm::mat4 Model;
+		VertexQuantization Quantization;	// ignored by unpacked vertices
+		uint32_t MaterialIndex;
+	};
 }
 
 namespace VkUtils
@@ -65,6 +146,9 @@ namespace VkUtils
 
 	bool CheckVkDeviceExtensionsSupport(VkPhysicalDevice device, const std::vector<const char*>& requiredDeviceExtensions);
 
+	// For optional extensions, enabled only when present
+	bool IsDeviceExtensionSupported(VkPhysicalDevice device, const char* extensionName);
+
 	bool CheckVkPhysicalDeviceSuitable(VkPhysicalDevice device, VkSurfaceKHR surface);
 
 	QueueFamilyIndices GetQueueFamiilyIndices(VkPhysicalDevice device, VkSurfaceKHR surface);
@@ -80,11 +164,9 @@ namespace VkUtils
 	// If function fails to create vertex buffer, it returns VK_NULL_HANDLE
 	VkBuffer CreateBuffer(VkDevice device, uint64_t bufferSize, VkBufferUsageFlags usageFlags);
 
-	// If it failed to create VkDeviceMemory , it returns VK_NULL_HANDLE
-	VkDeviceMemory AllocateBufferMemory(VkPhysicalDevice physDevice, VkDevice device, VkBuffer buffer, VkMemoryPropertyFlags memProps);
-
-	void AllocateImage2D(VkPhysicalDevice physicalDevice, VkDevice device, VkExtent3D extent, VkFormat format, VkImageUsageFlags usage, uint32_t mipLevels,
-		VkSampleCountFlagBits samples, VkImage* pImage, VkDeviceMemory* pMemory);
+	// Device local memory comes from allocator
+	void AllocateImage2D(DeviceAllocator& allocator, VkDevice device, VkExtent3D extent, VkFormat format, VkImageUsageFlags usage, uint32_t mipLevels,
+		VkSampleCountFlagBits samples, MemoryCategory category, VkImage* pImage, DeviceAllocation* pAllocation);
 
 	// If function doesn't find any suitable memory type, it returns UINT32_MAX
 	uint32_t FindMemoryType(VkPhysicalDevice physicalDevice, uint32_t allowedType, VkMemoryPropertyFlags properties);
@@ -93,31 +175,73 @@ namespace VkUtils
 
 	VkFormat FindSupportedFormat(VkPhysicalDevice physicalDevice, const std::vector<VkFormat>& formats, VkImageTiling imageTiling, VkFormatFeatureFlags feature);
 
-	VkSampleCountFlagBits FindMaxUsableSampleCount(VkPhysicalDevice physicalDevice);
+	bool IsFormatSupported(VkPhysicalDevice physicalDevice, VkFormat format, VkImageTiling imageTiling, VkFormatFeatureFlags feature);
 
-	bool HasStencilComponent(VkFormat format);
+	// Texture formats that can be loaded : RGBA8 and BC1/BC3/BC7
+	// Block extent is 4 for block compressed formats and 1 otherwise, block size is in bytes (0 for any other format)
+	uint32_t GetTextureFormatBlockExtent(VkFormat format);
+	uint32_t GetTextureFormatBlockSize(VkFormat format);
+	bool IsBlockCompressedFormat(VkFormat format);
 
-	void BeginSingleTimeCommands(VkDevice device, VkCommandPool cmdPool, VkCommandBuffer* pCmdBuffer);
+	VkSampleCountFlagBits FindMaxUsableSampleCount(VkPhysicalDevice physicalDevice);
 
-	void EndSingleTimeCommands(VkQueue queue, VkCommandBuffer cmdBuffer);
+	bool HasStencilComponent(VkFormat format);
 
 	void CopyBuffer(VkCommandBuffer cmdBuffer, VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize bufferSize);
 
-	void CreateImageFromFile(const char* fileName, VkPhysicalDevice physicalDevice, VkDevice device, VkQueue queue, VkCommandPool cmdPool, 
-		VkBuffer* pBuffer, VkDeviceMemory* pMemory, VkExtent3D* extent);
+	// Pixels are kept in the decoder's own allocation, uploads copy them to staging memory directly
+	struct DecodedPixelsDeleter
+	{
+		void operator()(uint8_t* pixels) const;
+	};
+	using DecodedPixels = std::unique_ptr<uint8_t[], DecodedPixelsDeleter>;
+
+	// Decode an image file to RGBA8 pixels, no Vulkan calls so it can run on any thread
+	// Return nullptr if the file is missing or can't be decoded
+	DecodedPixels DecodeImageFile(const char* fileName, VkExtent3D* pExtent);
 
 	uint32_t CalculateMipLevels(const VkExtent3D& extent);
 
+	// Planes of the frustum viewProj maps to depth [0, 1], in the space viewProj transforms from
+	// xyz is the normalized inward normal, w the distance : a point is inside when dot(xyz, p) + w >= 0 for all six
+	void GetFrustumPlanes(const glm::mat4& viewProj, glm::vec4 planes[6]);
+
 	void TransitionImageLayout(VkCommandBuffer cmdBuffer, VkImage image, VkImageLayout oldLayout, VkImageLayout newLayout, uint32_t mipLevels);
 
+	// Queue family ownership transfer after transfer writes : release recorded in srcCmdBuffer (source family's queue),
+	// acquire in dstCmdBuffer (destination family's queue), whose submission must wait for the source one
+	void TransferBufferOwnership(VkCommandBuffer srcCmdBuffer, VkCommandBuffer dstCmdBuffer, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size,
+		uint32_t srcFamilyIndex, uint32_t dstFamilyIndex, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess);
+
+	// Same for every mip level of an image, its layout changes from oldLayout to newLayout on the way
+	void TransferImageOwnership(VkCommandBuffer srcCmdBuffer, VkCommandBuffer dstCmdBuffer, VkImage image, uint32_t mipLevels,
+		VkImageLayout oldLayout, VkImageLayout newLayout, uint32_t srcFamilyIndex, uint32_t dstFamilyIndex, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess);
+
+	// Submit srcCmdBuffer to srcQueue, then dstCmdBuffer to dstQueue waiting for it through semaphore
+	// fence is signaled once both are done
+	void SubmitWithOwnershipTransfer(VkQueue srcQueue, VkCommandBuffer srcCmdBuffer, VkQueue dstQueue, VkCommandBuffer dstCmdBuffer,
+		VkSemaphore semaphore, VkFence fence);
+
 	void CopyBufferToImage(VkCommandBuffer cmdBuffer, VkExtent3D imageExtent, VkBuffer srcBuffer, VkImage dstImage);
 
+	// srcBuffer holds one tightly packed mip level at each of levelOffsets, starting with the largest one
+	// Works for block compressed images too, as blocks are tightly packed as well
+	void CopyBufferToImageMipLevels(VkCommandBuffer cmdBuffer, VkExtent3D imageExtent, const std::vector<VkDeviceSize>& levelOffsets,
+		VkBuffer srcBuffer, VkImage dstImage);
+
 	VkImageView CreateImageView2D(VkDevice device, VkImage image, VkFormat format, VkImageAspectFlags aspect, uint32_t mipLevels);
 
 	VkSampler CreateSampler(VkPhysicalDevice physicalDevice, VkDevice device, uint32_t mipLevels);
 
-	void LoadModel(const char* modelPath, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices);
+	// Face corners sharing the same position/uv/normal indices are welded into one vertex
+	// pStats is optional, pass nullptr to skip statistics
+	void LoadModel(const char* modelPath, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices, ModelLoadStats* pStats = nullptr);
+
+	// Load the same file with LoadModel (tinyobj) and LoadModelParallel and print timings of both
+	void BenchmarkModelLoaders(const char* modelPath, uint32_t iterations);
 
-	void GenerateMipmaps(VkPhysicalDevice physicalDevice, VkDevice device, VkCommandPool cmdPool, VkQueue queue, VkImage image, VkFormat format, VkExtent3D extent, uint32_t mipLevels);
+	// Blit every level from the previous one and leave the image in shader read layout
+	// Level 0 must be in transfer dst layout, its format must support linear filtering
+	void GenerateMipmaps(VkCommandBuffer cmdBuffer, VkImage image, VkExtent3D extent, uint32_t mipLevels);
 }
 
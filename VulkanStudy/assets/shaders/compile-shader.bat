@@ -1,3 +1,5 @@
 %VULKAN_SDK%/Bin/glslangValidator.exe -V shader.vert
+%VULKAN_SDK%/Bin/glslangValidator.exe -V -DPACKED_VERTEX shader.vert -o vert_packed.spv
 %VULKAN_SDK%/Bin/glslangValidator.exe -V shader.frag
+%VULKAN_SDK%/Bin/glslangValidator.exe -V cull.comp -o cull.spv
 pause
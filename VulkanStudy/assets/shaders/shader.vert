@@ -1,24 +1,63 @@
 #version 450 		// GLSL 4.5
 
+// Per frame
 layout (set = 0, binding = 0) uniform UniformBufferObject
 {
-	mat4 model;
 	mat4 view;
 	mat4 proj;
 } ubo;
 
+// Per draw (VkUtils::DrawPushConstants)
+layout (push_constant) uniform DrawConstants
+{
+	mat4 model;
+	// Mesh bounds to rebuild packed positions from quantized values
+	vec4 quantizationOffset;
+	vec4 quantizationScale;
+	uint materialIndex;
+} draw;
+
+#ifdef PACKED_VERTEX
+// Input from vertex buffer (VkUtils::PackedVertex), converted to float by vertex fetch
+layout (location = 0) in vec4 inPos;			// unorm16, xyz inside mesh bounds
+layout (location = 1) in vec2 inNormal;			// snorm16, octahedral
+layout (location = 2) in vec2 inTexCoord;		// half float
+#else
 // Input from vertex buffer
 layout (location = 0) in vec3 inPos;
 layout (location = 1) in vec3 inColor;
 layout (location = 2) in vec2 inTexCoord;
+#endif
+// Input from instance buffer (VkUtils::InstanceData)
+layout (location = 3) in mat4 instanceModel;
 
 // Output color to fragment shader
 layout (location = 0) out vec3 fragColor;
 layout (location = 1) out vec2 texCoord;
+#ifdef PACKED_VERTEX
+layout (location = 2) out vec3 fragNormal;
+
+vec3 DecodeOctahedral(vec2 encoded)
+{
+	vec3 normal = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+	float fold = max(-normal.z, 0.0);
+	normal.x += normal.x >= 0.0 ? -fold : fold;
+	normal.y += normal.y >= 0.0 ? -fold : fold;
+	return normalize(normal);
+}
+#endif
 
 void main()
 {
-	gl_Position = ubo.proj * ubo.view * ubo.model * vec4(inPos,1.0);
+	mat4 model = draw.model * instanceModel;
+#ifdef PACKED_VERTEX
+	vec3 pos = inPos.xyz * draw.quantizationScale.xyz + draw.quantizationOffset.xyz;
+	gl_Position = ubo.proj * ubo.view * model * vec4(pos,1.0);
+	fragColor = vec3(1.0);
+	fragNormal = mat3(model) * DecodeOctahedral(inNormal);
+#else
+	gl_Position = ubo.proj * ubo.view * model * vec4(inPos,1.0);
 	fragColor = inColor;
+#endif
 	texCoord = inTexCoord;
 }
\ No newline at end of file
@@ -1,14 +1,31 @@
 #include <iostream>
 #include <exception>
+#include <cstring>
 
 #include "VkApplication.h"
 
-int main() {
-    
-    VkApplication vkApp(800, 600, "Vulkan Application");
-    
+int main(int argc, char** argv) {
+
     try
     {
+        // --benchmark-obj <file.obj> [iterations] : compare OBJ loaders without starting the renderer
+        if (argc >= 3 && strcmp(argv[1], "--benchmark-obj") == 0)
+        {
+            uint32_t iterations = argc >= 4 ? static_cast<uint32_t>(std::strtoul(argv[3], nullptr, 10)) : 5;
+            VkUtils::BenchmarkModelLoaders(argv[2], iterations);
+            return EXIT_SUCCESS;
+        }
+
+        // --benchmark-culling [objects] [iterations] : compare CPU frustum culling methods without starting the renderer
+        if (argc >= 2 && strcmp(argv[1], "--benchmark-culling") == 0)
+        {
+            uint32_t objectCount = argc >= 3 ? static_cast<uint32_t>(std::strtoul(argv[2], nullptr, 10)) : 100000;
+            uint32_t iterations = argc >= 4 ? static_cast<uint32_t>(std::strtoul(argv[3], nullptr, 10)) : 100;
+            VkUtils::BenchmarkFrustumCulling(objectCount, iterations);
+            return EXIT_SUCCESS;
+        }
+
+        VkApplication vkApp(800, 600, "Vulkan Application");
         vkApp.Run();
     } 
     catch (const std::exception& e)
@@ -18,4 +35,4 @@ int main() {
     }
 
     return EXIT_SUCCESS;
-}
\ No newline at end of file
+}